@@ -29,7 +29,9 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include <EEPROM.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 //////////////////////////////////////////////////////////////////////
 //
@@ -53,6 +55,92 @@ const int TARGET = 0x3C;        // I2C slave address for display
 #   define PIXEL_VALUE_OFF  0
 #endif
 
+// Code placement of the hot drawing and calendar routines. Teensy 4
+// runs all code from ITCM unless it is marked FLASHMEM (FASTRUN changes
+// nothing there), so by default HOT_CODE is empty. Build with
+// -DHOT_CODE=FLASHMEM for the cold variant, run from flash through the
+// cache, and compare the 'c' tables (see casio_cycles).
+#ifndef HOT_CODE
+#   define HOT_CODE
+#endif
+
+//
+// clip rectangle: x1,y1 inclusive, x2,y2 exclusive
+//
+typedef struct {
+    int x1, y1;
+    int x2, y2;
+} CLIP;
+
+#define CLIP_DEPTH  4
+
+//
+// drawing state: the clip stack and the offscreen count. Headless CASIO
+// instances each bring their own (see casio_render()), so host builds
+// can draw many instances on different threads; the watch's own screen
+// uses DRAW_SCREEN. DRAWING points at the one in use, and is per thread
+// where CASIO_TLS is thread_local (tools/host/farm.cpp).
+//
+#ifndef CASIO_TLS
+#   define CASIO_TLS
+#endif
+
+typedef struct {
+    CLIP clip[CLIP_DEPTH];      // clip stack, clip[0] is the whole screen
+    int clip_top;
+    unsigned long offscreen;    // primitives that fell off the screen edge
+} DRAW;
+
+static DRAW DRAW_SCREEN = { { { 0, 0, 128, 64 } } };
+static CASIO_TLS DRAW *DRAWING = &DRAW_SCREEN;
+
+void draw_init(DRAW *d)
+{
+    memset(d, 0, sizeof(*d));
+    d->clip[0].x2 = 128;
+    d->clip[0].y2 = 64;
+}
+
+static struct
+{
+    char frame[FRAME_SIZE];     // last frame sent, the "old" frame of a transition
+    int sink;                   // drop display traffic (benchmarks)
+    unsigned long bytes;        // bytes written to the display
+    unsigned long transfers;    // I2C transactions
+} DISP = {
+    { 0 },
+    0,
+    0,
+    0,
+};
+
+//
+// all display traffic goes through disp_begin/disp_write/disp_end, which
+// count it. With DISP.sink set nothing reaches the I2C bus, but the
+// callers still chunk and format everything as usual.
+//
+void disp_begin()
+{
+    if( ! DISP.sink )
+        Wire.beginTransmission(TARGET);
+}
+
+int disp_write(const char *buf, int len)
+{
+    DISP.bytes += len;
+    if( DISP.sink )
+        return len;
+    return Wire.write(buf, len);
+}
+
+int disp_end()
+{
+    DISP.transfers++;
+    if( DISP.sink )
+        return 0;
+    return Wire.endTransmission();
+}
+
 void disp_setup()
 {
     Wire.setSDA(18);
@@ -99,9 +187,9 @@ int disp_init()
     int len;
 
     // Transmit to Slave
-    Wire.beginTransmission(TARGET);   // Slave address
-    len = Wire.write(databuf, datalen); // Write string to I2C Tx buffer
-    Wire.endTransmission();           // Transmit to Slave
+    disp_begin();                       // Slave address
+    len = disp_write(databuf, datalen); // Write string to I2C Tx buffer
+    disp_end();                         // Transmit to Slave
 
     // Check if error occured
     if( len != datalen )
@@ -112,6 +200,8 @@ int disp_init()
     }
 }
 
+void disp_power_contrast(int x);
+
 int disp_set_contrast(int x)
 {
     char buf[] = {
@@ -121,1119 +211,3407 @@ int disp_set_contrast(int x)
     };
     int len, rc;
 
-    Wire.beginTransmission(TARGET);
+    disp_begin();
     buf[2] = (char)x;
-    len = Wire.write(buf, sizeof(buf));
-    rc = Wire.endTransmission();
+    len = disp_write(buf, sizeof(buf));
+    rc = disp_end();
 
-    if( len != 1 ) {
+    disp_power_contrast(x);
+
+    if( len != sizeof(buf) ) {
         return len;
     }
 
     return rc;
 }
 
-int disp_set_range()
-{
-    char buf[] = {
-            0x00,
-            0x21, 0x00, 0x7f,       // set column start/end range  (0-127)
-            0x22, 0x00, 0x07,       // set page start/end range (0-7)
-    };
-    int len, rc;
-
-    Wire.beginTransmission(TARGET);
-    len = Wire.write(buf, sizeof(buf));
-    rc = Wire.endTransmission();
 
-    if( len != sizeof(buf)) {
-        return len;
-    }
+//////////////////////////////////////////////////////////////////////
+// frame mirror
+//
+// Sends what the display is showing out the serial port, for bug reports
+// and regression tests. tools/framedump.py turns the stream into PBM
+// images.
+//
+// Every packet is a delta against the previous frame the host has:
+//
+//      0xA5                sync
+//      'K' or 'D'          K = key frame, D = delta frame
+//      seq lo, seq hi      packet sequence number
+//      len lo, len hi      payload length
+//      payload
+//
+// A key frame's payload starts with a fill byte; the base frame is 1024
+// copies of it (the blank screen). A delta frame's base is the last frame
+// sent. The rest of the payload is the XOR of the new frame against the
+// base, run length encoded:
+//
+//      0x00 n      n+1 zero bytes
+//      b           one (non-zero) byte
+//
+// In mirror mode a delta is sent after every display update. While the
+// clock is ticking only the seconds digits change, which is around 100
+// bytes per second. 'm' toggles mirror mode; scripts should use console
+// "mirror on" / "mirror off", which don't depend on the current state.
+//
+#define MIRROR_SYNC     0xA5
 
-    return rc;
-}
+static struct
+{
+    int enabled;
+    unsigned short seq;
+    char prev[FRAME_SIZE];                  // what the host has
+    unsigned char buf[6 + 1 + FRAME_SIZE*3/2];
+    unsigned long bytes;                    // total encoded
+} MIRROR;
 
-int disp_update(const char *frame)
+//
+// encode 'frame' XOR 'base' into MIRROR.buf and send it
+//
+void disp_mirror_send(int type, const char *frame, const char *base, int fill)
 {
-    const char buf[] = {
-        0x40,
-    };
-    int i, len, err, rc;
-    const char *p;
+    unsigned char *p, x;
+    int i, run, len;
 
-    err = 0;
+    p = MIRROR.buf + 6;
+    if( type == 'K' )
+        *p++ = (unsigned char)fill;
 
-    p = frame;
-    for(i=0; i < FRAME_SIZE/128; i++)
+    for(i=0; i < FRAME_SIZE; )
     {
-        Wire.beginTransmission(TARGET);
-
-        len = Wire.write(buf, sizeof(buf));
-        if( len != sizeof(buf) )
+        x = frame[i] ^ (base ? base[i] : fill);
+        if( x != 0 )
         {
-            err = 2000 + len;
-            break;
+            *p++ = x;
+            i++;
+            continue;
         }
 
-        len = Wire.write(p, 128);
-        if( len != 128 )
+        run = 0;
+        while( i+run+1 < FRAME_SIZE && run < 255
+                    && (frame[i+run+1] ^ (base ? base[i+run+1] : fill)) == 0 )
         {
-            err = 2000 + len;
-            break;
+            run++;
         }
+        *p++ = 0x00;
+        *p++ = run;
+        i += run + 1;
+    }
 
-        rc = Wire.endTransmission();
-        if( rc )
-        {
-            err = 3000 + rc;
-            break;
-        }
+    len = p - (MIRROR.buf + 6);
 
-        p += 128;
+    MIRROR.buf[0] = MIRROR_SYNC;
+    MIRROR.buf[1] = type;
+    MIRROR.buf[2] = MIRROR.seq & 0xff;
+    MIRROR.buf[3] = MIRROR.seq >> 8;
+    MIRROR.buf[4] = len & 0xff;
+    MIRROR.buf[5] = len >> 8;
+
+    // (a null sink sends nothing, so the host sees no gap in seq)
+    MIRROR.bytes += 6 + len;
+    if( ! DISP.sink )
+    {
+        Serial.write(MIRROR.buf, 6 + len);
+        MIRROR.seq++;
     }
 
-    return err;
+    memcpy(MIRROR.prev, frame, FRAME_SIZE);
 }
 
-void disp_clear()
+//
+// 32 bit FNV-1a hash of a frame
+//
+HOT_CODE unsigned long disp_hash(const char *frame)
 {
-    static int init = 0;
-    static char blank[FRAME_SIZE];
+    unsigned long hash;
+    int i;
 
-    if( init == 0 )
+    hash = 2166136261UL;
+    for(i=0; i < FRAME_SIZE; i++)
     {
-        memset(blank, CLR_MASK, sizeof(blank));
-        init = 1;
+        hash = (hash ^ (unsigned char)frame[i]) * 16777619UL;
     }
-    disp_update(blank);
+
+    return hash & 0xffffffffUL;
 }
 
-void disp_pset(char *frame, int x, int y, int p)
+//
+// send the whole frame currently on the display
+//
+void disp_screenshot()
 {
-    const int WIDTH =   128;
-//  const int HEIGHT =   64;
+    disp_mirror_send('K', DISP.frame, NULL, CLR_MASK);
+}
 
-    if( PIXEL_ON(p) )
+void disp_mirror_enable(int on)
+{
+    MIRROR.enabled = on;
+    if( on )
+        disp_screenshot();
+}
+
+//////////////////////////////////////////////////////////////////////
+// power model
+//
+// OLED current is a fixed part (controller, charge pump) plus a part
+// per lit pixel that scales with the contrast (segment current):
+//
+//      uA = POWER_BASE_UA + lit * POWER_PIXEL_NA/1000 * contrast/255
+//
+// The numbers are for a 0.96" SSD1306 module at 3.3 V, about 0.4 mA
+// with nothing lit and 24 mA with all 8192 pixels lit at full contrast;
+// measure yours and adjust. With BLACK_ON_WHITE most pixels are lit.
+//
+// disp_power_update() runs whenever DISP.frame or the contrast
+// changes: it adds the charge used since the last change and works out
+// the new current. The lit pixels are counted by the burn-in accounting
+// (see burn-in), a set bit is a lit pixel. disp_lit() counts a frame.
+//
+// Console "power" prints the model (see casio_console_power).
+//
+#define POWER_BASE_UA       400
+#define POWER_PIXEL_NA      2880        // per lit pixel at contrast 0xff
+
+static struct
+{
+    int lit;                    // pixels lit in DISP.frame
+    int contrast;
+    unsigned long ua;           // current now
+    unsigned long last;         // micros() of the last update
+    unsigned long long ua_us;   // charge since boot
+    unsigned long long us;      // time covered
+} POWER = { 0, 0x7f };
+
+HOT_CODE int disp_lit(const char *frame)
+{
+    uint32_t w;
+    int i, n;
+
+    n = 0;
+    for(i=0; i < FRAME_SIZE; i += 4)
     {
-        frame[ x + (y>>3) * WIDTH ] |= (1 << (y % 8));
+        memcpy(&w, frame + i, 4);
+        n += __builtin_popcount(w);
     }
-    else
+
+    return n;
+}
+
+unsigned long disp_power_ua(int lit, int contrast)
+{
+    return POWER_BASE_UA
+        + (unsigned long)((unsigned long long)lit * POWER_PIXEL_NA * contrast / (255 * 1000));
+}
+
+int disp_burn_update(const char *frame, unsigned long us);
+
+void disp_power_update()
+{
+    unsigned long now = micros();
+    unsigned long us;
+
+    if( DISP.sink )
+        return;     // DISP.frame is not on the display
+
+    us = 0;
+    if( POWER.last )
     {
-        frame[ x + (y>>3) * WIDTH ] &= ~(1 << (y % 8));
+        us = now - POWER.last;
+        POWER.ua_us += (unsigned long long)POWER.ua * us;
+        POWER.us += us;
     }
+    POWER.last = now;
+
+    POWER.lit = disp_burn_update(DISP.frame, us);
+    POWER.ua = disp_power_ua(POWER.lit, POWER.contrast);
 }
 
-int disp_pget(char *frame, int x, int y)
+void disp_power_contrast(int x)
 {
-    const int WIDTH =   128;
-//  const int HEIGHT =   64;
-    int byte, mask;
+    POWER.contrast = x & 0xff;
+    disp_power_update();
+}
 
-    byte = frame[ x + (y>>3) * WIDTH ];
-    mask = (1 << (y % 8));
+//////////////////////////////////////////////////////////////////////
+// burn-in
+//
+// The frame lines (y 4, 10 and 15, x 60) and most of the background are
+// lit around the clock. To spread the wear the whole picture wanders
+// round a small orbit, one step every BURN_STEP_MS, one pixel at a time:
+//
+//  - up and down (+-1) with the display offset register ($D3): three
+//    bytes on the bus, nothing is drawn or sent again. The offset moves
+//    the COM lines, so it doesn't get in the way of the start line that
+//    T_SCROLL uses. The row pushed off one edge comes back at the other.
+//  - left and right (+-2) in software, the SSD1306 has no column offset.
+//    disp_burn_shift() moves the finished frame sideways just before it
+//    is sent (casio_update_screen(), casio_update_live()), so drawing,
+//    the log digests and headless instances never see the shift. Such
+//    a step costs one full frame on the bus.
+//
+// The wear is kept per region of 8x8 pixels, i.e. 8 bytes of a page
+// (16 x 8 regions): whenever DISP.frame changes, the time the previous
+// frame was up is added to every region, weighted by its lit pixels,
+// and the new frame is counted two words and two popcounts per region.
+// This runs in disp_power_update() and gives it the lit pixel count.
+//
+// Console "burn" prints the map (% of the time lit), the position in
+// the orbit and what the accounting and the shift cost per frame.
+//
+#define BURN_STEP_MS        (4*60*1000UL)
+#define BURN_REGIONS        (FRAME_SIZE/8)
 
-    return (byte & mask) ? PIXEL_VALUE_ON : PIXEL_VALUE_OFF;
+static const signed char BurnOrbit[][2] = {     // dx, dy
+    {  0,  0 }, {  1,  0 }, {  1,  1 }, {  2,  1 }, {  2,  0 }, {  2, -1 }, {  1, -1 },
+    {  0, -1 }, { -1, -1 }, { -2, -1 }, { -2,  0 }, { -2,  1 }, { -1,  1 }, {  0,  1 },
+};
+
+#define BURN_STEPS          (int)(sizeof(BurnOrbit)/sizeof(BurnOrbit[0]))
+
+static struct
+{
+    int enabled;
+    int step;                       // index into BurnOrbit
+    int dx, dy;
+    int offset;                     // the display offset register
+    unsigned long next;             // millis() of the next step
+
+    unsigned char lit[BURN_REGIONS];            // in DISP.frame
+    unsigned long long lit_us[BURN_REGIONS];    // lit pixels x us
+    unsigned long long us;
+
+    unsigned long frames;           // accounting, per frame
+    unsigned long count_cycles;
+    unsigned long count_max;
+    unsigned long shifts;           // shifting, per frame sent
+    unsigned long shift_cycles;
+    unsigned long shift_max;
+} BURN = { 1 };
+
+HOT_CODE int disp_burn_update(const char *frame, unsigned long us)
+{
+    uint32_t w[2];
+    unsigned long start, cycles;
+    int r, n, lit;
+
+    start = ARM_DWT_CYCCNT;
+
+    lit = 0;
+    for(r=0; r < BURN_REGIONS; r++)
+    {
+        BURN.lit_us[r] += (unsigned long long)BURN.lit[r] * us;
+
+        memcpy(w, frame + r*8, 8);
+        n = __builtin_popcount(w[0]) + __builtin_popcount(w[1]);
+        BURN.lit[r] = (unsigned char)n;
+        lit += n;
+    }
+    BURN.us += us;
+
+    cycles = ARM_DWT_CYCCNT - start;
+    BURN.frames++;
+    BURN.count_cycles += cycles;
+    if( cycles > BURN.count_max )
+        BURN.count_max = cycles;
+
+    return lit;
 }
 
-void disp_invert(char *frame)
+//
+// move 'frame' BURN.dx columns to the right (left if negative),
+// background comes in at the edge
+//
+HOT_CODE void disp_burn_shift(char *frame)
 {
-    const int WIDTH =   128;
-    const int HEIGHT =   64;
-    int x, y, p;
+    unsigned long start, cycles;
+    int page, dx;
+    char *p;
+
+    dx = BURN.dx;
+    if( dx == 0 )
+        return;
+
+    start = ARM_DWT_CYCCNT;
 
-    for(x=0; x < WIDTH; x++)
+    for(page=0; page < FRAME_SIZE/128; page++)
     {
-        for(y=0; y < HEIGHT; y++)
+        p = frame + page*128;
+        if( dx > 0 )
+        {
+            memmove(p + dx, p, 128 - dx);
+            memset(p, CLR_MASK, dx);
+        }
+        else
         {
-            p = disp_pget(frame, x, y);
-            p = (p == 1) ? 0 : 1;
-            disp_pset(frame, x, y, p);
+            memmove(p, p - dx, 128 + dx);
+            memset(p + 128 + dx, CLR_MASK, -dx);
         }
     }
+
+    cycles = ARM_DWT_CYCCNT - start;
+    BURN.shifts++;
+    BURN.shift_cycles += cycles;
+    if( cycles > BURN.shift_max )
+        BURN.shift_max = cycles;
 }
 
-//////////////////////////////////////////////////////////////////////
-// end DISP
-//////////////////////////////////////////////////////////////////////
+int disp_set_offset(int offset);
 
-//////////////////////////////////////////////////////////////////////
 //
-// begin DEBUG
+// take the next step of the orbit when it is due ('force' now), called
+// before a frame is drawn for the display. The vertical part goes to
+// the display here, the horizontal part with the next frame.
 //
-//////////////////////////////////////////////////////////////////////
-void debug_flash(int rc)
+int disp_burn_step(int force)
 {
-    int i, N;
+    unsigned long now = millis();
+    int offset;
 
-    if( rc == 0 )
-        N = 3;
-    else
-        N = 30;
+    if( ! BURN.enabled )
+    {
+        BURN.step = 0;
+        BURN.next = 0;
+    }
+    else if( force || (long)(now - BURN.next) >= 0 )
+    {
+        if( BURN.next != 0 || force )
+            BURN.step = (BURN.step + 1) % BURN_STEPS;
+        BURN.next = now + BURN_STEP_MS;
+    }
 
-    for(i=0; i < N; i++)
+    BURN.dx = BurnOrbit[BURN.step][0];
+    BURN.dy = BurnOrbit[BURN.step][1];
+
+    offset = BURN.dy & 0x3f;
+    if( offset == BURN.offset )
+        return 0;
+
+    BURN.offset = offset;
+    return disp_set_offset(offset);
+}
+
+//
+// console "burn": the wear map and the cost per frame
+//
+void disp_burn_console(const char *arg)
+{
+    const unsigned long mhz = F_CPU_ACTUAL / 1000000;
+    unsigned long long us;
+    int r;
+
+    if( strcmp(arg, "on") == 0 )
+        BURN.enabled = 1;
+    else if( strcmp(arg, "off") == 0 )
+        BURN.enabled = 0;
+
+    if( strcmp(arg, "step") == 0 || (strcmp(arg, "off") == 0 && ! DISP.sink) )
+        disp_burn_step(BURN.enabled);
+
+    Serial.printf("burn: %s, step %d/%d, dx %d dy %d, next in %ld s\r\n",
+            BURN.enabled ? "on" : "off", BURN.step, BURN_STEPS, BURN.dx, BURN.dy,
+            BURN.enabled && BURN.next ? (long)(BURN.next - millis()) / 1000 : 0L);
+    Serial.printf("burn: count %lu frames, avg %lu max %lu ns; shift %lu frames, avg %lu max %lu ns\r\n",
+            BURN.frames,
+            BURN.frames ? BURN.count_cycles / BURN.frames * 1000 / mhz : 0,
+            BURN.count_max * 1000 / mhz,
+            BURN.shifts,
+            BURN.shifts ? BURN.shift_cycles / BURN.shifts * 1000 / mhz : 0,
+            BURN.shift_max * 1000 / mhz);
+
+    // % of the time lit, one line per page, one column per 8 pixels
+    us = BURN.us ? BURN.us : 1;
+    for(r=0; r < BURN_REGIONS; r++)
     {
-        digitalWriteFast(13, HIGH);
-        delay(20);
-        digitalWriteFast(13, LOW);
-        delay(20);
+        Serial.printf("%4lu", (unsigned long)(BURN.lit_us[r] * 100 / (64 * us)));
+        if( r % 16 == 15 )
+            Serial.printf("\r\n");
     }
 }
 
-void debug_halt()
+//
+// called whenever DISP.frame changes: the mirror and the power model
+//
+void disp_mirror_update()
 {
-    digitalWriteFast(13, HIGH);
-    for(;;);
+    disp_power_update();
+
+    if( MIRROR.enabled && memcmp(MIRROR.prev, DISP.frame, FRAME_SIZE) != 0 )
+        disp_mirror_send('D', DISP.frame, MIRROR.prev, 0);
 }
-//////////////////////////////////////////////////////////////////////
+
 //
-// end DEBUG
+// restrict writes to columns col1..col2 and pages page1..page2 (inclusive).
+// This also moves the display's write pointer to (col1, page1).
 //
-//////////////////////////////////////////////////////////////////////
+int disp_set_window(int col1, int col2, int page1, int page2)
+{
+    char buf[] = {
+            0x00,
+            0x21, 0x00, 0x7f,       // set column start/end range  (0-127)
+            0x22, 0x00, 0x07,       // set page start/end range (0-7)
+    };
+    int len, rc;
+
+    buf[2] = (char)col1;
+    buf[3] = (char)col2;
+    buf[5] = (char)page1;
+    buf[6] = (char)page2;
+
+    disp_begin();
+    len = disp_write(buf, sizeof(buf));
+    rc = disp_end();
+
+    if( len != sizeof(buf)) {
+        return len;
+    }
+
+    return rc;
+}
+
+int disp_set_range()
+{
+    return disp_set_window(0, 127, 0, 7);
+}
 
-//////////////////////////////////////////////////////////////////////
 //
-// begin DEVICE
+// set the display RAM row that is shown on the top line (0-63).
+// Used for hardware scrolling.
 //
-//////////////////////////////////////////////////////////////////////
+int disp_set_start_line(int line)
+{
+    char buf[] = {
+            0x00,
+            0x40,
+    };
+    int len, rc;
 
-typedef enum {
-    E_NONE,
-    E_BUTTONA,
-    E_BUTTONL,
-    E_BUTTONB,
-    E_BUTTONC,
-    E_BUTTONA_RELEASE,
-    E_BUTTONL_RELEASE,
-    E_BUTTONB_RELEASE,
-    E_BUTTONC_RELEASE,
-    E_HEX_BUTTON_0,     // 0
-    E_HEX_BUTTON_1,     // 1
-    E_HEX_BUTTON_2,     // 2
-    E_HEX_BUTTON_3,     // 3
-    E_HEX_BUTTON_4,     // 4
-    E_HEX_BUTTON_5,     // 5
-    E_HEX_BUTTON_6,     // 6
-    E_HEX_BUTTON_7,     // 7
-    E_HEX_BUTTON_8,     // 8
-    E_HEX_BUTTON_9,     // 9
-    E_HEX_BUTTON_A,     // A
-    E_HEX_BUTTON_B,     // B
-    E_HEX_BUTTON_C,     // C
-    E_HEX_BUTTON_D,     // D
-    E_HEX_BUTTON_STAR,  // *
-    E_HEX_BUTTON_POUND, // #
-    E_HEX_BUTTON_0_RELEASE,     // 0
-    E_HEX_BUTTON_1_RELEASE,     // 1
-    E_HEX_BUTTON_2_RELEASE,     // 2
-    E_HEX_BUTTON_3_RELEASE,     // 3
-    E_HEX_BUTTON_4_RELEASE,     // 4
-    E_HEX_BUTTON_5_RELEASE,     // 5
-    E_HEX_BUTTON_6_RELEASE,     // 6
-    E_HEX_BUTTON_7_RELEASE,     // 7
-    E_HEX_BUTTON_8_RELEASE,     // 8
-    E_HEX_BUTTON_9_RELEASE,     // 9
-    E_HEX_BUTTON_A_RELEASE,     // A
-    E_HEX_BUTTON_B_RELEASE,     // B
-    E_HEX_BUTTON_C_RELEASE,     // C
-    E_HEX_BUTTON_D_RELEASE,     // D
-    E_HEX_BUTTON_STAR_RELEASE,  // *
-    E_HEX_BUTTON_POUND_RELEASE, // #
-    E_SECONDS_TIMER,
-    E_SECONDS15,            // 1/6th second     every 100/15th seconds
-    E_LIGHT_OFF,            // triggered when DEVICE.light goes to 0
-} EVENT;
+    disp_begin();
+    buf[1] = (char)(0x40 | (line & 0x3f));
+    len = disp_write(buf, sizeof(buf));
+    rc = disp_end();
 
-static volatile struct
-{
-    IntervalTimer it;
-    long clock;             // 1/100th of seconds counter
-    long epoch;             // seconds since jan 1, 1970
-    int xxx;                // push button state
-    int hex;                // hex button key press
-    int hex_row;            // key keypad scan row
-    int counter100;         // counter 1/100th second
-    int counter15;          // counter 1/6.6th second
-    int counter15_enable;   // enable E_SECOND15 event
-    int light;
-} DEVICE;
+    if( len != sizeof(buf)) {
+        return len;
+    }
 
-void isr_xxx1()
-{
-    DEVICE.xxx = 0x01;
+    return rc;
 }
 
-void isr_xxx2()
+//
+// set the display offset (0-63): which COM line shows display row 0.
+// Moves the picture up or down without touching the display RAM, and
+// independently of the start line.
+//
+int disp_set_offset(int offset)
 {
-    DEVICE.xxx = 0x02;
-}
+    char buf[] = {
+            0x00,
+            0xd3, 0x00,
+    };
+    int len, rc;
 
-void isr_xxx3()
-{
-    DEVICE.xxx = 0x04;
-}
+    disp_begin();
+    buf[2] = (char)(offset & 0x3f);
+    len = disp_write(buf, sizeof(buf));
+    rc = disp_end();
 
-void isr_xxx4()
-{
-    DEVICE.xxx = 0x08;
+    if( len != sizeof(buf)) {
+        return len;
+    }
+
+    return rc;
 }
 
-//////////////////////////////////////////////////////////////////////
-// hex keypad
-//
-//  pins 25
-//       26
-//       27
-//       28
 //
-//       29
-//       30
-//       31
-//       32
-//
-//           1  2  3  4
-//      A    1  2  3  A
-//      B    4  5  6  B
-//      C    7  8  9  C
-//      D    *  0  #  D
+// send a rectangle of 'frame' to the display: columns col1..col2
+// of pages page1..page2 (inclusive). The window is restored to the
+// full screen afterwards, so disp_update() keeps working.
 //
-
-#define HK1     25
-#define HK2     26
-#define HK3     27
-#define HK4     28
-
-#define HKA     29
-#define HKB     30
-#define HKC     31
-#define HKD     32
-
-int PMAP(int hex)
+int disp_update_window(const char *frame, int col1, int col2, int page1, int page2)
 {
-    // i think this is just: "return HK1 + (hex % 10)-1;"
+    const char buf[] = {
+        0x40,
+    };
+    int page, len, err, rc, n;
+    const char *p;
 
-    switch(hex)
+    err = disp_set_window(col1, col2, page1, page2);
+    if( err )
     {
-        case  1: return HK1; // D
-        case  2: return HK2; // #
-        case  3: return HK3; // 0
-        case  4: return HK4; // *
+        return 1000 + err;
+    }
 
-        case  11: return HK1; // C
-        case  12: return HK2; // 9
-        case  13: return HK3; // 8
-        case  14: return HK4; // 7
+    n = col2 - col1 + 1;
+    for(page=page1; page <= page2; page++)
+    {
+        p = frame + page*128 + col1;
 
-        case  21: return HK1; // B
-        case  22: return HK2; // 6
-        case  23: return HK3; // 5
-        case  24: return HK4; // 4
+        disp_begin();
 
-        case  31: return HK1; // A
-        case  32: return HK2; // 3
-        case  33: return HK3; // 2
-        case  34: return HK4; // 1
-    }
-    return 0;
-}
+        len = disp_write(buf, sizeof(buf));
+        if( len != sizeof(buf) )
+        {
+            err = 2000 + len;
+            break;
+        }
 
-//
-// trigger this on a timer, every 1/100th seconds.
-// - Increments all the clock and timer variables.
-// - Implements the hex keypad scan logic.
-//
-void isr_hex_scan()
-{
-    int v, pin;
+        len = disp_write(p, n);
+        if( len != n )
+        {
+            err = 2000 + len;
+            break;
+        }
 
-    DEVICE.clock += 1;
+        rc = disp_end();
+        if( rc )
+        {
+            err = 3000 + rc;
+            break;
+        }
 
-    DEVICE.counter100 += 1;
-    if( DEVICE.counter100 > 99 ) {
-        DEVICE.counter100 = 0;
-        DEVICE.epoch += 1;
+        memcpy(DISP.frame + page*128 + col1, p, n);
     }
 
-    DEVICE.counter15 += 1;
-    if( DEVICE.counter15 > 14 ) {
-        DEVICE.counter15 = 0;
-    }
+    disp_mirror_update();
 
-    if( DEVICE.light > 0 ) {
-        DEVICE.light -= 1;
+    rc = disp_set_range();
+    if( err == 0 && rc )
+    {
+        err = 1000 + rc;
     }
 
-    if( DEVICE.hex != 0 ) {
-        v = digitalRead( PMAP(DEVICE.hex) );
-        if( v != 0 )
+    return err;
+}
+
+int disp_update(const char *frame)
+{
+    const char buf[] = {
+        0x40,
+    };
+    int i, len, err, rc;
+    const char *p;
+
+    err = 0;
+
+    p = frame;
+    for(i=0; i < FRAME_SIZE/128; i++)
+    {
+        disp_begin();
+
+        len = disp_write(buf, sizeof(buf));
+        if( len != sizeof(buf) )
         {
-            return;
+            err = 2000 + len;
+            break;
         }
-        else
+
+        len = disp_write(p, 128);
+        if( len != 128 )
         {
-            DEVICE.hex = 0;
+            err = 2000 + len;
+            break;
         }
-    }
 
-    if( DEVICE.xxx != 0 ) {
-        switch(DEVICE.xxx) {
-        case 0x01:  pin = 12; break;
-        case 0x02:  pin = 11; break;
-        case 0x04:  pin = 10; break;
-        case 0x08:  pin = 9; break;
+        rc = disp_end();
+        if( rc )
+        {
+            err = 3000 + rc;
+            break;
         }
-        v = digitalRead(pin);
-        if( v == 0 )
-            DEVICE.xxx = 0;
-    }
 
-    DEVICE.hex_row += 1;
-    if( DEVICE.hex_row > 3 )
-        DEVICE.hex_row = 0;
+        p += 128;
+    }
 
-    digitalWriteFast(HKA, DEVICE.hex_row == 0 ? HIGH : LOW);
-    digitalWriteFast(HKB, DEVICE.hex_row == 1 ? HIGH : LOW);
-    digitalWriteFast(HKC, DEVICE.hex_row == 2 ? HIGH : LOW);
-    digitalWriteFast(HKD, DEVICE.hex_row == 3 ? HIGH : LOW);
-}
+    if( err == 0 )
+    {
+        memcpy(DISP.frame, frame, FRAME_SIZE);
+        disp_mirror_update();
+    }
 
-void isr_hk1()
-{
-    DEVICE.hex = DEVICE.hex_row*10 + 1;
+    return err;
 }
 
-void isr_hk2()
-{
-    DEVICE.hex = DEVICE.hex_row*10 + 2;
-}
+//
+// send only the pages of 'frame' that differ from the display, top to
+// bottom. Before every page but the first 'preempt' (if not NULL) is
+// asked whether a newer frame is on its way; if so the transfer stops
+// there and DISP_PREEMPTED is returned. DISP.frame is kept page by page,
+// so the next call only sends what still differs from the newer frame:
+// the rest of a stale frame is never sent.
+//
+// Like every other transfer this leaves the write pointer at (0, 0) of
+// the full screen. Runs of pages from page 0 need no window commands.
+//
+#define DISP_PREEMPTED  4000
 
-void isr_hk3()
+int disp_update_pages(const char *frame, int (*preempt)())
 {
-    DEVICE.hex = DEVICE.hex_row*10 + 3;
-}
+    const char buf[] = {
+        0x40,
+    };
+    int page, at, sent, windowed, len, err, rc;
+    const char *p;
 
-void isr_hk4()
-{
-    DEVICE.hex = DEVICE.hex_row*10 + 4;
-}
+    err = 0;
+    at = 0;             // the page the write pointer is on
+    sent = 0;
+    windowed = 0;
 
-void device_setup()
-{
-    int rc, rc2;
+    for(page=0; page < FRAME_SIZE/128; page++)
+    {
+        p = frame + page*128;
+        if( memcmp(p, DISP.frame + page*128, 128) == 0 )
+            continue;
 
-    Serial.begin(9600);
+        if( sent > 0 && preempt && preempt() )
+        {
+            err = DISP_PREEMPTED;
+            break;
+        }
 
-    pinMode(13, OUTPUT);        // built-in led
+        if( at != page )
+        {
+            rc = disp_set_window(0, 127, page, FRAME_SIZE/128 - 1);
+            if( rc )
+            {
+                err = 1000 + rc;
+                break;
+            }
+            windowed = 1;
+        }
 
-    pinMode(24, OUTPUT);        // buzzer
+        disp_begin();
 
-    pinMode(12, INPUT);         // push button 1 (upper left)
-    pinMode(11, INPUT);         // push button 2 (upper right)
-    pinMode(10, INPUT);         // push button 3 (lower left)
-    pinMode(9, INPUT);          // push button 4 (lower right)
+        len = disp_write(buf, sizeof(buf));
+        if( len != sizeof(buf) )
+        {
+            err = 2000 + len;
+            break;
+        }
 
-    attachInterrupt(12, isr_xxx1, RISING);
-    attachInterrupt(11, isr_xxx2, RISING);
-    attachInterrupt(10, isr_xxx3, RISING);
-    attachInterrupt(9, isr_xxx4, RISING);
-
-    //
-    // hex keypad
-    //
-    pinMode(HKA, OUTPUT);
-    pinMode(HKB, OUTPUT);
-    pinMode(HKC, OUTPUT);
-    pinMode(HKD, OUTPUT);
-
-    digitalWriteFast(HKA, LOW);
-    digitalWriteFast(HKB, LOW);
-    digitalWriteFast(HKC, LOW);
-    digitalWriteFast(HKD, LOW);
-
-    pinMode(HK1, INPUT_PULLDOWN);
-    pinMode(HK2, INPUT_PULLDOWN);
-    pinMode(HK3, INPUT_PULLDOWN);
-    pinMode(HK4, INPUT_PULLDOWN);
-
-    attachInterrupt(HK1, isr_hk1, RISING);
-    attachInterrupt(HK2, isr_hk2, RISING);
-    attachInterrupt(HK3, isr_hk3, RISING);
-    attachInterrupt(HK4, isr_hk4, RISING);
+        len = disp_write(p, 128);
+        if( len != 128 )
+        {
+            err = 2000 + len;
+            break;
+        }
 
-    disp_setup();
+        rc = disp_end();
+        if( rc )
+        {
+            err = 3000 + rc;
+            break;
+        }
 
-    rc = disp_init();
-    if( rc )
-    {
-        Serial.println("disp_init failed");
-        debug_flash(rc);
+        memcpy(DISP.frame + page*128, p, 128);
+        at = page + 1;
+        sent++;
     }
 
-    rc2 = disp_set_range();
-    if( rc2 )
+    if( sent > 0 )
+        disp_mirror_update();
+
+    if( windowed || (at != 0 && at != FRAME_SIZE/128) )
     {
-        Serial.println("disp_set_range failed");
-        debug_flash(rc2);
+        rc = disp_set_range();
+        if( err == 0 && rc )
+            err = 1000 + rc;
     }
 
-    DEVICE.it.begin(isr_hex_scan, 10000); // 1/100th of a second
-
-    interrupts();
+    return err;
 }
 
-//
-// wait for event to occur. Monitor global variables for a change.
-//
-int device_get_event()
+void disp_clear()
 {
-    static int saved_xxx = 0;
-    static int saved_epoch = 0;
-    static int saved_counter15 = 0;
-    static int saved_hex = 0;
-    static int saved_light = 0;
-    int e;
+    static int init = 0;
+    static char blank[FRAME_SIZE];
 
-    e = E_NONE;
-    while( e == E_NONE )
-    {
-        if( saved_xxx != DEVICE.xxx )
-        {
-            if( DEVICE.xxx == 0 ) {
-                if( saved_xxx & 0x01 ) {
-                    e = E_BUTTONL_RELEASE;
-                } else if( saved_xxx & 0x02 ) {
-                    e = E_BUTTONC_RELEASE;
-                } else if( saved_xxx & 0x04 ) {
-                    e = E_BUTTONB_RELEASE;
-                } else if( saved_xxx & 0x08 ) {
-                    e = E_BUTTONA_RELEASE;
-                }
-            } else if( DEVICE.xxx & 0x01 ) {
-                e = E_BUTTONL;
-            } else if( DEVICE.xxx & 0x02 ) {
-                e = E_BUTTONC;
-            } else if( DEVICE.xxx & 0x04 ) {
-                e = E_BUTTONB;
-            } else if( DEVICE.xxx & 0x08 ) {
-                e = E_BUTTONA;
-            }
-            saved_xxx = DEVICE.xxx;
-        }
-        else if( saved_hex != DEVICE.hex )
-        {
-            switch(DEVICE.hex)
-            {
-            case  0:
-                    switch(saved_hex) {
-                    case  1: e = E_HEX_BUTTON_D_RELEASE; break;         // D
-                    case  2: e = E_HEX_BUTTON_POUND_RELEASE; break;     // #
-                    case  3: e = E_HEX_BUTTON_0_RELEASE; break;         // 0
-                    case  4: e = E_HEX_BUTTON_STAR_RELEASE; break;      // *
-
-                    case  11: e = E_HEX_BUTTON_C_RELEASE; break;        // C
-                    case  12: e = E_HEX_BUTTON_9_RELEASE; break;        // 9
-                    case  13: e = E_HEX_BUTTON_8_RELEASE; break;        // 8
-                    case  14: e = E_HEX_BUTTON_7_RELEASE; break;        // 7
-
-                    case  21: e = E_HEX_BUTTON_B_RELEASE; break;        // B
-                    case  22: e = E_HEX_BUTTON_6_RELEASE; break;        // 6
-                    case  23: e = E_HEX_BUTTON_5_RELEASE; break;        // 5
-                    case  24: e = E_HEX_BUTTON_4_RELEASE; break;        // 4
-
-                    case  31: e = E_HEX_BUTTON_A_RELEASE; break;        // A
-                    case  32: e = E_HEX_BUTTON_3_RELEASE; break;        // 3
-                    case  33: e = E_HEX_BUTTON_2_RELEASE; break;        // 2
-                    case  34: e = E_HEX_BUTTON_1_RELEASE; break;        // 1
-                    }
-                    break;
-            case  1: e = E_HEX_BUTTON_D; break;         // D
-            case  2: e = E_HEX_BUTTON_POUND; break;     // #
-            case  3: e = E_HEX_BUTTON_0; break;         // 0
-            case  4: e = E_HEX_BUTTON_STAR; break;      // *
-
-            case  11: e = E_HEX_BUTTON_C; break;        // C
-            case  12: e = E_HEX_BUTTON_9; break;        // 9
-            case  13: e = E_HEX_BUTTON_8; break;        // 8
-            case  14: e = E_HEX_BUTTON_7; break;        // 7
-
-            case  21: e = E_HEX_BUTTON_B; break;        // B
-            case  22: e = E_HEX_BUTTON_6; break;        // 6
-            case  23: e = E_HEX_BUTTON_5; break;        // 5
-            case  24: e = E_HEX_BUTTON_4; break;        // 4
-
-            case  31: e = E_HEX_BUTTON_A; break;        // A
-            case  32: e = E_HEX_BUTTON_3; break;        // 3
-            case  33: e = E_HEX_BUTTON_2; break;        // 2
-            case  34: e = E_HEX_BUTTON_1; break;        // 1
-            }
-            saved_hex = DEVICE.hex;
-        }
-        else if( saved_light != DEVICE.light )
-        {
-            if( DEVICE.light == 0 )
-            {
-                e = E_LIGHT_OFF;
-            }
-            saved_light = DEVICE.light;
-        }
-        else if( saved_epoch != DEVICE.epoch )
-        {
-            saved_epoch = DEVICE.epoch;
-            e = E_SECONDS_TIMER;
-        }
-        else if( saved_counter15 != DEVICE.counter15 )
-        {
-            saved_counter15 = DEVICE.counter15;
-            if( DEVICE.counter15_enable )
-                e = E_SECONDS15;
-        }
+    if( init == 0 )
+    {
+        memset(blank, CLR_MASK, sizeof(blank));
+        init = 1;
     }
-
-    return e;
+    disp_update(blank);
 }
-//////////////////////////////////////////////////////////////////////
-// end DEVICE
-//////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
+// clipping
 //
-// begin DRAW
+// disp_pset() and disp_pget() do no bounds checking. Every draw routine
+// clips its whole primitive (block, span, glyph) against the current
+// clip rectangle once, then runs the unchecked loop. Only a glyph that
+// straddles the clip edge falls back to checking each font pixel.
 //
-//////////////////////////////////////////////////////////////////////
 
-void draw_filled_block(char *frame, int x1, int y1, int x2, int y2)
+//
+// push a clip rectangle (intersected with the current one)
+//
+int disp_clip_push(int x1, int y1, int x2, int y2)
 {
-    int x, y;
+    DRAW *d = DRAWING;
+    CLIP *c, *n;
 
-    for(x=x1; x < x2; x++) {
-        for(y=y1; y < y2; y++) {
-            disp_pset(frame, x, y, 1);
-        }
-    }
-}
+    if( d->clip_top >= CLIP_DEPTH-1 )
+        return -1;
 
-void draw_rect(char *frame, int x1, int y1, int width, int height)
-{
-    int x, y;
-    int x2, y2;
+    c = &d->clip[d->clip_top];
+    n = &d->clip[d->clip_top+1];
 
-    x2 = x1 + width;
-    y2 = y1 + height;
+    n->x1 = (x1 > c->x1) ? x1 : c->x1;
+    n->y1 = (y1 > c->y1) ? y1 : c->y1;
+    n->x2 = (x2 < c->x2) ? x2 : c->x2;
+    n->y2 = (y2 < c->y2) ? y2 : c->y2;
 
-    for(x=x1; x <= x2; x++) {
-        disp_pset(frame, x, y1, 1);
-        disp_pset(frame, x, y2, 1);
-    }
+    if( n->x2 < n->x1 ) n->x2 = n->x1;
+    if( n->y2 < n->y1 ) n->y2 = n->y1;
 
-    for(y=y1; y <= y2; y++) {
-        disp_pset(frame, x1, y, 1);
-        disp_pset(frame, x2, y, 1);
-    }
+    d->clip_top += 1;
+    return 0;
+}
+
+void disp_clip_pop()
+{
+    if( DRAWING->clip_top > 0 )
+        DRAWING->clip_top -= 1;
 }
 
 //
-//          (x0, y0)
-//  0x01          ======
-//              ||       ||
-//  0x02        ||  ##   || 0x04
-//              ||       ||
-//  0x08          ======
-//              ||       ||
-//  0x10        ||  ##   || 0x20
-//              ||       ||
-//  0x40          ======    ##     0x80
+// clip the rectangle 'r' to the current clip rectangle, in place.
+// Returns:
+//  0 - nothing is visible
+//  1 - rectangle was entirely inside, unchanged
+//  2 - rectangle was clipped
 //
-// Top dot:         0x100
-// bottom dot:      0x200
-// decimal point:   0x80
+// Callers copy the result into plain locals before looping, otherwise
+// every store through 'char *frame' forces the bounds to be re-read.
 //
-void draw_segments(char *frame, int x, int y, int width, int height, int thick, int segments)
+int disp_clip_rect(CLIP *r)
 {
-    int x1, x2, y1, y2;
-
-    if( segments & 0x01 ) {
-        x1 = x + thick;
-        x2 = x + thick + width;
-        y1 = y;
-        y2 = y + thick;
+    DRAW *d = DRAWING;
+    const CLIP *c = &d->clip[d->clip_top];
 
-        draw_filled_block(frame, x1, y1, x2, y2);
-    }
-
-    if( segments & 0x02 ) {
-        x1 = x;
-        x2 = x + thick;
-        y1 = y + thick;
-        y2 = y + thick + height;
+    if( r->x1 >= c->x1 && r->y1 >= c->y1 && r->x2 <= c->x2 && r->y2 <= c->y2 )
+        return 1;
 
-        draw_filled_block(frame, x1, y1, x2, y2);
-    }
-
-    if( segments & 0x04 ) {
-        x1 = x + thick + width;
-        x2 = x + thick + width + thick;
-        y1 = y + thick;
-        y2 = y + thick + height;
+    if( d->clip_top == 0 )
+        d->offscreen++;
 
-        draw_filled_block(frame, x1, y1, x2, y2);
-    }
+    if( r->x1 < c->x1 ) r->x1 = c->x1;
+    if( r->y1 < c->y1 ) r->y1 = c->y1;
+    if( r->x2 > c->x2 ) r->x2 = c->x2;
+    if( r->y2 > c->y2 ) r->y2 = c->y2;
 
-    if( segments & 0x08 ) {
-        x1 = x + thick;
-        x2 = x + thick + width;
-        y1 = y + thick + height;
-        y2 = y + thick + height + thick;
+    if( r->x1 >= r->x2 || r->y1 >= r->y2 )
+        return 0;
 
-        draw_filled_block(frame, x1, y1, x2, y2);
-    }
+    return 2;
+}
 
-    if( segments & 0x10 ) {
-        x1 = x;
-        x2 = x + thick;
-        y1 = y + thick + height + thick;
-        y2 = y + thick + height + thick + height;
+void disp_pset(char *frame, int x, int y, int p)
+{
+    const int WIDTH =   128;
+//  const int HEIGHT =   64;
 
-        draw_filled_block(frame, x1, y1, x2, y2);
+    if( PIXEL_ON(p) )
+    {
+        frame[ x + (y>>3) * WIDTH ] |= (1 << (y % 8));
     }
-
-    if( segments & 0x20 ) {
-        x1 = x + thick + width;
-        x2 = x + thick + width + thick;
-        y1 = y + thick + height + thick;
-        y2 = y + thick + height + thick + height;
-
-        draw_filled_block(frame, x1, y1, x2, y2);
+    else
+    {
+        frame[ x + (y>>3) * WIDTH ] &= ~(1 << (y % 8));
     }
+}
 
-    if( segments & 0x40 ) {
-        x1 = x + thick;
-        x2 = x + thick + width;
-        y1 = y + thick + height + thick + height;
-        y2 = y + thick + height + thick + height + thick;
+int disp_pget(char *frame, int x, int y)
+{
+    const int WIDTH =   128;
+//  const int HEIGHT =   64;
+    int byte, mask;
 
-        draw_filled_block(frame, x1, y1, x2, y2);
-    }
+    byte = frame[ x + (y>>3) * WIDTH ];
+    mask = (1 << (y % 8));
 
-    if( segments & 0x80 ) {
-        // decimal
-        const int SPC = 2; // 1 looked okay
+    return (byte & mask) ? PIXEL_VALUE_ON : PIXEL_VALUE_OFF;
+}
 
-        x1 = x + thick + width + thick + SPC;
-        x2 = x + thick + width + thick + SPC + thick;
-        y1 = y + thick + height + thick + height;
-        y2 = y + thick + height + thick + height + thick;
+//
+// every pixel flips, so a word at a time
+//
+void disp_invert(char *frame)
+{
+    uint32_t w;
+    int i;
 
-        draw_filled_block(frame, x1, y1, x2, y2);
+    for(i=0; i < FRAME_SIZE; i += 4)
+    {
+        memcpy(&w, frame + i, 4);
+        w = ~w;
+        memcpy(frame + i, &w, 4);
     }
+}
 
-    if( segments & 0x100 ) {
-        // top dot
-        x1 = x + thick + width/2 - thick/2;
-        x2 = x + thick + width/2 - thick/2 + thick;
-        y1 = y + thick + height/2 - thick/2;
-        y2 = y + thick + height/2 - thick/2 + thick;
+//////////////////////////////////////////////////////////////////////
+// end DISP
+//////////////////////////////////////////////////////////////////////
 
-        draw_filled_block(frame, x1, y1, x2, y2);
-    }
+//////////////////////////////////////////////////////////////////////
+//
+// begin DEBUG
+//
+//////////////////////////////////////////////////////////////////////
+void debug_flash(int rc)
+{
+    int i, N;
 
-    if( segments & 0x200 ) {
-        // bottom dot
-        x1 = x + thick + width/2 - thick/2;
-        x2 = x + thick + width/2 - thick/2 + thick;
-        y1 = y + thick + height + thick + height/2 - thick/2;
-        y2 = y + thick + height + thick + height/2 - thick/2 + thick;
+    if( rc == 0 )
+        N = 3;
+    else
+        N = 30;
 
-        draw_filled_block(frame, x1, y1, x2, y2);
+    for(i=0; i < N; i++)
+    {
+        digitalWriteFast(13, HIGH);
+        delay(20);
+        digitalWriteFast(13, LOW);
+        delay(20);
     }
 }
 
-void draw_digit(char *frame, int x, int y, int width, int height, int thick, char digit, int dp)
-{
-    int segments;
+void device_halt_record(void *where);
 
-    switch(digit)
-    {
-    case '0':
-        segments = 0x01 | 0x02 | 0x04 | 0x10 | 0x20 | 0x40;
-        break;
-    case '1':
-        segments = 0x04 | 0x20;
-        break;
-    case '2':
-        segments = 0x01 | 0x04 | 0x08 | 0x10 | 0x40;
-        break;
-    case '3':
-        segments = 0x01 | 0x04 | 0x08 | 0x020 | 0x40;
-        break;
-    case '4':
-        segments = 0x02 | 0x08 | 0x04 | 0x020;
-        break;
-    case '5':
-        segments = 0x01 | 0x02 | 0x08 | 0x20 | 0x40;
-        break;
-    case '6':
-        segments = 0x01 | 0x02 | 0x08 | 0x10 | 0x20 | 0x40;
-        break;
-    case '7':
-        segments = 0x01 | 0x02 | 0x04 | 0x20; 
-        break;
-    case '8':
-        segments = 0x01 | 0x02 | 0x04 | 0x08 | 0x10 | 0x20 | 0x40; 
-        break;
-    case '9':
-    case 'g':
-        segments = 0x01 | 0x02 | 0x04 | 0x08 | 0x20 | 0x40; 
-        break;
-    case 'A':
-    case 'a':
-        segments = 0x01 | 0x02 | 0x04 | 0x08 | 0x10 | 0x20;
-        break;
-    case 'B':
-    case 'b':
-        segments = 0x02 | 0x10 | 0x40 | 0x20 | 0x08; 
-        break;
-    case 'C':
-    case 'c':
-        segments = 0x01 | 0x02 | 0x10 | 0x40;
-        break;
-    case 'D':
-    case 'd':
-        segments = 0x04 | 0x20 | 0x08 | 0x10 | 0x40;
-        break;
-    case 'E':
-    case 'e':
-        segments = 0x01 | 0x02 | 0x08 | 0x10 | 0x40;
-        break;
-    case 'F':
-    case 'f':
-        segments = 0x01 | 0x02 | 0x08 | 0x10;
-        break;
-    case 'H':
-        segments = 0x02 | 0x04 | 0x08 | 0x10 | 0x20;
-        break;
-    case 'h':
-        segments = 0x02 | 0x08 | 0x10 | 0x20;
-        break;
-    case 'i':
-        segments = 0x20;
-        break;
-    case 'J':
-        segments = 0x04 | 0x20 | 0x40 | 0x10;
-        break;
-    case 'L':
-        segments = 0x02 | 0x10 | 0x40;
-        break;
-    case 'n':
-        segments = 0x08 | 0x10 | 0x20;
-        break;
-    case 'o':
-        segments = 0x08 | 0x10 | 0x20 | 0x40;
-        break;
-    case 'P':
-        segments = 0x01 | 0x02 | 0x04 | 0x08 | 0x10;
-        break;
-    case 'U':
-        segments = 0x02 | 0x04 | 0x10 | 0x20 | 0x40;
-        break;
-    case '-':
-        segments = 0x08;
-        break;
-    case '_':
-        segments = 0x04;
-        break;
-    case ':':
-        segments = 0x200 | 0x100;
-        break;
-    case '.':
-        segments = 0x80;
-        break;
-    case ' ':
-        segments = 0x00;  /* BLANK */
-        break;
-    default:
-        segments = 0x00;
-        break;
-    }
+//
+// stop here with the led on. The watchdog resets the watch after a
+// while and the next boot reports where (see watchdog).
+//
+void debug_halt()
+{
+    device_halt_record(__builtin_return_address(0));
+    digitalWriteFast(13, HIGH);
+    for(;;);
+}
+//////////////////////////////////////////////////////////////////////
+//
+// end DEBUG
+//
+//////////////////////////////////////////////////////////////////////
 
-    if(dp) {
-        segments |= 0x80;
-    }
+//////////////////////////////////////////////////////////////////////
+//
+// begin DEVICE
+//
+//////////////////////////////////////////////////////////////////////
 
-    draw_segments(frame, x, y, width, height, thick, segments);
-}
+typedef enum {
+    E_NONE,
+    E_BUTTONA,
+    E_BUTTONL,
+    E_BUTTONB,
+    E_BUTTONC,
+    E_BUTTONA_RELEASE,
+    E_BUTTONL_RELEASE,
+    E_BUTTONB_RELEASE,
+    E_BUTTONC_RELEASE,
+    E_HEX_BUTTON_0,     // 0
+    E_HEX_BUTTON_1,     // 1
+    E_HEX_BUTTON_2,     // 2
+    E_HEX_BUTTON_3,     // 3
+    E_HEX_BUTTON_4,     // 4
+    E_HEX_BUTTON_5,     // 5
+    E_HEX_BUTTON_6,     // 6
+    E_HEX_BUTTON_7,     // 7
+    E_HEX_BUTTON_8,     // 8
+    E_HEX_BUTTON_9,     // 9
+    E_HEX_BUTTON_A,     // A
+    E_HEX_BUTTON_B,     // B
+    E_HEX_BUTTON_C,     // C
+    E_HEX_BUTTON_D,     // D
+    E_HEX_BUTTON_STAR,  // *
+    E_HEX_BUTTON_POUND, // #
+    E_HEX_BUTTON_0_RELEASE,     // 0
+    E_HEX_BUTTON_1_RELEASE,     // 1
+    E_HEX_BUTTON_2_RELEASE,     // 2
+    E_HEX_BUTTON_3_RELEASE,     // 3
+    E_HEX_BUTTON_4_RELEASE,     // 4
+    E_HEX_BUTTON_5_RELEASE,     // 5
+    E_HEX_BUTTON_6_RELEASE,     // 6
+    E_HEX_BUTTON_7_RELEASE,     // 7
+    E_HEX_BUTTON_8_RELEASE,     // 8
+    E_HEX_BUTTON_9_RELEASE,     // 9
+    E_HEX_BUTTON_A_RELEASE,     // A
+    E_HEX_BUTTON_B_RELEASE,     // B
+    E_HEX_BUTTON_C_RELEASE,     // C
+    E_HEX_BUTTON_D_RELEASE,     // D
+    E_HEX_BUTTON_STAR_RELEASE,  // *
+    E_HEX_BUTTON_POUND_RELEASE, // #
+    E_SECONDS_TIMER,
+    E_SECONDS15,            // 1/6th second     every 100/15th seconds
+    E_LIGHT_OFF,            // triggered when DEVICE.light goes to 0
+    E_LIVE,                 // new 1/100th while live_enable, see casio_update_live()
+} EVENT;
+
+//
+// time base trim, see device_trim_ticks()
+//
+typedef struct {
+    long ppb;               // correction, parts per billion (+ = clock runs slow)
+    long acc;               // Bresenham accumulator
+} TRIM;
 
-void draw_segstr(char *frame, int x0, int y0, int width, int height, int thick, const char *str)
+static volatile struct
 {
-    int x;
-    const char *p;
-    const int SPACING = 3;
+    IntervalTimer it;
+    unsigned long ticks;    // raw timer interrupts, untrimmed
+    unsigned long tick_us;  // micros() at the last interrupt
+    TRIM trim;
+    long slew;              // ticks still to add (+) or drop (-), see device_sync_apply()
+    long clock;             // 1/100th of seconds counter
+    unsigned long epoch;    // seconds since jan 1, 1970
+    int xxx;                // push button state
+    int hex;                // hex button key press
+    int hex_row;            // key keypad scan row
+    int counter100;         // counter 1/100th second
+    int counter15;          // counter 1/6.6th second
+    int counter15_enable;   // enable E_SECOND15 event
+    int live_enable;        // enable E_LIVE event
+    int light;
+    unsigned long input_us; // micros() of the last key or button press
+    int cycles;             // light + # asked for casio_cycles(), casio_run() runs it
+} DEVICE;
 
-    x = x0;
-    for(p=str; *p; p++)
+//
+// events from the serial console (key injection). device_get_event()
+// hands them out along with the ones the interrupts raise.
+//
+#define EVENT_QUEUE     32
+
+static struct
+{
+    unsigned char buf[EVENT_QUEUE];
+    int head, tail;
+    unsigned long dropped;
+} QUEUE;
+
+int device_post_event(int e)
+{
+    int next = (QUEUE.head + 1) % EVENT_QUEUE;
+
+    if( next == QUEUE.tail )
     {
-        if( *p == '.' )
-            continue;
-        draw_digit(frame, x, y0, width, height, thick, *p, p[1]=='.');
-        x = x + width + thick*2 + SPACING;
+        QUEUE.dropped++;
+        return -1;
     }
+    QUEUE.buf[QUEUE.head] = e;
+    QUEUE.head = next;
+    DEVICE.input_us = micros();
+    return 0;
 }
 
-void draw_number(char *frame, int x0, int y0, int width, int height, int thick, int num)
+void isr_xxx1()
 {
-    char buf[20];
-
-    snprintf(buf, sizeof(buf), "%3d", num);
+    DEVICE.xxx = 0x01;
+    DEVICE.input_us = micros();
+}
 
-    draw_segstr(frame, x0, y0, width, height, thick, buf);
+void isr_xxx2()
+{
+    DEVICE.xxx = 0x02;
+    DEVICE.input_us = micros();
 }
 
-//////////////////////////////////////////////////////////////////////
-//
-// 7x5 font
-//
-//////////////////////////////////////////////////////////////////////
+void isr_xxx3()
+{
+    DEVICE.xxx = 0x04;
+    DEVICE.input_us = micros();
+}
 
-const int CHAR_WIDTH = 5;
-const int CHAR_HEIGHT = 7;
-const int CHAR_SPACING = 1;
+void isr_xxx4()
+{
+    DEVICE.xxx = 0x08;
+    DEVICE.input_us = micros();
+}
 
-// render a 5x7 font character into a frame buffer
+//////////////////////////////////////////////////////////////////////
+// hex keypad
 //
-// get the pixels for character 'ch' at coordinate (x,y)
-// (0,0)
-//      +-------+
-//      |  * *  |
-//      |   *   |
-//      | ***** |
-//      | *     |
-//      | ****  |
-//      | *     |
-//      | ***** |
-//      +-------+
+//  pins 25
+//       26
+//       27
+//       28
 //
-//  5x7 text
+//       29
+//       30
+//       31
+//       32
 //
-//        0   1   2   3   4
-//      +---+---+---+---+---+
-//  0   | 4 | 3 | 2 | 1 | 0 |       4...0       top
-//      +---+---+---+---+---+
+//           1  2  3  4
+//      A    1  2  3  A
+//      B    4  5  6  B
+//      C    7  8  9  C
+//      D    *  0  #  D
 //
-//      +---+---+---+---+---+
-//  1   |29 |28 |27 |26 |25 |       29...25     bits
-//      +---+---+---+---+---+
-//  2   |24 |23 |22 |21 |20 |       24...20
-//      +---+---+---+---+---+
-//  3   |19 |18 |17 |16 |15 |       19...15
-//      +---+---+---+---+---+
-//  4   |14 |13 |12 |11 |10 |       14...10
-//      +---+---+---+---+---+
-//  5   | 9 | 8 | 7 | 6 | 5 |       9...5
-//      +---+---+---+---+---+
-//  6   | 4 | 3 | 2 | 1 | 0 |       4...0
-//      +---+---+---+---+---+
+
+#define HK1     25
+#define HK2     26
+#define HK3     27
+#define HK4     28
+
+#define HKA     29
+#define HKB     30
+#define HKC     31
+#define HKD     32
+
+int PMAP(int hex)
+{
+    // i think this is just: "return HK1 + (hex % 10)-1;"
+
+    switch(hex)
+    {
+        case  1: return HK1; // D
+        case  2: return HK2; // #
+        case  3: return HK3; // 0
+        case  4: return HK4; // *
+
+        case  11: return HK1; // C
+        case  12: return HK2; // 9
+        case  13: return HK3; // 8
+        case  14: return HK4; // 7
+
+        case  21: return HK1; // B
+        case  22: return HK2; // 6
+        case  23: return HK3; // 5
+        case  24: return HK4; // 4
+
+        case  31: return HK1; // A
+        case  32: return HK2; // 3
+        case  33: return HK3; // 2
+        case  34: return HK4; // 1
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// time base trim
+//
+// The timer interrupt comes every 10 ms of the crystal's idea of time,
+// which is off by some ppm. The correction (DEVICE.trim.ppb) is applied
+// Bresenham style: every interrupt adds ppb to an accumulator, and each
+// time it passes a billion the time base takes an extra tick (clock
+// slow) or skips one (clock fast). Over a day that spreads the
+// correction out in single 10 ms steps with no long term error.
+//
+// The correction is measured by device_cal_start()/device_cal_finish()
+// against a reference clock (the Teensy's 32 kHz RTC, serial command
+// 'k'), and kept in EEPROM.
 //
 
-struct {
-    char top[133];      // the top row (bits 0 to 4)
-    long bits[133];     // the bottom 6 rows (bits 0 to 29)
-} CasioFont = {
-    //
-    //  top:            +-+-+-+-+-+
-    //        4 - 0     | | | | | | row 0
-    //                  +-+-+-+-+-+
-    //
-    //  bits:           +-+-+-+-+-+
-    //      29 - 25     | | | | | | row 1
-    //                  +-+-+-+-+-+
-    //      24 - 20     | | | | | | row 2
-    //                  +-+-+-+-+-+
-    //      19 - 15     | | | | | | row 3
-    //                  +-+-+-+-+-+
-    //      14 - 10     | | | | | | row 4
-    //                  +-+-+-+-+-+
-    //        9 - 5     | | | | | | row 5
-    //                  +-+-+-+-+-+
-    //        4 - 0     | | | | | | row 6
-    //                  +-+-+-+-+-+
-    //
+#define TRIM_ONE        1000000000L
+#define TRIM_MAGIC      0x7452694dUL    // "MiRt"
+#define TRIM_EEPROM     0               // EEPROM address
+#define TICK_US         10000           // nominal timer period
+#define CAL_MIN_TICKS   6000            // one minute
 
-    //
-    // top row bits 0 - 4
-    //
-    0x00,          // 00000 <0 \00 - NUL>
-    0x00,          // 00000 <1 \01 - SPACE>
-    0x00,          // 00000 <2 \02 - A>
-    0x02,          // 00010 <3 \03 - A1>
-    0x08,          // 01000 <4 \04 - A2>
-    0x0A,          // 01010 <5 \05 - A3>
-    0x04,          // 00100 <6 \06 - A4>
-    0x0A,          // 01010 <7 \07 - A5>
-    0x09,          // 01001 <8 \10 - A6>
-    0x0E,          // 01110 <9 \11 - A7>
-    0x00,          // 00000 <10 \12 - B>
-    0x00,          // 00000 <11 \13 - C>
-    0x0F,          // 01111 <12 \14 - C1>
-    0x02,          // 00010 <13 \15 - C2>
-    0x00,          // 00000 <14 \16 - D>
-    0x00,          // 00000 <15 \17 - E>
-    0x02,          // 00010 <16 \20 - E1>
-    0x08,          // 01000 <17 \21 - E2>
-    0x04,          // 00100 <18 \22 - E3>
-    0x0A,          // 01010 <19 \23 - E4>
-    0x1F,          // 11111 <20 \24 - E5>
-    0x00,          // 00000 <21 \25 - F>
-    0x00,          // 00000 <22 \26 - G>
-    0x0A,          // 01010 <23 \27 - G1>
-    0x00,          // 00000 <24 \30 - H>
-    0x00,          // 00000 <25 \31 - I>
-    0x02,          // 00010 <26 \32 - I1>
-    0x08,          // 01000 <27 \33 - I2>
-    0x04,          // 00100 <28 \34 - I3>
-    0x0A,          // 01010 <29 \35 - I4>
-    0x04,          // 00100 <30 \36 - I5>
-    0x00,          // 00000 <31 \37 - J>
-    0x00,          // 00000 <32 \40 - K>
-    0x00,          // 00000 <33 \41 - L>
-    0x00,          // 00000 <34 \42 - L1>
-    0x00,          // 00000 <35 \43 - M>
-    0x00,          // 00000 <36 \44 - N>
-    0x02,          // 00010 <37 \45 - N1>
-    0x09,          // 01001 <38 \46 - N2>
-    0x00,          // 00000 <39 \47 - O>
-    0x02,          // 00010 <40 \50 - O1>
-    0x08,          // 01000 <41 \51 - O2>
-    0x04,          // 00100 <42 \52 - O3>
-    0x0A,          // 01010 <43 \53 - O4>
-    0x09,          // 01001 <44 \54 - O5>
-    0x00,          // 00000 <45 \55 - OE>
-    0x00,          // 00000 <46 \56 - P>
-    0x00,          // 00000 <47 \57 - Q>
-    0x00,          // 00000 <48 \60 - R>
-    0x00,          // 00000 <49 \61 - S>
-    0x02,          // 00010 <50 \62 - S1>
-    0x0F,          // 01111 <51 \63 - S2>
-    0x00,          // 00000 <52 \64 - T>
-    0x1F,          // 11111 <53 \65 - T1>
-    0x00,          // 00000 <54 \66 - U>
-    0x02,          // 00010 <55 \67 - U1>
-    0x08,          // 01000 <56 \70 - U2>
-    0x04,          // 00100 <57 \71 - U3>
-    0x0A,          // 01010 <58 \72 - U4>
-    0x00,          // 00000 <59 \73 - V>
-    0x00,          // 00000 <60 \74 - W>
-    0x00,          // 00000 <61 \75 - X>
-    0x00,          // 00000 <62 \76 - Y>
-    0x00,          // 00000 <63 \77 - Z>
-    0x02,          // 00010 <64 \100 - Z1>
-    0x04,          // 00100 <65 \101 - Z2>
-    0x00,          // 00000 <66 \102 - AE>
-    0x00,          // 00000 <67 \103 - O7>
-    0x04,          // 00100 <68 \104 - A8>
-    0x0A,          // 01010 <69 \105 - A9>
-    0x0A,          // 01010 <70 \106 - O8>
-    0x00,          // 00000 <71 \107 - SYM1>
-    0x00,          // 00000 <72 \110 - SYM2:B>
-    0x00,          // 00000 <73 \111 - SYM3>
-    0x00,          // 00000 <74 \112 - SYM4>
-    0x00,          // 00000 <75 \113 - SYM5:E>
-    0x0A,          // 01010 <76 \114 - SYM6:E>
-    0x00,          // 00000 <77 \115 - SYM7>
-    0x00,          // 00000 <78 \116 - SYM8>
-    0x00,          // 00000 <79 \117 - SYM9:N>
-    0x0A,          // 01010 <80 \120 - SYM10:N>
-    0x00,          // 00000 <81 \121 - SYM11>
-    0x00,          // 00000 <82 \122 - SYM12>
-    0x00,          // 00000 <83 \123 - SYM13:M>
-    0x00,          // 00000 <84 \124 - SYM14:H>
-    0x00,          // 00000 <85 \125 - SYM15:O>
-    0x00,          // 00000 <86 \126 - SYM16>
-    0x00,          // 00000 <87 \127 - SYM17:P>
-    0x00,          // 00000 <88 \130 - SYM18:C>
-    0x00,          // 00000 <89 \131 - SYM19:T>
-    0x00,          // 00000 <90 \132 - SYM20:y>
-    0x00,          // 00000 <91 \133 - SYM21>
-    0x00,          // 00000 <92 \134 - SYM22:X>
-    0x00,          // 00000 <93 \135 - SYM23>
-    0x00,          // 00000 <94 \136 - SYM24>
-    0x00,          // 00000 <95 \137 - SYM25:W>
-    0x00,          // 00000 <96 \140 - SYM26:W>
-    0x00,          // 00000 <97 \141 - SYM27>
-    0x00,          // 00000 <98 \142 - SYM28>
-    0x00,          // 00000 <99 \143 - SYM29>
-    0x00,          // 00000 <100 \144 - SYM30>
-    0x00,          // 00000 <101 \145 - SYM31>
-    0x00,          // 00000 <102 \146 - SYM32:R>
-    0x00,          // 00000 <103 \147 - @>
-    0x00,          // 00000 <104 \150 - !>
-    0x00,          // 00000 <105 \151 - ?>
-    0x00,          // 00000 <106 \152 - ,>
-    0x00,          // 00000 <107 \153 - .>
-    0x00,          // 00000 <108 \154 - :>
-    0x00,          // 00000 <109 \155 - />
-    0x00,          // 00000 <110 \156 - +>
-    0x00,          // 00000 <111 \157 - ->
-    0x00,          // 00000 <112 \160 - 0>
-    0x00,          // 00000 <113 \161 - 1>
-    0x00,          // 00000 <114 \162 - 2>
-    0x00,          // 00000 <115 \163 - 3>
-    0x00,          // 00000 <116 \164 - 4>
-    0x00,          // 00000 <117 \165 - 5>
-    0x00,          // 00000 <118 \166 - 6>
-    0x00,          // 00000 <119 \167 - 7>
-    0x00,          // 00000 <120 \170 - 8>
-    0x00,          // 00000 <121 \171 - 9>
-    0x00,          // 00000 <122 \172 - exchange>
-    0x00,          // 00000 <123 \173 - hour glass>
-    0x00,          // 00000 <124 \174 - left arrow>
-    0x00,          // 00000 <125 \175 - right arrow>
-    0x00,          // 00000 <126 \176 - bell>
-    0x00,          // 00000 <127 \177 - dual time>
-    0x00,          // 00000 <128 \200 - calculator-1>
-    0x00,          // 00000 <129 \201 - calculator-2>
-    0x00,          // 00000 <130 \202 - calculator-3>
-    0x00,          // 00000 <131 \203 - divide>
-    0x00,          // 00000 <132 \204 - stop watch>
+static struct
+{
+    int running;
+    unsigned long long ref;     // reference time at the start, us
+    unsigned long ticks;        // DEVICE.ticks at the start
+} CAL;
 
-    //
-    // Bottom 6 rows
-    //
-    //                  +-+-+-+-+-+
-    //      top         | | | | | | row 0
-    //                  +-+-+-+-+-+
-    //      29 - 25     | | | | | | row 1
-    //                  +-+-+-+-+-+
-    //      24 - 20     | | | | | | row 2
-    //                  +-+-+-+-+-+
-    //      19 - 15     | | | | | | row 3
-    //                  +-+-+-+-+-+
-    //      14 - 10     | | | | | | row 4
-    //                  +-+-+-+-+-+
-    //        9 - 5     | | | | | | row 5
-    //                  +-+-+-+-+-+
-    //        4 - 0     | | | | | | row 6
-    //                  +-+-+-+-+-+
-    //
-    //             // 29 25 24 20 19 15 14 10 9   5 4   0
-    //             // +---+ +---+ +---+ +---+ +---+ +---+
-    0x00000000,    // 00000 00000 00000 00000 00000 00000 <0 \00 - NUL>
-    0x00000000,    // 00000 00000 00000 00000 00000 00000 <1 \01 - SPACE>
-    0x00E8FE31,    // 00000 01110 10001 11111 10001 10001 <2 \02 - A>
-    0x08E8FE31,    // 00100 01110 10001 11111 10001 10001 <3 \03 - A1>
-    0x08E8FE31,    // 00100 01110 10001 11111 10001 10001 <4 \04 - A2>
-    0x08E8FE31,    // 00100 01110 10001 11111 10001 10001 <5 \05 - A3>
-    0x14E8FE31,    // 01010 01110 10001 11111 10001 10001 <6 \06 - A4>
-    0x00E8FE31,    // 00000 01110 10001 11111 10001 10001 <7 \07 - A5>
-    0x2CE8FE31,    // 10110 01110 10001 11111 10001 10001 <8 \10 - A6>
-    0x23F8C443,    // 10001 11111 10001 10001 00010 00011 <9 \11 - A7>
-    0x01E8FA3E,    // 00000 11110 10001 11110 10001 11110 <10 \12 - B>
-    0x00F8420F,    // 00000 01111 10000 10000 10000 01111 <11 \13 - C>
-    0x21083C4F,    // 10000 10000 10000 01111 00010 01111 <12 \14 - C1>
-    0x08F8420F,    // 00100 01111 10000 10000 10000 01111 <13 \15 - C2>
-    0x01E8C63E,    // 00000 11110 10001 10001 10001 11110 <14 \16 - D>
-    0x01F87A1F,    // 00000 11111 10000 11110 10000 11111 <15 \17 - E>
-    0x09F87A1F,    // 00100 11111 10000 11110 10000 11111 <16 \20 - E1>
-    0x09F87A1F,    // 00100 11111 10000 11110 10000 11111 <17 \21 - E2>
-    0x15F87A1F,    // 01010 11111 10000 11110 10000 11111 <18 \22 - E3>
-    0x01F87A1F,    // 00000 11111 10000 11110 10000 11111 <19 \23 - E4>
+//
+// how many ticks (0, 1 or 2) the time base moves for one interrupt
+//
+int device_trim_ticks(volatile TRIM *t)
+{
+    t->acc += t->ppb;
+    if( t->acc >= TRIM_ONE )
+    {
+        t->acc -= TRIM_ONE;
+        return 2;
+    }
+    if( t->acc <= -TRIM_ONE )
+    {
+        t->acc += TRIM_ONE;
+        return 0;
+    }
+    return 1;
+}
+
+//
+// correction, in ppb, for an oscillator that counted 'ticks' while the
+// reference moved 'ref_us'
+//
+long device_trim_measure(unsigned long ticks, unsigned long long ref_us)
+{
+    double local_us = (double)ticks * TICK_US;
+
+    return (long)((ref_us - local_us) * 1e9 / local_us);
+}
+
+void device_trim_load()
+{
+    struct { unsigned long magic; long ppb; } saved;
+
+    EEPROM.get(TRIM_EEPROM, saved);
+    if( saved.magic == TRIM_MAGIC && saved.ppb > -TRIM_ONE/10 && saved.ppb < TRIM_ONE/10 )
+        DEVICE.trim.ppb = saved.ppb;
+}
+
+void device_trim_save()
+{
+    struct { unsigned long magic; long ppb; } saved = { TRIM_MAGIC, DEVICE.trim.ppb };
+
+    EEPROM.put(TRIM_EEPROM, saved);
+}
+
+//
+// the RTC's 32768 Hz counter, in microseconds
+//
+unsigned long long device_rtc_us()
+{
+#if defined(__IMXRT1062__)
+    unsigned long hi, lo;
+    unsigned long long t;
+
+    do {
+        hi = SNVS_HPRTCMR;
+        lo = SNVS_HPRTCLR;
+    } while( hi != SNVS_HPRTCMR );
+
+    t = ((unsigned long long)hi << 32) | lo;
+    return (t >> 15) * 1000000ULL + (((t & 0x7fff) * 1000000ULL) >> 15);
+#else
+    return 0;
+#endif
+}
+
+void device_cal_start(unsigned long long ref_us)
+{
+    noInterrupts();
+    CAL.ticks = DEVICE.ticks;
+    interrupts();
+    CAL.ref = ref_us;
+    CAL.running = 1;
+}
+
+//
+// end the measurement, apply and save the new correction. Returns -1 if
+// the measurement was too short to be useful.
+//
+int device_cal_finish(unsigned long long ref_us)
+{
+    unsigned long ticks;
+
+    noInterrupts();
+    ticks = DEVICE.ticks - CAL.ticks;
+    interrupts();
+
+    if( ! CAL.running || ticks < CAL_MIN_TICKS || ref_us <= CAL.ref )
+        return -1;
+
+    CAL.running = 0;
+    DEVICE.trim.ppb = device_trim_measure(ticks, ref_us - CAL.ref);
+    device_trim_save();
+
+    return 0;
+}
+
+//
+// serial command 'k': first press starts measuring against the RTC,
+// the second (at least a minute later, longer is better) sets the trim
+//
+void device_cal_command()
+{
+    unsigned long long now = device_rtc_us();
+
+    if( now == 0 )
+    {
+        Serial.printf("cal: no rtc\r\n");
+    }
+    else if( ! CAL.running )
+    {
+        device_cal_start(now);
+        Serial.printf("cal: started, trim %ld ppb\r\n", DEVICE.trim.ppb);
+    }
+    else if( device_cal_finish(now) )
+    {
+        Serial.printf("cal: too short\r\n");
+    }
+    else
+    {
+        Serial.printf("cal: trim %ld ppb\r\n", DEVICE.trim.ppb);
+    }
+}
+
+//
+// self test ('t'): an oscillator that is 'skew_ppb' slow is calibrated
+// over a simulated day, then run for another day with the trim. Prints
+// the measured trim and how far off the trimmed clock ended up. Returns
+// 1 (FAIL) unless the trim is within TRIM_TOL_PPB of 'skew_ppb' and the
+// trimmed clock is less than a tick off.
+//
+#define TRIM_TOL_PPB    2
+
+int device_trim_selftest(long skew_ppb)
+{
+    const unsigned long DAY = 8640000UL;        // ticks
+    TRIM t = { 0, 0 };
+    unsigned long long ref;
+    unsigned long i, clock;
+    double err;
+    int ok;
+
+    ref = (unsigned long long)(DAY * (double)TICK_US * (1.0 + skew_ppb * 1e-9));
+    t.ppb = device_trim_measure(DAY, ref);
+
+    clock = 0;
+    for(i=0; i < DAY; i++)
+        clock += device_trim_ticks(&t);
+
+    err = (double)clock * TICK_US - (double)ref;
+    ok = labs(t.ppb - skew_ppb) <= TRIM_TOL_PPB && err > -TICK_US && err < TICK_US;
+    Serial.printf("selftest trim: %ld ppb oscillator, trim %ld ppb, %.1f ms off after a day, %s\r\n",
+            skew_ppb, t.ppb, err / 1000.0, ok ? "ok" : "FAIL");
+
+    return ok ? 0 : 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+// time sync
+//
+// An NTP style exchange with tools/timesync.py over the serial port,
+// using the frame mirror's packet framing:
+//
+//      host:  'y'                          start a burst
+//      watch: 0xA5 'Q' seq len=8   t1      request, t1 = watch time
+//      host:  0xA5 'R' seq len=24  t1 t2 t3
+//                                          t2 = host time the request
+//                                          arrived, t3 = reply sent
+//
+// and the watch notes t4 when the reply arrives. Times are 8 byte
+// little endian microseconds since 1970, local time (the watch has no
+// time zone). Each exchange gives
+//
+//      offset = ((t2 - t1) + (t3 - t4)) / 2
+//      delay  = (t4 - t1) - (t3 - t2)
+//
+// A burst is SYNC_SAMPLES exchanges. Samples that took more than twice
+// the best delay (plus a tick) are outliers, queued behind other serial
+// traffic; the offset is the median of the rest. A large offset is
+// stepped, anything under SYNC_STEP_US is slewed by adding or dropping
+// one tick every SYNC_SLEW_EVERY ticks (500 ppm), so the seconds never
+// jump or repeat.
+//
+// A request without a reply in SYNC_TIMEOUT_US is sent again, under a
+// new seq so a late reply is ignored, up to SYNC_RETRIES times; then
+// the burst is aborted, as it is when no sample survives the outlier
+// test. The clock is left alone either way.
+//
+// The syncs also feed the calibration (see time base trim): the first
+// one starts a measurement and one at least SYNC_CAL_TICKS later sets
+// the trim, so the drift between syncs goes away as well.
+//
+
+#define SYNC_SAMPLES        8
+#define SYNC_STEP_US        128000L
+#define SYNC_SLEW_EVERY     2000
+#define SYNC_CAL_TICKS      360000UL    // an hour
+#define SYNC_TIMEOUT_US     250000UL
+#define SYNC_RETRIES        3
+
+static struct
+{
+    int active;                     // a burst is running
+    int n;                          // samples so far in this burst
+    int retries;                    // for the current sample
+    unsigned long sent_us;          // micros() the request went out
+    unsigned short seq;
+    long long offset[SYNC_SAMPLES]; // us
+    long long delay[SYNC_SAMPLES];
+} SYNC;
+
+//
+// watch time in microseconds since 1970
+//
+unsigned long long device_time_us()
+{
+    unsigned long epoch, us;
+    int c100;
+
+    noInterrupts();
+    epoch = DEVICE.epoch;
+    c100 = DEVICE.counter100;
+    us = micros() - DEVICE.tick_us;
+    interrupts();
+
+    if( us >= TICK_US )
+        us = TICK_US - 1;
+
+    return epoch * 1000000ULL + c100 * (unsigned long)TICK_US + us;
+}
+
+void device_put_u64(unsigned char *p, unsigned long long v)
+{
+    int i;
+
+    for(i=0; i < 8; i++)
+        p[i] = v >> (i*8);
+}
+
+unsigned long long device_get_u64(const unsigned char *p)
+{
+    unsigned long long v = 0;
+    int i;
+
+    for(i=7; i >= 0; i--)
+        v = (v << 8) | p[i];
+
+    return v;
+}
+
+void device_sync_request()
+{
+    unsigned char buf[6 + 8];
+
+    buf[0] = MIRROR_SYNC;
+    buf[1] = 'Q';
+    buf[2] = SYNC.seq & 0xff;
+    buf[3] = SYNC.seq >> 8;
+    buf[4] = 8;
+    buf[5] = 0;
+    device_put_u64(buf + 6, device_time_us());
+    Serial.write(buf, sizeof(buf));
+    SYNC.sent_us = micros();
+}
+
+//
+// step or slew the time base by 'offset' microseconds
+//
+void device_sync_apply(long long offset)
+{
+    long long t;
+    long ticks;
+
+    ticks = (offset + (offset < 0 ? -TICK_US/2 : TICK_US/2)) / TICK_US;
+
+    if( offset >= SYNC_STEP_US || offset <= -SYNC_STEP_US )
+    {
+        noInterrupts();
+        t = (long long)DEVICE.epoch * 100 + DEVICE.counter100 + ticks;
+        DEVICE.epoch = t / 100;
+        DEVICE.counter100 = t % 100;
+        DEVICE.slew = 0;
+        interrupts();
+    }
+    else
+    {
+        noInterrupts();
+        DEVICE.slew = ticks;
+        interrupts();
+    }
+}
+
+void device_sync_finish()
+{
+    long long offset[SYNC_SAMPLES], best, x, ref;
+    int i, j, n;
+
+    SYNC.active = 0;
+
+    best = SYNC.delay[0];
+    for(i=1; i < SYNC_SAMPLES; i++)
+        if( SYNC.delay[i] < best )
+            best = SYNC.delay[i];
+
+    n = 0;
+    for(i=0; i < SYNC_SAMPLES; i++)
+    {
+        if( SYNC.delay[i] > 2*best + TICK_US )
+            continue;
+        x = SYNC.offset[i];
+        for(j=n; j > 0 && offset[j-1] > x; j--)
+            offset[j] = offset[j-1];
+        offset[j] = x;
+        n++;
+    }
+
+    // (only when the best delay is below -TICK_US, i.e. the host's
+    // times are nonsense)
+    if( n == 0 )
+    {
+        Serial.printf("sync: aborted, no usable samples (best delay %ld us)\r\n", (long)best);
+        return;
+    }
+
+    x = offset[n/2];
+    ref = device_time_us() + x;
+
+    device_sync_apply(x);
+
+    if( ! CAL.running )
+        device_cal_start(ref);
+    else if( DEVICE.ticks - CAL.ticks >= SYNC_CAL_TICKS && device_cal_finish(ref) == 0 )
+        device_cal_start(ref);
+
+    Serial.printf("sync: offset %ld us delay %ld us, %d/%d samples, %s, accuracy %.1f ms, trim %ld ppb\r\n",
+            (long)x, (long)best, n, SYNC_SAMPLES,
+            (x >= SYNC_STEP_US || x <= -SYNC_STEP_US) ? "stepped" : "slewing",
+            (best / 2 + (offset[n-1] - offset[0]) / 2) / 1000.0,
+            DEVICE.trim.ppb);
+}
+
+//
+// a reply from the host (collected by the console), 't4' is when its
+// sync byte arrived
+//
+void device_sync_packet(const unsigned char *pkt, int len, unsigned long long t4)
+{
+    unsigned long long t1, t2, t3;
+
+    if( len != 6 + 24 || pkt[1] != 'R' || (pkt[4] | (pkt[5] << 8)) != 24 )
+        return;
+    if( ! SYNC.active || (pkt[2] | (pkt[3] << 8)) != SYNC.seq || SYNC.n >= SYNC_SAMPLES )
+        return;
+
+    t1 = device_get_u64(pkt + 6);
+    t2 = device_get_u64(pkt + 14);
+    t3 = device_get_u64(pkt + 22);
+
+    SYNC.offset[SYNC.n] = ((long long)(t2 - t1) + (long long)(t3 - t4)) / 2;
+    SYNC.delay[SYNC.n] = (long long)(t4 - t1) - (long long)(t3 - t2);
+    SYNC.n++;
+    SYNC.seq++;
+    SYNC.retries = 0;
+
+    if( SYNC.n < SYNC_SAMPLES )
+        device_sync_request();
+    else
+        device_sync_finish();
+}
+
+void device_sync_start()
+{
+    SYNC.active = 1;
+    SYNC.n = 0;
+    SYNC.retries = 0;
+    device_sync_request();
+}
+
+//
+// from device_poll_event() once a tick: resend a request that got no
+// reply, or give up on the burst
+//
+void device_sync_poll()
+{
+    if( ! SYNC.active || micros() - SYNC.sent_us < SYNC_TIMEOUT_US )
+        return;
+
+    SYNC.seq++;
+    if( SYNC.retries++ < SYNC_RETRIES )
+    {
+        device_sync_request();
+        return;
+    }
+
+    SYNC.active = 0;
+    Serial.printf("sync: aborted, no reply to sample %d after %d tries\r\n",
+            SYNC.n + 1, SYNC_RETRIES + 1);
+}
+
+//////////////////////////////////////////////////////////////////////
+// interrupts
+//
+// The 1/100th timer interrupt (the top half, isr_hex_scan) only counts
+// the tick, notes when it happened and pends the deferred handler (the
+// bottom half, isr_deferred), a software interrupt at the lowest
+// priority. That one does the rest for every tick since it last ran:
+//
+//  - advances the clock, trimmed and slewed (DEVICE.tick_us follows it,
+//    so device_time_us() never mixes a new tick with an old clock)
+//  - counter15 and the light countdown
+//  - keypad and button release (digitalRead) and driving the next row
+//
+// Priorities (lower is more urgent; the M7 uses the top 4 bits):
+//
+//  PRIO_WDOG   watchdog warning, once just before a reset (see watchdog)
+//  PRIO_TICK   timer       nothing else can hold up the tick
+//  PRIO_GPIO   buttons, hex keypad: capture the key and a timestamp
+//  PRIO_I2C    display
+//  PRIO_DEFER  the bottom half, preempted by all of the above
+//
+// A late bottom half (USB, a long noInterrupts()) only delays the
+// clock's update, it never loses a tick.
+//
+// Both halves record their longest run in cycles; console "isr" prints
+// and resets them. Build with -DDEVICE_DEFER=0 to run the bottom half
+// inside the timer interrupt, as before, for comparison:
+//
+//      isr: tick max N cycles (N ns), deferred max N cycles (N ns), N runs, N late
+//
+#ifndef DEVICE_DEFER
+#   define DEVICE_DEFER 1
+#endif
+
+#define PRIO_WDOG       0
+#define PRIO_TICK       16
+#define PRIO_GPIO       64
+#define PRIO_I2C        128
+#define PRIO_DEFER      240
+
+static volatile struct
+{
+    unsigned long ticks;        // DEVICE.ticks the bottom half has done
+    unsigned long tick_us;      // micros() at the last tick, for the bottom half
+    unsigned long tick_max;     // longest top half, cycles
+    unsigned long defer_max;    // longest bottom half, cycles
+    unsigned long runs;
+    unsigned long late;         // runs that found more than one tick
+} ISR;
+
+//
+// keypad and button release, and the next keypad row
+//
+void device_scan_keys()
+{
+    int v, pin;
+
+    if( DEVICE.hex != 0 ) {
+        v = digitalRead( PMAP(DEVICE.hex) );
+        if( v != 0 )
+        {
+            return;
+        }
+        else
+        {
+            DEVICE.hex = 0;
+        }
+    }
+
+    if( DEVICE.xxx != 0 ) {
+        switch(DEVICE.xxx) {
+        case 0x01:  pin = 12; break;
+        case 0x02:  pin = 11; break;
+        case 0x04:  pin = 10; break;
+        case 0x08:  pin = 9; break;
+        }
+        v = digitalRead(pin);
+        if( v == 0 )
+            DEVICE.xxx = 0;
+    }
+
+    DEVICE.hex_row += 1;
+    if( DEVICE.hex_row > 3 )
+        DEVICE.hex_row = 0;
+
+    digitalWriteFast(HKA, DEVICE.hex_row == 0 ? HIGH : LOW);
+    digitalWriteFast(HKB, DEVICE.hex_row == 1 ? HIGH : LOW);
+    digitalWriteFast(HKC, DEVICE.hex_row == 2 ? HIGH : LOW);
+    digitalWriteFast(HKD, DEVICE.hex_row == 3 ? HIGH : LOW);
+}
+
+void device_watchdog_tick();
+
+//
+// bottom half: everything the ticks since the last run imply
+//
+void isr_deferred()
+{
+    unsigned long start, cycles, tick_us;
+    int n, ticks;
+
+    start = ARM_DWT_CYCCNT;
+
+    noInterrupts();
+    ticks = DEVICE.ticks - ISR.ticks;
+    tick_us = ISR.tick_us;
+    interrupts();
+
+    if( ticks > 1 )
+        ISR.late++;
+
+    for(; ticks > 0; ticks--)
+    {
+        ISR.ticks++;
+
+        n = device_trim_ticks(&DEVICE.trim);
+        if( DEVICE.slew != 0 && ISR.ticks % SYNC_SLEW_EVERY == 0 )
+        {
+            if( DEVICE.slew > 0 )
+            {
+                n++;
+                DEVICE.slew--;
+            }
+            else if( n > 0 )
+            {
+                n--;
+                DEVICE.slew++;
+            }
+        }
+
+        for(; n > 0; n--)
+        {
+            DEVICE.clock += 1;
+
+            DEVICE.counter100 += 1;
+            if( DEVICE.counter100 > 99 ) {
+                DEVICE.counter100 = 0;
+                DEVICE.epoch += 1;
+            }
+        }
+
+        DEVICE.counter15 += 1;
+        if( DEVICE.counter15 > 14 ) {
+            DEVICE.counter15 = 0;
+        }
+
+        if( DEVICE.light > 0 ) {
+            DEVICE.light -= 1;
+        }
+    }
+    DEVICE.tick_us = tick_us;
+
+    ISR.runs++;
+
+    device_scan_keys();
+    device_watchdog_tick();
+
+    cycles = ARM_DWT_CYCCNT - start;
+    if( cycles > ISR.defer_max )
+        ISR.defer_max = cycles;
+}
+
+//
+// top half: trigger this on a timer, every 1/100th seconds
+//
+void isr_hex_scan()
+{
+    unsigned long start, cycles;
+
+    start = ARM_DWT_CYCCNT;
+
+    DEVICE.ticks += 1;
+    ISR.tick_us = micros();
+
+#if DEVICE_DEFER && defined(__IMXRT1062__)
+    NVIC_SET_PENDING(IRQ_SOFTWARE);
+#else
+    isr_deferred();
+#endif
+
+    cycles = ARM_DWT_CYCCNT - start;
+    if( cycles > ISR.tick_max )
+        ISR.tick_max = cycles;
+}
+
+//
+// console "isr"
+//
+void device_isr_report()
+{
+    const unsigned long mhz = F_CPU_ACTUAL / 1000000;
+
+    Serial.printf("isr: tick max %lu cycles (%lu ns), deferred max %lu cycles (%lu ns), %lu runs, %lu late\r\n",
+            ISR.tick_max, ISR.tick_max * 1000 / mhz,
+            ISR.defer_max, ISR.defer_max * 1000 / mhz,
+            ISR.runs, ISR.late);
+
+    ISR.tick_max = 0;
+    ISR.defer_max = 0;
+}
+
+void device_isr_setup()
+{
+    // normally already running on Teensy 4
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+
+#if defined(__IMXRT1062__)
+    attachInterruptVector(IRQ_SOFTWARE, isr_deferred);
+    NVIC_SET_PRIORITY(IRQ_SOFTWARE, PRIO_DEFER);
+    NVIC_ENABLE_IRQ(IRQ_SOFTWARE);
+
+    NVIC_SET_PRIORITY(IRQ_GPIO6789, PRIO_GPIO);
+    NVIC_SET_PRIORITY(IRQ_LPI2C1, PRIO_I2C);
+#endif
+
+    DEVICE.it.priority(PRIO_TICK);
+}
+
+void isr_hk1()
+{
+    DEVICE.hex = DEVICE.hex_row*10 + 1;
+    DEVICE.input_us = micros();
+}
+
+void isr_hk2()
+{
+    DEVICE.hex = DEVICE.hex_row*10 + 2;
+    DEVICE.input_us = micros();
+}
+
+void isr_hk3()
+{
+    DEVICE.hex = DEVICE.hex_row*10 + 3;
+    DEVICE.input_us = micros();
+}
+
+void isr_hk4()
+{
+    DEVICE.hex = DEVICE.hex_row*10 + 4;
+    DEVICE.input_us = micros();
+}
+
+//////////////////////////////////////////////////////////////////////
+// watchdog
+//
+// casio_run() marks the stage it is in (device_stage). Leaving a stage
+// that took longer than its budget counts as a stall; console "stall"
+// prints the counts and the longest time per stage. The hardware
+// watchdog (WDOG1) is fed by device_poll_event(), i.e. whenever the
+// main loop is waiting for events, so a hang anywhere else resets the
+// watch after WATCHDOG_MS:
+//
+//  stage       budget
+//  idle        blocked in device_get_event() or device_wait_event(),
+//              no budget
+//  event       taking the next event
+//  process     casio_process_event()
+//  render      casio_render()
+//  transmit    the display transfer, transitions included
+//  command     a console line: benchmarks, tests etc. run for seconds,
+//              so while one runs the tick feeds the watchdog instead
+//
+// Half a second before the reset the watchdog interrupt saves a crash
+// record: the stage and how long it had been running, the registers
+// the interrupt stacked (pc is where the watch was stuck), and the
+// flight recorder, the last FLIGHT_SIZE stage changes with their
+// times and events. A HardFault (and the other faults) saves the same,
+// plus the fault status registers, and resets at once. debug_halt()
+// saves its caller and waits for the watchdog.
+//
+// The record is in DMAMEM, which the startup code doesn't clear. At the
+// next boot it is checked (magic, checksum), printed and kept for
+// console "stall":
+//
+//      crash: watchdog in transmit, 1500 ms, uptime 81234 ms
+//        r0 20001a30 r1 00000080 r2 00000000 r3 0000003c r12 00000000
+//        lr 00003a4f pc 00003b12 psr 21000000
+//        cfsr 00000000 hfsr 00000000 mmfar 00000000 bfar 00000000
+//        flight: -1502417 us transmit 0, -1502530 us render 0, ...
+//
+// (the boot ROM may reuse some OCRAM, then the record is just lost.)
+//
+#define WATCHDOG_MS     2000        // 0.5 s steps
+#define WATCHDOG_WARN   1           // interrupt this many 0.5 s before
+#define FLIGHT_SIZE     16
+#define CRASH_MAGIC     0xC4A5C0DEUL
+
+typedef enum {
+    S_IDLE,
+    S_EVENT,
+    S_PROCESS,
+    S_RENDER,
+    S_TRANSMIT,
+    S_COMMAND,
+    S_STAGES
+} STAGE;
+
+static const char *StageNames[S_STAGES] = {
+    "idle", "event", "process", "render", "transmit", "command",
+};
+
+static const unsigned long StageBudgetUs[S_STAGES] = {
+    0,          // idle, no budget
+    20000,      // event
+    5000,       // process
+    10000,      // render
+    250000,     // transmit, a transition is 150 ms
+    0,          // command
+};
+
+typedef enum {
+    CRASH_NONE,
+    CRASH_WATCHDOG,
+    CRASH_FAULT,
+    CRASH_HALT,
+} CRASH_KIND;
+
+static const char *CrashNames[] = { "none", "watchdog", "fault", "halt" };
+
+typedef struct {
+    unsigned long us;           // micros()
+    unsigned char stage;
+    unsigned char event;
+} FLIGHT;
+
+typedef struct {
+    unsigned long magic;
+    unsigned long kind;
+    unsigned long r[8];         // r0-r3, r12, lr, pc, psr as stacked
+    unsigned long cfsr, hfsr, mmfar, bfar;
+    unsigned long stage;
+    unsigned long stage_ms;     // how long the stage had been running
+    unsigned long uptime_ms;
+    unsigned long now;          // micros() when saved
+    FLIGHT flight[FLIGHT_SIZE];
+    unsigned long flight_pos;
+    unsigned long sum;
+} CRASH;
+
+static DMAMEM CRASH crash_ram;  // survives the reset
+static CRASH crash_last;        // the one found at boot
+
+static volatile struct
+{
+    int stage;
+    unsigned long since;        // micros() when the stage started
+    unsigned long stalls[S_STAGES];
+    unsigned long max_us[S_STAGES];
+    int enabled;
+} STALL;
+
+unsigned long device_crash_sum(const CRASH *c)
+{
+    const unsigned long *p = (const unsigned long *)c;
+    unsigned long sum = 0x5A5A5A5AUL;
+    int i;
+
+    for(i=0; i < (int)(offsetof(CRASH, sum) / sizeof(*p)); i++)
+        sum = (sum ^ p[i]) * 16777619UL;
+
+    return sum;
+}
+
+void device_watchdog_feed()
+{
+#if defined(__IMXRT1062__)
+    if( STALL.enabled )
+    {
+        WDOG1_WSR = 0x5555;
+        WDOG1_WSR = 0xAAAA;
+    }
+#endif
+}
+
+//
+// from the tick's bottom half: console commands can take their time
+//
+void device_watchdog_tick()
+{
+    if( STALL.stage == S_COMMAND )
+        device_watchdog_feed();
+}
+
+//
+// the main loop enters 'stage' (for S_PROCESS 'event' is the event)
+//
+void device_stage(int stage, int event)
+{
+    unsigned long now, us;
+    int prev;
+
+    now = micros();
+    prev = STALL.stage;
+    us = now - STALL.since;
+
+    if( us > STALL.max_us[prev] )
+        STALL.max_us[prev] = us;
+    if( StageBudgetUs[prev] && us > StageBudgetUs[prev] )
+        STALL.stalls[prev]++;
+
+    STALL.stage = stage;
+    STALL.since = now;
+
+    crash_ram.flight[crash_ram.flight_pos % FLIGHT_SIZE].us = now;
+    crash_ram.flight[crash_ram.flight_pos % FLIGHT_SIZE].stage = stage;
+    crash_ram.flight[crash_ram.flight_pos % FLIGHT_SIZE].event = event;
+    crash_ram.flight_pos++;
+}
+
+//
+// fill in and seal the crash record. 'sp' is the exception stack
+// frame, or NULL.
+//
+void device_crash_save(const unsigned long *sp, int kind)
+{
+    unsigned long now = micros();
+    int i;
+
+    crash_ram.kind = kind;
+    for(i=0; i < 8; i++)
+        crash_ram.r[i] = sp ? sp[i] : 0;
+#if defined(__IMXRT1062__)
+    crash_ram.cfsr = SCB_CFSR;
+    crash_ram.hfsr = SCB_HFSR;
+    crash_ram.mmfar = SCB_MMFAR;
+    crash_ram.bfar = SCB_BFAR;
+#endif
+    crash_ram.stage = STALL.stage;
+    crash_ram.stage_ms = (now - STALL.since) / 1000;
+    crash_ram.uptime_ms = millis();
+    crash_ram.now = now;
+    crash_ram.magic = CRASH_MAGIC;
+    crash_ram.sum = device_crash_sum(&crash_ram);
+
+#if defined(__IMXRT1062__)
+    arm_dcache_flush(&crash_ram, sizeof(crash_ram));
+#endif
+}
+
+void device_reset()
+{
+#if defined(__IMXRT1062__)
+    SCB_AIRCR = 0x05FA0004;     // SYSRESETREQ
+#endif
+    for(;;)
+        ;
+}
+
+extern "C" void device_crash_isr(const unsigned long *sp, int kind)
+{
+#if defined(__IMXRT1062__)
+    if( kind == CRASH_WATCHDOG )
+        WDOG1_WICR |= 0x4000;   // WTIS, clear
+#endif
+    device_crash_save(sp, kind);
+    device_reset();
+}
+
+//
+// exception entries: pass the stacked registers (MSP or PSP) on
+//
+#if defined(__IMXRT1062__)
+extern "C" __attribute__((naked)) void isr_fault()
+{
+    __asm volatile(
+        "tst lr, #4             \n"
+        "ite eq                 \n"
+        "mrseq r0, msp          \n"
+        "mrsne r0, psp          \n"
+        "mov r1, #2             \n"    // CRASH_FAULT
+        "b device_crash_isr     \n");
+}
+
+extern "C" __attribute__((naked)) void isr_watchdog()
+{
+    __asm volatile(
+        "tst lr, #4             \n"
+        "ite eq                 \n"
+        "mrseq r0, msp          \n"
+        "mrsne r0, psp          \n"
+        "mov r1, #1             \n"    // CRASH_WATCHDOG
+        "b device_crash_isr     \n");
+}
+#endif
+
+void device_halt_record(void *where)
+{
+    unsigned long r[8] = { 0 };
+
+    r[6] = (unsigned long)where;
+    device_crash_save(r, CRASH_HALT);
+}
+
+void device_crash_print(const CRASH *c)
+{
+    const FLIGHT *f;
+    int i, n;
+
+    Serial.printf("crash: %s in %s, %lu ms, uptime %lu ms\r\n",
+            c->kind < 4 ? CrashNames[c->kind] : "?",
+            c->stage < S_STAGES ? StageNames[c->stage] : "?",
+            c->stage_ms, c->uptime_ms);
+    Serial.printf("  r0 %08lx r1 %08lx r2 %08lx r3 %08lx r12 %08lx\r\n",
+            c->r[0], c->r[1], c->r[2], c->r[3], c->r[4]);
+    Serial.printf("  lr %08lx pc %08lx psr %08lx\r\n", c->r[5], c->r[6], c->r[7]);
+    Serial.printf("  cfsr %08lx hfsr %08lx mmfar %08lx bfar %08lx\r\n",
+            c->cfsr, c->hfsr, c->mmfar, c->bfar);
+
+    Serial.printf("  flight:");
+    n = c->flight_pos < FLIGHT_SIZE ? c->flight_pos : FLIGHT_SIZE;
+    for(i=1; i <= n; i++)
+    {
+        f = &c->flight[(c->flight_pos - i) % FLIGHT_SIZE];
+        Serial.printf(" -%lu us %s %d%s", c->now - f->us,
+                f->stage < S_STAGES ? StageNames[f->stage] : "?", f->event,
+                i < n ? "," : "");
+    }
+    Serial.printf("\r\n");
+}
+
+//
+// console "stall"
+//
+void device_stall_report()
+{
+    int i;
+
+    for(i=0; i < S_STAGES; i++)
+    {
+        Serial.printf("stall: %-8s budget %6lu us, %lu over, max %lu us\r\n",
+                StageNames[i], StageBudgetUs[i], STALL.stalls[i], STALL.max_us[i]);
+    }
+
+    if( crash_last.magic == CRASH_MAGIC )
+        device_crash_print(&crash_last);
+    else
+        Serial.printf("no crash record\r\n");
+}
+
+//
+// at boot: pick up the crash record, then arm the watchdog and the
+// fault handlers
+//
+void device_watchdog_setup()
+{
+    if( crash_ram.magic == CRASH_MAGIC && crash_ram.sum == device_crash_sum(&crash_ram) )
+    {
+        crash_last = crash_ram;
+        device_crash_print(&crash_last);
+    }
+    memset(&crash_ram, 0, sizeof(crash_ram));
+
+    STALL.stage = S_IDLE;
+    STALL.since = micros();
+
+#if defined(__IMXRT1062__)
+    _VectorsRam[3] = isr_fault;         // HardFault
+    _VectorsRam[4] = isr_fault;         // MemManage
+    _VectorsRam[5] = isr_fault;         // BusFault
+    _VectorsRam[6] = isr_fault;         // UsageFault
+
+    CCM_CCGR3 |= CCM_CCGR3_WDOG1(CCM_CCGR_ON);
+    WDOG1_WMCR = 0;                     // no power down counter
+    WDOG1_WICR = 0x8000                 // WIE
+            | (WATCHDOG_WARN & 0xff);   // WICT
+    WDOG1_WCR = (((WATCHDOG_MS / 500) - 1) << 8)    // WT, 0.5 s steps
+            | 0x20 | 0x10               // WDA, SRS: no external/software reset
+            | 0x08 | 0x04               // WDT, WDE: time out resets the chip
+            | 0x01;                     // WDZST: stop in low power modes
+
+    attachInterruptVector(IRQ_WDOG1, isr_watchdog);
+    NVIC_SET_PRIORITY(IRQ_WDOG1, PRIO_WDOG);
+    NVIC_ENABLE_IRQ(IRQ_WDOG1);
+#endif
+
+    STALL.enabled = 1;
+    device_watchdog_feed();
+}
+
+void device_setup()
+{
+    int rc, rc2;
+
+    Serial.begin(9600);
+
+    pinMode(13, OUTPUT);        // built-in led
+
+    pinMode(24, OUTPUT);        // buzzer
+
+    pinMode(12, INPUT);         // push button 1 (upper left)
+    pinMode(11, INPUT);         // push button 2 (upper right)
+    pinMode(10, INPUT);         // push button 3 (lower left)
+    pinMode(9, INPUT);          // push button 4 (lower right)
+
+    attachInterrupt(12, isr_xxx1, RISING);
+    attachInterrupt(11, isr_xxx2, RISING);
+    attachInterrupt(10, isr_xxx3, RISING);
+    attachInterrupt(9, isr_xxx4, RISING);
+
+    //
+    // hex keypad
+    //
+    pinMode(HKA, OUTPUT);
+    pinMode(HKB, OUTPUT);
+    pinMode(HKC, OUTPUT);
+    pinMode(HKD, OUTPUT);
+
+    digitalWriteFast(HKA, LOW);
+    digitalWriteFast(HKB, LOW);
+    digitalWriteFast(HKC, LOW);
+    digitalWriteFast(HKD, LOW);
+
+    pinMode(HK1, INPUT_PULLDOWN);
+    pinMode(HK2, INPUT_PULLDOWN);
+    pinMode(HK3, INPUT_PULLDOWN);
+    pinMode(HK4, INPUT_PULLDOWN);
+
+    attachInterrupt(HK1, isr_hk1, RISING);
+    attachInterrupt(HK2, isr_hk2, RISING);
+    attachInterrupt(HK3, isr_hk3, RISING);
+    attachInterrupt(HK4, isr_hk4, RISING);
+
+    disp_setup();
+
+    rc = disp_init();
+    if( rc )
+    {
+        Serial.println("disp_init failed");
+        debug_flash(rc);
+    }
+
+    rc2 = disp_set_range();
+    if( rc2 )
+    {
+        Serial.println("disp_set_range failed");
+        debug_flash(rc2);
+    }
+
+    device_trim_load();
+
+    device_isr_setup();
+    DEVICE.it.begin(isr_hex_scan, TICK_US); // 1/100th of a second
+
+    device_watchdog_setup();
+
+    interrupts();
+}
+
+int casio_selftest();
+int casio_selftest_run(int print);
+void casio_soak();
+void casio_warp();
+void casio_log_command(int ch);
+void casio_fuzz();
+void casio_bench();
+void casio_cycles();
+void casio_pipeline();
+void casio_latency();
+void casio_power_day();
+void casio_console_state();
+void casio_console_time(const char *arg);
+void casio_console_frame(const char *arg);
+void casio_console_power(const char *arg);
+
+//
+// single letter console commands (see serial console)
+//  s   - send a screenshot (key frame)
+//  m   - toggle mirror mode
+//  k   - start/finish clock calibration against the RTC (see device_cal_command)
+//  y   - start a time sync burst (see time sync, tools/timesync.py)
+//  h   - print the hash of the frame on the display
+//  t   - run the self test (see casio_selftest)
+//  T   - print the self test digests as a table for SelftestGolden
+//  o   - run the soak test (see casio_soak)
+//  w   - run the time warp test (see casio_warp)
+//  z   - run random inputs through the fuzz entry (see casio_fuzz_input)
+//  b   - run the micro benchmarks (see casio_bench)
+//  c   - print cycle counts (see casio_cycles)
+//  e   - run the end to end pipeline benchmark (see casio_pipeline)
+//  l   - measure key latency with and without preemption (see casio_latency)
+//  u   - estimate a day's display charge under each power policy (see casio_power_day)
+//  r   - start/stop recording events (see casio_log_command)
+//  d   - dump the event log
+//  p   - replay the event log at full speed and check the frames
+//  P   - replay the event log in real time on the display
+//
+void device_serial_command(int ch)
+{
+    switch(ch)
+    {
+    case 'h':
+        Serial.printf("frame %08lx\r\n", disp_hash(DISP.frame));
+        break;
+    case 't':
+        casio_selftest();
+        break;
+    case 'T':
+        casio_selftest_run(1);
+        break;
+    case 'o':
+        casio_soak();
+        break;
+    case 'w':
+        casio_warp();
+        break;
+    case 'z':
+        casio_fuzz();
+        break;
+    case 'b':
+        casio_bench();
+        break;
+    case 'c':
+        casio_cycles();
+        break;
+    case 'e':
+        casio_pipeline();
+        break;
+    case 'l':
+        casio_latency();
+        break;
+    case 'u':
+        casio_power_day();
+        break;
+    case 'r':
+    case 'd':
+    case 'p':
+    case 'P':
+        casio_log_command(ch);
+        break;
+    case 's':
+        disp_screenshot();
+        break;
+    case 'm':
+        disp_mirror_enable( ! MIRROR.enabled );
+        break;
+    case 'k':
+        device_cal_command();
+        break;
+    case 'y':
+        device_sync_start();
+        break;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// serial console
+//
+// Line oriented commands over USB serial, for people and for test
+// scripts driving the watch. device_get_event() calls
+// device_console_poll() whenever it has nothing else to do; each call
+// reads at most CONSOLE_BYTES bytes and runs at most one line, and
+// never waits for more input, so the watch keeps ticking and drawing
+// while a command is being typed.
+//
+//      time                        print the time
+//      time EPOCH                  set the time (5 or more digits)
+//      time YYYY-MM-DD HH:MM:SS    1970 to 2105, checked
+//      state                       dump the watch state
+//      counters                    time base, display and queue counters
+//      mirror [on|off]             frame mirror on or off (see frame mirror)
+//      isr                         longest interrupt times (see interrupts)
+//      stall                       stage times and the last crash (see watchdog)
+//      power [normal|dim|invert|save]  display power model, set the policy
+//                                  (not while recording, see event log)
+//      burn [on|off|step]          burn-in wear map, pixel shift (see burn-in)
+//      frame [US]                  frame counters, set the minimum frame interval
+//      btn A|B|C|L...              press and release buttons
+//      key 0-9|A-D|*|#...          press and release hex keys
+//      event N                     raise event N (see EVENT)
+//      help
+//
+// plus the single letter commands above. Injected events go through a
+// queue that device_get_event() drains like the interrupt driven ones,
+// so the log, the mirror etc. can't tell them apart.
+//
+// A 0xA5 at the start of a line is a binary packet from the host (time
+// sync replies), collected here a byte at a time. The header decides:
+// anything but a sync reply ('R', 24 bytes) is dropped as soon as it is
+// in, so a stray 0xA5 costs the 6 bytes after it and not the next
+// 64 KB of input.
+//
+
+#define CONSOLE_LINE    64
+#define CONSOLE_BYTES   64          // per poll
+
+static struct
+{
+    char line[CONSOLE_LINE];
+    int len;
+    unsigned char pkt[6 + 24];
+    int pkt_len;                    // bytes of the packet so far, 0 = none
+    int pkt_size;                   // whole packet, once the header is in
+    unsigned long long pkt_time;    // when the sync byte arrived
+} CONSOLE;
+
+void device_console_counters()
+{
+    Serial.printf("ticks %lu clock %ld epoch %lu trim %ld ppb slew %ld\r\n",
+            DEVICE.ticks, DEVICE.clock, DEVICE.epoch, DEVICE.trim.ppb, DEVICE.slew);
+    Serial.printf("disp %lu bytes %lu transfers %lu offscreen, mirror %lu bytes\r\n",
+            DISP.bytes, DISP.transfers, DRAW_SCREEN.offscreen, MIRROR.bytes);
+    Serial.printf("queue %d waiting %lu dropped\r\n",
+            (QUEUE.head - QUEUE.tail + EVENT_QUEUE) % EVENT_QUEUE, QUEUE.dropped);
+}
+
+//
+// "mirror on" and "mirror off" set the mode whatever it was, unlike 'm'.
+// Turning it on again sends a fresh key frame.
+//
+void device_console_mirror(const char *arg)
+{
+    if( strcmp(arg, "on") == 0 )
+        disp_mirror_enable(1);
+    else if( strcmp(arg, "off") == 0 )
+        disp_mirror_enable(0);
+    else
+        Serial.printf("mirror %s, %lu bytes\r\n", MIRROR.enabled ? "on" : "off", MIRROR.bytes);
+}
+
+//
+// press and release every key named in 'arg'
+//
+void device_console_keys(const char *arg, int hex)
+{
+    const char *p;
+    int e;
+
+    for(p=arg; *p; p++)
+    {
+        e = -1;
+        if( ! hex )
+        {
+            switch(*p)
+            {
+            case 'A': case 'a': e = E_BUTTONA; break;
+            case 'B': case 'b': e = E_BUTTONB; break;
+            case 'C': case 'c': e = E_BUTTONC; break;
+            case 'L': case 'l': e = E_BUTTONL; break;
+            }
+            if( e >= 0 && device_post_event(e) == 0 )
+                device_post_event(e + E_BUTTONA_RELEASE - E_BUTTONA);
+        }
+        else
+        {
+            if( *p >= '0' && *p <= '9' )        e = E_HEX_BUTTON_0 + (*p - '0');
+            else if( *p >= 'A' && *p <= 'D' )   e = E_HEX_BUTTON_A + (*p - 'A');
+            else if( *p >= 'a' && *p <= 'd' )   e = E_HEX_BUTTON_A + (*p - 'a');
+            else if( *p == '*' )                e = E_HEX_BUTTON_STAR;
+            else if( *p == '#' )                e = E_HEX_BUTTON_POUND;
+            if( e >= 0 && device_post_event(e) == 0 )
+                device_post_event(e + E_HEX_BUTTON_0_RELEASE - E_HEX_BUTTON_0);
+        }
+    }
+}
+
+void device_console_line(char *line)
+{
+    char *arg;
+    int e;
+
+    // split off the first word
+    for(arg=line; *arg && *arg != ' '; arg++)
+        ;
+    if( *arg )
+        *arg++ = '\0';
+    while( *arg == ' ' )
+        arg++;
+
+    if( line[0] != '\0' && line[1] == '\0' )
+        device_serial_command(line[0]);
+    else if( strcmp(line, "time") == 0 )
+        casio_console_time(arg);
+    else if( strcmp(line, "state") == 0 )
+        casio_console_state();
+    else if( strcmp(line, "counters") == 0 )
+        device_console_counters();
+    else if( strcmp(line, "mirror") == 0 )
+        device_console_mirror(arg);
+    else if( strcmp(line, "frame") == 0 )
+        casio_console_frame(arg);
+    else if( strcmp(line, "isr") == 0 )
+        device_isr_report();
+    else if( strcmp(line, "stall") == 0 )
+        device_stall_report();
+    else if( strcmp(line, "power") == 0 )
+        casio_console_power(arg);
+    else if( strcmp(line, "burn") == 0 )
+        disp_burn_console(arg);
+    else if( strcmp(line, "btn") == 0 )
+        device_console_keys(arg, 0);
+    else if( strcmp(line, "key") == 0 )
+        device_console_keys(arg, 1);
+    else if( strcmp(line, "event") == 0 && sscanf(arg, "%d", &e) == 1 && e > E_NONE && e <= E_LIGHT_OFF )
+        device_post_event(e);
+    else
+        Serial.printf("commands: time [EPOCH|Y-M-D H:M:S], state, counters, mirror [on|off], frame [US],\r\n"
+                "  isr, stall, power [POLICY], burn [on|off|step], btn ABCL, key 0-9A-D*#, event N,\r\n"
+                "  s m k y h t T o w z b c e l u r d p P\r\n");
+}
+
+void device_console_poll()
+{
+    int n, ch, prev;
+
+    for(n=0; n < CONSOLE_BYTES && Serial.available() > 0; n++)
+    {
+        ch = Serial.read();
+
+        if( CONSOLE.pkt_len > 0 )
+        {
+            if( CONSOLE.pkt_len < (int)sizeof(CONSOLE.pkt) )
+                CONSOLE.pkt[CONSOLE.pkt_len] = ch;
+            CONSOLE.pkt_len++;
+
+            if( CONSOLE.pkt_len == 6 )
+            {
+                CONSOLE.pkt_size = 6 + (CONSOLE.pkt[4] | (CONSOLE.pkt[5] << 8));
+                if( CONSOLE.pkt[1] != 'R' || CONSOLE.pkt_size != (int)sizeof(CONSOLE.pkt) )
+                {
+                    CONSOLE.pkt_len = 0;        // not a sync reply, back to lines
+                    continue;
+                }
+            }
+            if( CONSOLE.pkt_len >= 6 && CONSOLE.pkt_len == CONSOLE.pkt_size )
+            {
+                device_sync_packet(CONSOLE.pkt, CONSOLE.pkt_len, CONSOLE.pkt_time);
+                CONSOLE.pkt_len = 0;
+            }
+        }
+        else if( ch == MIRROR_SYNC && CONSOLE.len == 0 )
+        {
+            CONSOLE.pkt_time = device_time_us();
+            CONSOLE.pkt[0] = ch;
+            CONSOLE.pkt_len = 1;
+        }
+        else if( ch == '\r' || ch == '\n' )
+        {
+            if( CONSOLE.len > 0 )
+            {
+                CONSOLE.line[CONSOLE.len] = '\0';
+                CONSOLE.len = 0;
+                prev = STALL.stage;
+                device_stage(S_COMMAND, 0);
+                device_console_line(CONSOLE.line);
+                device_stage(prev, 0);
+                return;
+            }
+        }
+        else if( CONSOLE.len < CONSOLE_LINE-1 )
+        {
+            CONSOLE.line[CONSOLE.len++] = ch;
+        }
+    }
+}
+
+//
+// the buttons and keys as device_poll_event() last saw them
+//
+static struct
+{
+    int xxx;
+    int hex;
+} POLL;
+
+//
+// the next event, or E_NONE if nothing has happened. Monitors the
+// global variables for a change.
+//
+int device_poll_event()
+{
+    static unsigned long saved_epoch = 0;
+    static int saved_counter15 = 0;
+    static int saved_light = 0;
+    static long saved_clock = 0;
+    int e;
+
+    device_watchdog_feed();
+
+    e = E_NONE;
+    if( POLL.xxx != DEVICE.xxx )
+    {
+        if( DEVICE.xxx == 0 ) {
+            if( POLL.xxx & 0x01 ) {
+                e = E_BUTTONL_RELEASE;
+            } else if( POLL.xxx & 0x02 ) {
+                e = E_BUTTONC_RELEASE;
+            } else if( POLL.xxx & 0x04 ) {
+                e = E_BUTTONB_RELEASE;
+            } else if( POLL.xxx & 0x08 ) {
+                e = E_BUTTONA_RELEASE;
+            }
+        } else if( DEVICE.xxx & 0x01 ) {
+            e = E_BUTTONL;
+        } else if( DEVICE.xxx & 0x02 ) {
+            e = E_BUTTONC;
+        } else if( DEVICE.xxx & 0x04 ) {
+            e = E_BUTTONB;
+        } else if( DEVICE.xxx & 0x08 ) {
+            e = E_BUTTONA;
+        }
+        POLL.xxx = DEVICE.xxx;
+    }
+    else if( POLL.hex != DEVICE.hex )
+    {
+        switch(DEVICE.hex)
+        {
+        case  0:
+                switch(POLL.hex) {
+                case  1: e = E_HEX_BUTTON_D_RELEASE; break;         // D
+                case  2: e = E_HEX_BUTTON_POUND_RELEASE; break;     // #
+                case  3: e = E_HEX_BUTTON_0_RELEASE; break;         // 0
+                case  4: e = E_HEX_BUTTON_STAR_RELEASE; break;      // *
+
+                case  11: e = E_HEX_BUTTON_C_RELEASE; break;        // C
+                case  12: e = E_HEX_BUTTON_9_RELEASE; break;        // 9
+                case  13: e = E_HEX_BUTTON_8_RELEASE; break;        // 8
+                case  14: e = E_HEX_BUTTON_7_RELEASE; break;        // 7
+
+                case  21: e = E_HEX_BUTTON_B_RELEASE; break;        // B
+                case  22: e = E_HEX_BUTTON_6_RELEASE; break;        // 6
+                case  23: e = E_HEX_BUTTON_5_RELEASE; break;        // 5
+                case  24: e = E_HEX_BUTTON_4_RELEASE; break;        // 4
+
+                case  31: e = E_HEX_BUTTON_A_RELEASE; break;        // A
+                case  32: e = E_HEX_BUTTON_3_RELEASE; break;        // 3
+                case  33: e = E_HEX_BUTTON_2_RELEASE; break;        // 2
+                case  34: e = E_HEX_BUTTON_1_RELEASE; break;        // 1
+                }
+                break;
+        case  1: e = E_HEX_BUTTON_D; break;         // D
+        case  2: e = E_HEX_BUTTON_POUND; break;     // #
+        case  3: e = E_HEX_BUTTON_0; break;         // 0
+        case  4: e = E_HEX_BUTTON_STAR; break;      // *
+
+        case  11: e = E_HEX_BUTTON_C; break;        // C
+        case  12: e = E_HEX_BUTTON_9; break;        // 9
+        case  13: e = E_HEX_BUTTON_8; break;        // 8
+        case  14: e = E_HEX_BUTTON_7; break;        // 7
+
+        case  21: e = E_HEX_BUTTON_B; break;        // B
+        case  22: e = E_HEX_BUTTON_6; break;        // 6
+        case  23: e = E_HEX_BUTTON_5; break;        // 5
+        case  24: e = E_HEX_BUTTON_4; break;        // 4
+
+        case  31: e = E_HEX_BUTTON_A; break;        // A
+        case  32: e = E_HEX_BUTTON_3; break;        // 3
+        case  33: e = E_HEX_BUTTON_2; break;        // 2
+        case  34: e = E_HEX_BUTTON_1; break;        // 1
+        }
+        POLL.hex = DEVICE.hex;
+    }
+    else if( saved_light != DEVICE.light )
+    {
+        if( DEVICE.light == 0 )
+        {
+            e = E_LIGHT_OFF;
+        }
+        saved_light = DEVICE.light;
+    }
+    else if( saved_epoch != DEVICE.epoch )
+    {
+        saved_epoch = DEVICE.epoch;
+        e = E_SECONDS_TIMER;
+    }
+    else if( saved_counter15 != DEVICE.counter15 )
+    {
+        saved_counter15 = DEVICE.counter15;
+        if( DEVICE.counter15_enable )
+            e = E_SECONDS15;
+    }
+    else if( QUEUE.tail != QUEUE.head )
+    {
+        e = QUEUE.buf[QUEUE.tail];
+        QUEUE.tail = (QUEUE.tail + 1) % EVENT_QUEUE;
+    }
+    else if( Serial.available() > 0 )
+    {
+        device_console_poll();
+    }
+    else if( saved_clock != DEVICE.clock )
+    {
+        // lowest priority: only when there is nothing else to do
+        saved_clock = DEVICE.clock;
+        device_sync_poll();
+        if( DEVICE.live_enable )
+            e = E_LIVE;
+    }
+
+    return e;
+}
+
+//
+// is there a key, button or console event device_poll_event() hasn't
+// handed out yet? Lets a display transfer give way to it.
+//
+int device_input_pending()
+{
+    return POLL.xxx != DEVICE.xxx || POLL.hex != DEVICE.hex
+        || QUEUE.tail != QUEUE.head;
+}
+
+//
+// sleep until the next interrupt: the tick, a key or button, USB, or
+// SysTick, which wakes it every millisecond at the latest
+//
+void device_sleep()
+{
+#if defined(__IMXRT1062__)
+    asm volatile("wfi");
+#endif
+}
+
+//
+// wait for event to occur
+//
+int device_get_event()
+{
+    int e;
+
+    while( (e = device_poll_event()) == E_NONE )
+        device_sleep();
+
+    return e;
+}
+
+//
+// wait for an event, but not past 'deadline' (micros()). Returns E_NONE
+// if the deadline came first.
+//
+int device_wait_event(unsigned long deadline)
+{
+    int e;
+
+    while( (e = device_poll_event()) == E_NONE && (long)(deadline - micros()) > 0 )
+        device_sleep();
+
+    return e;
+}
+//////////////////////////////////////////////////////////////////////
+// end DEVICE
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//
+// begin DRAW
+//
+//////////////////////////////////////////////////////////////////////
+
+HOT_CODE void draw_filled_block(char *frame, int x1, int y1, int x2, int y2)
+{
+    CLIP r = { x1, y1, x2, y2 };
+    int x, y;
+
+    if( disp_clip_rect(&r) == 0 )
+        return;
+
+    x1 = r.x1;
+    y1 = r.y1;
+    x2 = r.x2;
+    y2 = r.y2;
+
+    //
+    // fill one page (8 rows) at a time: build the mask of rows inside
+    // this page, then apply it to each column byte.
+    //
+    for(y=y1; y < y2; y = (y | 7) + 1) {
+        const int WIDTH = 128;
+        char *p;
+        int mask;
+
+        mask = 0xff << (y & 7);
+        if( (y | 7) >= y2 )
+            mask &= 0xff >> (7 - ((y2-1) & 7));
+
+        p = frame + (y>>3) * WIDTH;
+        for(x=x1; x < x2; x++) {
+            if( PIXEL_ON(1) )
+                p[x] |= mask;
+            else
+                p[x] &= ~mask;
+        }
+    }
+}
+
+void draw_rect(char *frame, int x1, int y1, int width, int height)
+{
+    int x2, y2;
+
+    x2 = x1 + width;
+    y2 = y1 + height;
+
+    draw_filled_block(frame, x1, y1, x2+1, y1+1);
+    draw_filled_block(frame, x1, y2, x2+1, y2+1);
+    draw_filled_block(frame, x1, y1, x1+1, y2+1);
+    draw_filled_block(frame, x2, y1, x2+1, y2+1);
+}
+
+//
+//          (x0, y0)
+//  0x01          ======
+//              ||       ||
+//  0x02        ||  ##   || 0x04
+//              ||       ||
+//  0x08          ======
+//              ||       ||
+//  0x10        ||  ##   || 0x20
+//              ||       ||
+//  0x40          ======    ##     0x80
+//
+// Top dot:         0x100
+// bottom dot:      0x200
+// decimal point:   0x80
+//
+void draw_segments(char *frame, int x, int y, int width, int height, int thick, int segments)
+{
+    int x1, x2, y1, y2;
+
+    if( segments & 0x01 ) {
+        x1 = x + thick;
+        x2 = x + thick + width;
+        y1 = y;
+        y2 = y + thick;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x02 ) {
+        x1 = x;
+        x2 = x + thick;
+        y1 = y + thick;
+        y2 = y + thick + height;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x04 ) {
+        x1 = x + thick + width;
+        x2 = x + thick + width + thick;
+        y1 = y + thick;
+        y2 = y + thick + height;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x08 ) {
+        x1 = x + thick;
+        x2 = x + thick + width;
+        y1 = y + thick + height;
+        y2 = y + thick + height + thick;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x10 ) {
+        x1 = x;
+        x2 = x + thick;
+        y1 = y + thick + height + thick;
+        y2 = y + thick + height + thick + height;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x20 ) {
+        x1 = x + thick + width;
+        x2 = x + thick + width + thick;
+        y1 = y + thick + height + thick;
+        y2 = y + thick + height + thick + height;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x40 ) {
+        x1 = x + thick;
+        x2 = x + thick + width;
+        y1 = y + thick + height + thick + height;
+        y2 = y + thick + height + thick + height + thick;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x80 ) {
+        // decimal
+        const int SPC = 2; // 1 looked okay
+
+        x1 = x + thick + width + thick + SPC;
+        x2 = x + thick + width + thick + SPC + thick;
+        y1 = y + thick + height + thick + height;
+        y2 = y + thick + height + thick + height + thick;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x100 ) {
+        // top dot
+        x1 = x + thick + width/2 - thick/2;
+        x2 = x + thick + width/2 - thick/2 + thick;
+        y1 = y + thick + height/2 - thick/2;
+        y2 = y + thick + height/2 - thick/2 + thick;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+
+    if( segments & 0x200 ) {
+        // bottom dot
+        x1 = x + thick + width/2 - thick/2;
+        x2 = x + thick + width/2 - thick/2 + thick;
+        y1 = y + thick + height + thick + height/2 - thick/2;
+        y2 = y + thick + height + thick + height/2 - thick/2 + thick;
+
+        draw_filled_block(frame, x1, y1, x2, y2);
+    }
+}
+
+HOT_CODE void draw_digit(char *frame, int x, int y, int width, int height, int thick, char digit, int dp)
+{
+    int segments;
+
+    switch(digit)
+    {
+    case '0':
+        segments = 0x01 | 0x02 | 0x04 | 0x10 | 0x20 | 0x40;
+        break;
+    case '1':
+        segments = 0x04 | 0x20;
+        break;
+    case '2':
+        segments = 0x01 | 0x04 | 0x08 | 0x10 | 0x40;
+        break;
+    case '3':
+        segments = 0x01 | 0x04 | 0x08 | 0x020 | 0x40;
+        break;
+    case '4':
+        segments = 0x02 | 0x08 | 0x04 | 0x020;
+        break;
+    case '5':
+        segments = 0x01 | 0x02 | 0x08 | 0x20 | 0x40;
+        break;
+    case '6':
+        segments = 0x01 | 0x02 | 0x08 | 0x10 | 0x20 | 0x40;
+        break;
+    case '7':
+        segments = 0x01 | 0x02 | 0x04 | 0x20; 
+        break;
+    case '8':
+        segments = 0x01 | 0x02 | 0x04 | 0x08 | 0x10 | 0x20 | 0x40; 
+        break;
+    case '9':
+    case 'g':
+        segments = 0x01 | 0x02 | 0x04 | 0x08 | 0x20 | 0x40; 
+        break;
+    case 'A':
+    case 'a':
+        segments = 0x01 | 0x02 | 0x04 | 0x08 | 0x10 | 0x20;
+        break;
+    case 'B':
+    case 'b':
+        segments = 0x02 | 0x10 | 0x40 | 0x20 | 0x08; 
+        break;
+    case 'C':
+    case 'c':
+        segments = 0x01 | 0x02 | 0x10 | 0x40;
+        break;
+    case 'D':
+    case 'd':
+        segments = 0x04 | 0x20 | 0x08 | 0x10 | 0x40;
+        break;
+    case 'E':
+    case 'e':
+        segments = 0x01 | 0x02 | 0x08 | 0x10 | 0x40;
+        break;
+    case 'F':
+    case 'f':
+        segments = 0x01 | 0x02 | 0x08 | 0x10;
+        break;
+    case 'H':
+        segments = 0x02 | 0x04 | 0x08 | 0x10 | 0x20;
+        break;
+    case 'h':
+        segments = 0x02 | 0x08 | 0x10 | 0x20;
+        break;
+    case 'i':
+        segments = 0x20;
+        break;
+    case 'J':
+        segments = 0x04 | 0x20 | 0x40 | 0x10;
+        break;
+    case 'L':
+        segments = 0x02 | 0x10 | 0x40;
+        break;
+    case 'n':
+        segments = 0x08 | 0x10 | 0x20;
+        break;
+    case 'o':
+        segments = 0x08 | 0x10 | 0x20 | 0x40;
+        break;
+    case 'P':
+        segments = 0x01 | 0x02 | 0x04 | 0x08 | 0x10;
+        break;
+    case 'U':
+        segments = 0x02 | 0x04 | 0x10 | 0x20 | 0x40;
+        break;
+    case '-':
+        segments = 0x08;
+        break;
+    case '_':
+        segments = 0x04;
+        break;
+    case ':':
+        segments = 0x200 | 0x100;
+        break;
+    case '.':
+        segments = 0x80;
+        break;
+    case ' ':
+        segments = 0x00;  /* BLANK */
+        break;
+    default:
+        segments = 0x00;
+        break;
+    }
+
+    if(dp) {
+        segments |= 0x80;
+    }
+
+    draw_segments(frame, x, y, width, height, thick, segments);
+}
+
+HOT_CODE void draw_segstr(char *frame, int x0, int y0, int width, int height, int thick, const char *str)
+{
+    int x;
+    const char *p;
+    const int SPACING = 3;
+
+    x = x0;
+    for(p=str; *p; p++)
+    {
+        if( *p == '.' )
+            continue;
+        draw_digit(frame, x, y0, width, height, thick, *p, p[1]=='.');
+        x = x + width + thick*2 + SPACING;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// segment string formatting
+//
+// The screens build their draw_segstr() strings with these instead of
+// snprintf, which is slow on the M7 and pulls in newlib's formatted
+// I/O. Each function writes at 'p', NUL terminates and returns the
+// end, so calls can be chained:
+//
+//      p = fmt_2d(buf, hours);         // "%2d:%02d"
+//      *p++ = ':';
+//      p = fmt_02d(p, minutes);
+//
+// Two digit fields come from a lookup table; nothing divides by more
+// than one constant per digit.
+//
+
+static const char Digits2[201] =
+    "00010203040506070809" "10111213141516171819" "20212223242526272829"
+    "30313233343536373839" "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879" "80818283848586878889"
+    "90919293949596979899";
+
+//
+// "%*ld": right aligned in 'width' characters
+//
+char *fmt_int(char *p, long v, int width)
+{
+    char tmp[12];
+    unsigned long u;
+    int n, i;
+
+    u = (v < 0) ? 0UL - (unsigned long)v : (unsigned long)v;
+    n = 0;
+    do {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+    } while( u );
+    if( v < 0 )
+        tmp[n++] = '-';
+
+    for(i=n; i < width; i++)
+        *p++ = ' ';
+    while( n > 0 )
+        *p++ = tmp[--n];
+    *p = '\0';
+
+    return p;
+}
+
+//
+// "%02d", 0-99
+//
+char *fmt_02d(char *p, int v)
+{
+    if( v < 0 || v > 99 )
+        return fmt_int(p, v, 2);
+
+    *p++ = Digits2[v*2];
+    *p++ = Digits2[v*2 + 1];
+    *p = '\0';
+
+    return p;
+}
+
+//
+// "%2d", 0-99
+//
+char *fmt_2d(char *p, int v)
+{
+    if( v < 0 || v > 99 )
+        return fmt_int(p, v, 2);
+
+    *p++ = (v < 10) ? ' ' : Digits2[v*2];
+    *p++ = Digits2[v*2 + 1];
+    *p = '\0';
+
+    return p;
+}
+
+//
+// "%*s": right aligned in 'width' characters
+//
+char *fmt_str(char *p, const char *str, int width)
+{
+    int n = strlen(str);
+
+    while( width-- > n )
+        *p++ = ' ';
+    while( *str )
+        *p++ = *str++;
+    *p = '\0';
+
+    return p;
+}
+
+//
+// "%2d%c%02d", the time fields
+//
+char *fmt_time(char *p, int hours, int delim, int minutes)
+{
+    p = fmt_2d(p, hours);
+    *p++ = delim;
+    return fmt_02d(p, minutes);
+}
+
+//
+// the calculator display: 8 digits, right aligned in 9 characters (the
+// '.' shares a digit's cell). Rounds to 9 decimals, drops trailing
+// zeros but keeps the '.', then cuts the decimals to fit. "E" if the
+// integer part has more than 8 digits.
+//
+char *fmt_calc(char *p, double v)
+{
+    char tmp[24];
+    char *q;
+    unsigned long ip, fp;
+    int neg, digits, i;
+
+    neg = (v < 0);
+    if( neg )
+        v = -v;
+
+    if( !(v < 1e8) )                    // (NaN too)
+        return fmt_str(p, "E", 9);
+
+    ip = (unsigned long)v;
+    fp = (unsigned long)((v - ip) * 1e9 + 0.5);
+    if( fp >= 1000000000UL )
+    {
+        ip++;
+        fp -= 1000000000UL;
+        if( ip >= 100000000UL )
+            return fmt_str(p, "E", 9);
+    }
+
+    q = tmp;
+    if( neg )
+        *q++ = '-';
+    q = fmt_int(q, ip, 0);
+    digits = q - tmp - neg;
+    *q++ = '.';
+
+    for(i=8; i >= 0; i--)
+    {
+        q[i] = '0' + fp % 10;
+        fp /= 10;
+    }
+    for(i=9; i > 0 && q[i-1] == '0'; i--)
+        ;
+    if( i > 8 - digits )
+        i = 8 - digits;
+    q[i] = '\0';
+
+    return fmt_str(p, tmp, 9);
+}
+
+//
+// fmt_calc() the slow way, as the calculator screen used to: "%.9f",
+// trailing zeros dropped, cut to 8 digits, "E" past 8 integer digits.
+// Only the self test calls it (see casio_selftest_fmt_calc), and it
+// has to stay above the poison below.
+//
+char *fmt_calc_ref(char *p, double v)
+{
+    char tmp[64];
+    char *q;
+    int n;
+
+    snprintf(tmp, sizeof(tmp), "%.9f", v + 0.0);     // (-0.0 is 0.)
+
+    for(q=tmp+strlen(tmp)-1; q > tmp && *q == '0'; q--)
+        *q = '\0';
+
+    q = strchr(tmp, '.');
+    if( q == NULL || q - tmp - (tmp[0] == '-') > 8 )
+        return fmt_str(p, "E", 9);
+
+    n = 0;
+    for(q=tmp; *q; q++)
+    {
+        if( *q >= '0' && *q <= '9' && ++n > 8 )
+        {
+            *q = '\0';
+            break;
+        }
+    }
+
+    return fmt_str(p, tmp, 9);
+}
+
+// keep it that way
+#pragma GCC poison sprintf snprintf vsnprintf
+
+void draw_number(char *frame, int x0, int y0, int width, int height, int thick, int num)
+{
+    char buf[20];
+
+    fmt_int(buf, num, 3);
+
+    draw_segstr(frame, x0, y0, width, height, thick, buf);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// 7x5 font
+//
+//////////////////////////////////////////////////////////////////////
+
+const int CHAR_WIDTH = 5;
+const int CHAR_HEIGHT = 7;
+const int CHAR_SPACING = 1;
+
+// render a 5x7 font character into a frame buffer
+//
+// get the pixels for character 'ch' at coordinate (x,y)
+// (0,0)
+//      +-------+
+//      |  * *  |
+//      |   *   |
+//      | ***** |
+//      | *     |
+//      | ****  |
+//      | *     |
+//      | ***** |
+//      +-------+
+//
+//  5x7 text
+//
+//        0   1   2   3   4
+//      +---+---+---+---+---+
+//  0   | 4 | 3 | 2 | 1 | 0 |       4...0       top
+//      +---+---+---+---+---+
+//
+//      +---+---+---+---+---+
+//  1   |29 |28 |27 |26 |25 |       29...25     bits
+//      +---+---+---+---+---+
+//  2   |24 |23 |22 |21 |20 |       24...20
+//      +---+---+---+---+---+
+//  3   |19 |18 |17 |16 |15 |       19...15
+//      +---+---+---+---+---+
+//  4   |14 |13 |12 |11 |10 |       14...10
+//      +---+---+---+---+---+
+//  5   | 9 | 8 | 7 | 6 | 5 |       9...5
+//      +---+---+---+---+---+
+//  6   | 4 | 3 | 2 | 1 | 0 |       4...0
+//      +---+---+---+---+---+
+//
+
+struct {
+    char top[133];      // the top row (bits 0 to 4)
+    long bits[133];     // the bottom 6 rows (bits 0 to 29)
+} CasioFont = {
+    //
+    //  top:            +-+-+-+-+-+
+    //        4 - 0     | | | | | | row 0
+    //                  +-+-+-+-+-+
+    //
+    //  bits:           +-+-+-+-+-+
+    //      29 - 25     | | | | | | row 1
+    //                  +-+-+-+-+-+
+    //      24 - 20     | | | | | | row 2
+    //                  +-+-+-+-+-+
+    //      19 - 15     | | | | | | row 3
+    //                  +-+-+-+-+-+
+    //      14 - 10     | | | | | | row 4
+    //                  +-+-+-+-+-+
+    //        9 - 5     | | | | | | row 5
+    //                  +-+-+-+-+-+
+    //        4 - 0     | | | | | | row 6
+    //                  +-+-+-+-+-+
+    //
+
+    //
+    // top row bits 0 - 4
+    //
+    0x00,          // 00000 <0 \00 - NUL>
+    0x00,          // 00000 <1 \01 - SPACE>
+    0x00,          // 00000 <2 \02 - A>
+    0x02,          // 00010 <3 \03 - A1>
+    0x08,          // 01000 <4 \04 - A2>
+    0x0A,          // 01010 <5 \05 - A3>
+    0x04,          // 00100 <6 \06 - A4>
+    0x0A,          // 01010 <7 \07 - A5>
+    0x09,          // 01001 <8 \10 - A6>
+    0x0E,          // 01110 <9 \11 - A7>
+    0x00,          // 00000 <10 \12 - B>
+    0x00,          // 00000 <11 \13 - C>
+    0x0F,          // 01111 <12 \14 - C1>
+    0x02,          // 00010 <13 \15 - C2>
+    0x00,          // 00000 <14 \16 - D>
+    0x00,          // 00000 <15 \17 - E>
+    0x02,          // 00010 <16 \20 - E1>
+    0x08,          // 01000 <17 \21 - E2>
+    0x04,          // 00100 <18 \22 - E3>
+    0x0A,          // 01010 <19 \23 - E4>
+    0x1F,          // 11111 <20 \24 - E5>
+    0x00,          // 00000 <21 \25 - F>
+    0x00,          // 00000 <22 \26 - G>
+    0x0A,          // 01010 <23 \27 - G1>
+    0x00,          // 00000 <24 \30 - H>
+    0x00,          // 00000 <25 \31 - I>
+    0x02,          // 00010 <26 \32 - I1>
+    0x08,          // 01000 <27 \33 - I2>
+    0x04,          // 00100 <28 \34 - I3>
+    0x0A,          // 01010 <29 \35 - I4>
+    0x04,          // 00100 <30 \36 - I5>
+    0x00,          // 00000 <31 \37 - J>
+    0x00,          // 00000 <32 \40 - K>
+    0x00,          // 00000 <33 \41 - L>
+    0x00,          // 00000 <34 \42 - L1>
+    0x00,          // 00000 <35 \43 - M>
+    0x00,          // 00000 <36 \44 - N>
+    0x02,          // 00010 <37 \45 - N1>
+    0x09,          // 01001 <38 \46 - N2>
+    0x00,          // 00000 <39 \47 - O>
+    0x02,          // 00010 <40 \50 - O1>
+    0x08,          // 01000 <41 \51 - O2>
+    0x04,          // 00100 <42 \52 - O3>
+    0x0A,          // 01010 <43 \53 - O4>
+    0x09,          // 01001 <44 \54 - O5>
+    0x00,          // 00000 <45 \55 - OE>
+    0x00,          // 00000 <46 \56 - P>
+    0x00,          // 00000 <47 \57 - Q>
+    0x00,          // 00000 <48 \60 - R>
+    0x00,          // 00000 <49 \61 - S>
+    0x02,          // 00010 <50 \62 - S1>
+    0x0F,          // 01111 <51 \63 - S2>
+    0x00,          // 00000 <52 \64 - T>
+    0x1F,          // 11111 <53 \65 - T1>
+    0x00,          // 00000 <54 \66 - U>
+    0x02,          // 00010 <55 \67 - U1>
+    0x08,          // 01000 <56 \70 - U2>
+    0x04,          // 00100 <57 \71 - U3>
+    0x0A,          // 01010 <58 \72 - U4>
+    0x00,          // 00000 <59 \73 - V>
+    0x00,          // 00000 <60 \74 - W>
+    0x00,          // 00000 <61 \75 - X>
+    0x00,          // 00000 <62 \76 - Y>
+    0x00,          // 00000 <63 \77 - Z>
+    0x02,          // 00010 <64 \100 - Z1>
+    0x04,          // 00100 <65 \101 - Z2>
+    0x00,          // 00000 <66 \102 - AE>
+    0x00,          // 00000 <67 \103 - O7>
+    0x04,          // 00100 <68 \104 - A8>
+    0x0A,          // 01010 <69 \105 - A9>
+    0x0A,          // 01010 <70 \106 - O8>
+    0x00,          // 00000 <71 \107 - SYM1>
+    0x00,          // 00000 <72 \110 - SYM2:B>
+    0x00,          // 00000 <73 \111 - SYM3>
+    0x00,          // 00000 <74 \112 - SYM4>
+    0x00,          // 00000 <75 \113 - SYM5:E>
+    0x0A,          // 01010 <76 \114 - SYM6:E>
+    0x00,          // 00000 <77 \115 - SYM7>
+    0x00,          // 00000 <78 \116 - SYM8>
+    0x00,          // 00000 <79 \117 - SYM9:N>
+    0x0A,          // 01010 <80 \120 - SYM10:N>
+    0x00,          // 00000 <81 \121 - SYM11>
+    0x00,          // 00000 <82 \122 - SYM12>
+    0x00,          // 00000 <83 \123 - SYM13:M>
+    0x00,          // 00000 <84 \124 - SYM14:H>
+    0x00,          // 00000 <85 \125 - SYM15:O>
+    0x00,          // 00000 <86 \126 - SYM16>
+    0x00,          // 00000 <87 \127 - SYM17:P>
+    0x00,          // 00000 <88 \130 - SYM18:C>
+    0x00,          // 00000 <89 \131 - SYM19:T>
+    0x00,          // 00000 <90 \132 - SYM20:y>
+    0x00,          // 00000 <91 \133 - SYM21>
+    0x00,          // 00000 <92 \134 - SYM22:X>
+    0x00,          // 00000 <93 \135 - SYM23>
+    0x00,          // 00000 <94 \136 - SYM24>
+    0x00,          // 00000 <95 \137 - SYM25:W>
+    0x00,          // 00000 <96 \140 - SYM26:W>
+    0x00,          // 00000 <97 \141 - SYM27>
+    0x00,          // 00000 <98 \142 - SYM28>
+    0x00,          // 00000 <99 \143 - SYM29>
+    0x00,          // 00000 <100 \144 - SYM30>
+    0x00,          // 00000 <101 \145 - SYM31>
+    0x00,          // 00000 <102 \146 - SYM32:R>
+    0x00,          // 00000 <103 \147 - @>
+    0x00,          // 00000 <104 \150 - !>
+    0x00,          // 00000 <105 \151 - ?>
+    0x00,          // 00000 <106 \152 - ,>
+    0x00,          // 00000 <107 \153 - .>
+    0x00,          // 00000 <108 \154 - :>
+    0x00,          // 00000 <109 \155 - />
+    0x00,          // 00000 <110 \156 - +>
+    0x00,          // 00000 <111 \157 - ->
+    0x00,          // 00000 <112 \160 - 0>
+    0x00,          // 00000 <113 \161 - 1>
+    0x00,          // 00000 <114 \162 - 2>
+    0x00,          // 00000 <115 \163 - 3>
+    0x00,          // 00000 <116 \164 - 4>
+    0x00,          // 00000 <117 \165 - 5>
+    0x00,          // 00000 <118 \166 - 6>
+    0x00,          // 00000 <119 \167 - 7>
+    0x00,          // 00000 <120 \170 - 8>
+    0x00,          // 00000 <121 \171 - 9>
+    0x00,          // 00000 <122 \172 - exchange>
+    0x00,          // 00000 <123 \173 - hour glass>
+    0x00,          // 00000 <124 \174 - left arrow>
+    0x00,          // 00000 <125 \175 - right arrow>
+    0x00,          // 00000 <126 \176 - bell>
+    0x00,          // 00000 <127 \177 - dual time>
+    0x00,          // 00000 <128 \200 - calculator-1>
+    0x00,          // 00000 <129 \201 - calculator-2>
+    0x00,          // 00000 <130 \202 - calculator-3>
+    0x00,          // 00000 <131 \203 - divide>
+    0x00,          // 00000 <132 \204 - stop watch>
+
+    //
+    // Bottom 6 rows
+    //
+    //                  +-+-+-+-+-+
+    //      top         | | | | | | row 0
+    //                  +-+-+-+-+-+
+    //      29 - 25     | | | | | | row 1
+    //                  +-+-+-+-+-+
+    //      24 - 20     | | | | | | row 2
+    //                  +-+-+-+-+-+
+    //      19 - 15     | | | | | | row 3
+    //                  +-+-+-+-+-+
+    //      14 - 10     | | | | | | row 4
+    //                  +-+-+-+-+-+
+    //        9 - 5     | | | | | | row 5
+    //                  +-+-+-+-+-+
+    //        4 - 0     | | | | | | row 6
+    //                  +-+-+-+-+-+
+    //
+    //             // 29 25 24 20 19 15 14 10 9   5 4   0
+    //             // +---+ +---+ +---+ +---+ +---+ +---+
+    0x00000000,    // 00000 00000 00000 00000 00000 00000 <0 \00 - NUL>
+    0x00000000,    // 00000 00000 00000 00000 00000 00000 <1 \01 - SPACE>
+    0x00E8FE31,    // 00000 01110 10001 11111 10001 10001 <2 \02 - A>
+    0x08E8FE31,    // 00100 01110 10001 11111 10001 10001 <3 \03 - A1>
+    0x08E8FE31,    // 00100 01110 10001 11111 10001 10001 <4 \04 - A2>
+    0x08E8FE31,    // 00100 01110 10001 11111 10001 10001 <5 \05 - A3>
+    0x14E8FE31,    // 01010 01110 10001 11111 10001 10001 <6 \06 - A4>
+    0x00E8FE31,    // 00000 01110 10001 11111 10001 10001 <7 \07 - A5>
+    0x2CE8FE31,    // 10110 01110 10001 11111 10001 10001 <8 \10 - A6>
+    0x23F8C443,    // 10001 11111 10001 10001 00010 00011 <9 \11 - A7>
+    0x01E8FA3E,    // 00000 11110 10001 11110 10001 11110 <10 \12 - B>
+    0x00F8420F,    // 00000 01111 10000 10000 10000 01111 <11 \13 - C>
+    0x21083C4F,    // 10000 10000 10000 01111 00010 01111 <12 \14 - C1>
+    0x08F8420F,    // 00100 01111 10000 10000 10000 01111 <13 \15 - C2>
+    0x01E8C63E,    // 00000 11110 10001 10001 10001 11110 <14 \16 - D>
+    0x01F87A1F,    // 00000 11111 10000 11110 10000 11111 <15 \17 - E>
+    0x09F87A1F,    // 00100 11111 10000 11110 10000 11111 <16 \20 - E1>
+    0x09F87A1F,    // 00100 11111 10000 11110 10000 11111 <17 \21 - E2>
+    0x15F87A1F,    // 01010 11111 10000 11110 10000 11111 <18 \22 - E3>
+    0x01F87A1F,    // 00000 11111 10000 11110 10000 11111 <19 \23 - E4>
     0x21E87C43,    // 10000 11110 10000 11111 00010 00011 <20 \24 - E5>
     0x01F87A10,    // 00000 11111 10000 11110 10000 10000 <21 \25 - F>
     0x00F85E2F,    // 00000 01111 10000 10111 10001 01111 <22 \26 - G>
@@ -1349,1458 +3727,4615 @@ struct {
     0x00877541,    // 00000 01000 01110 11101 01010 00001 <132 \204 - stop watch>
 };
 
-void draw_char(char *frame, int x0, int y0, int mag, char ch)
-{
-    char top;
-    long bits;
-    int i, x, y, mx, my, pixel;
+HOT_CODE void draw_char(char *frame, int x0, int y0, int mag, int ch)
+{
+    char top;
+    long bits;
+    int i, x, y, mx, my, pixel;
+    CLIP r = { x0, y0, x0 + CHAR_WIDTH*mag, y0 + CHAR_HEIGHT*mag };
+    int clipped;
+
+    if( ch < 0 || ch >= (int)sizeof(CasioFont.top) )
+        ch = 0;
+
+    top = CasioFont.top[ch];
+    bits = CasioFont.bits[ch];
+
+    clipped = disp_clip_rect(&r);
+    if( clipped == 0 )
+        return;
+
+    if( clipped == 2 )
+    {
+        //
+        // glyph straddles the clip edge: clip each font pixel
+        //
+        for(y=0; y < CHAR_HEIGHT; y++) {
+            for(x=0; x < CHAR_WIDTH; x++) {
+                if( y == 0 )
+                    pixel = (top >> (CHAR_WIDTH-1-x)) & 1;
+                else
+                    pixel = (bits >> ((CHAR_HEIGHT-1-y)*CHAR_WIDTH + CHAR_WIDTH-1-x)) & 1;
+
+                if( pixel )
+                    draw_filled_block(frame, x0+x*mag, y0+y*mag, x0+x*mag+mag, y0+y*mag+mag);
+            }
+        }
+        return;
+    }
+
+    // top row
+    if( top != 0 )
+    {
+        x = 4;
+        y = 0;
+        for(i=0; i < 5; i++) {
+            pixel = top & 1;
+            top >>= 1;
+
+            for(mx=0; mx < mag; mx++) {
+                for(my=0; my < mag; my++) {
+                    if( pixel )
+                        disp_pset(frame, x0+x*mag+mx, y0+y*mag+my, pixel);
+                }
+            }
+            x--;
+        }
+    }
+
+    // bottom rows
+    x = 4;
+    y = 6;
+    for(i=0; i < 30; i++) {
+        pixel = bits & 1;
+        bits >>= 1;
+
+        for(mx=0; mx < mag; mx++) {
+            for(my=0; my < mag; my++) {
+                if( pixel )
+                    disp_pset(frame, x0+x*mag+mx, y0+y*mag+my, pixel);
+            }
+        }
+
+        x--;
+        if( x < 0 ) {
+            x = 4;
+            y--;
+            if( y < 0 ) y = 4;
+        }
+    }
+}
+
+void draw_blit(char *frame, int x0, int y0, int width, int height, long bits)
+{
+    int len;
+    int i, x, y, pixel;
+    CLIP r = { x0, y0, x0 + width, y0 + height };
+    int x1, y1, x2, y2, clipped;
+
+    clipped = disp_clip_rect(&r);
+    if( clipped == 0 )
+        return;
+
+    x1 = r.x1;
+    y1 = r.y1;
+    x2 = r.x2;
+    y2 = r.y2;
+
+    len = width * height;
+    x = width-1;
+    y = height-1;
+    for(i=0; i < len; i++) {
+        pixel = bits & 1;
+        bits >>= 1;
+
+        if( pixel && (clipped == 1
+                || (x0+x >= x1 && x0+x < x2 && y0+y >= y1 && y0+y < y2)) )
+            disp_pset(frame, x0+x, y0+y, pixel);
+
+        x--;
+        if( x < 0 ) {
+            x = width-1;
+            y--;
+            if( y < 0 )
+                y = height-1;
+        }
+    }
+}
+
+//
+// Day of the Week List
+//
+//      Sun Mon Tue Wed Thu Fri Sat
+//
+// ENG  SUN MON TUE WED THU FRI SAT
+// POR  DOM SEG TER QUA QUI SEX S\000B
+// ESP  DOM LUN MAR MI\000 JUE VIE S\000B
+// FRA  DIM LUN MAR MER JEU VEN SAM
+// NED  ZON MAA DIN WOE DON VRI ZAT
+// DAN  S\000N MAN TIR ONS TOR FRE L\000R
+// DEU  SON MON DIE MIT DON FRE SAM
+// ITA  DOM LUN MAR MER GIO VEN SAB
+// SVE  S\000N M\000N TIS ONS TOR FRE L\000R
+// POL  NIE PON WTO \000RO CZE PI\000 SOB
+// ROM  DUM LUN MAR MIE JOI VIN S\000M
+// TUR  PAZ PZT SAL \000AR PER CUM CTS
+// PYC  BC \000H B\000 CP \000\000 \000\000 C\000
+//
+// Languages:
+//  ENG
+//  POR
+//  ESP
+//  FRA
+//  NED
+//  DAN
+//  DEU
+//  ITA
+//  SVE
+//  POL
+//  ROM
+//  T\000R
+//  P\000C
+//
+
+unsigned char AsciiMap[256];
+
+void make_ascii()
+{
+    static char letters[] = {
+             2, 10, 11, 14, 15, 21,         // A B C D E F
+            22, 24, 25, 31, 32, 33,         // G H I J K L
+            35, 36, 39, 46, 47, 48,         // M N O P Q R
+            49, 52, 54, 59, 60, 61,         // S T U V W X
+            62, 63,                         // Y Z
+    };
+    int i;
+
+    // digits
+    for(i=0; i <= 9; i++)
+    {
+        AsciiMap[ '0' + i ] = 112 + i;
+    }
+
+    // letters
+    for(i=0; i < 26; i++)
+    {
+        AsciiMap[ 'A' + i ] = letters[i];
+        AsciiMap[ 'a' + i ] = letters[i];
+    }
+
+    AsciiMap[' '] = '\001';
+
+    // symbols
+    AsciiMap['@'] = 103;
+    AsciiMap['!'] = 104;
+    AsciiMap['?'] = 105;
+    AsciiMap[','] = 106;
+    AsciiMap['.'] = 107;
+    AsciiMap[':'] = 108;
+    AsciiMap['/'] = 109;
+    AsciiMap['+'] = 110;
+    AsciiMap['-'] = 111;
+
+    // special symbols
+    AsciiMap[1] = 123;  // hour glass
+    AsciiMap[2] = 124;  // left arrow
+    AsciiMap[3] = 125;  // right arrow
+
+    AsciiMap[4] = 126;  // bell
+    AsciiMap[5] = 127;  // dual time
+    AsciiMap[6] = 128;  // calculator1
+
+    AsciiMap[7] = 129;  // calculator2
+    AsciiMap[8] = 130;  // calculator3
+    AsciiMap[9] = 131;  // divide
+
+    AsciiMap[10] = 132; // stop watch
+
+    AsciiMap[11] = 3;   // A1 \13
+    AsciiMap[12] = 4;   // A2 \14
+    AsciiMap[13] = 5;   // A3 \15
+    AsciiMap[14] = 6;   // A4
+    AsciiMap[15] = 7;   // A5
+    AsciiMap[16] = 8;   // A6
+    AsciiMap[17] = 9;   // A7
+}
+
+void draw_ascii_string(char *frame, int x0, int y0, int mag, const char *str)
+{
+    const char *p;
+    int x, ch;
+
+    x = x0;
+    for(p=str; *p; p++)
+    {
+        ch = AsciiMap[(unsigned char)*p];
+        if( ch == 0 )
+        {
+            ch = ch + 128;
+        }
+
+        draw_char(frame, x, y0, mag, ch);
+        x = x + CHAR_WIDTH * mag + CHAR_SPACING;
+    }
+}
+
+void draw_string(char *frame, int x0, int y0, int mag, const char *str)
+{
+    const char *p;
+    int x;
+
+    x = x0;
+    for(p=str; *p; p++)
+    {
+        draw_char(frame, x, y0, mag, (unsigned char)*p);
+        x = x + CHAR_WIDTH * mag + CHAR_SPACING;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// text layout
+//
+// Proportional text placed in a box. Each glyph advances by the width
+// of the columns it actually uses (measured from CasioFont), so "I" is
+// narrower than "M". Blank glyphs and the icons (122 and up, some of
+// which are drawn as several glyphs side by side) keep the full
+// CHAR_WIDTH cell.
+//
+// Text that doesn't fit in the box is truncated and ends with "...".
+//
+// Measured string widths are kept in a small cache, so text drawn every
+// frame isn't re-measured every frame.
+//
+//////////////////////////////////////////////////////////////////////
+
+typedef enum {
+    ALIGN_LEFT,
+    ALIGN_CENTER,
+    ALIGN_RIGHT,
+} ALIGN;
+
+#define FONT_GLYPHS         133
+#define FONT_FIRST_ICON     122
+#define FONT_DOT            107
+
+struct {
+    char left[FONT_GLYPHS];     // first column used (0-4)
+    char width[FONT_GLYPHS];    // number of columns used (1-5)
+} FontMetrics;
+
+void make_font_metrics()
+{
+    int g, x, cols, bits;
+
+    for(g=0; g < FONT_GLYPHS; g++)
+    {
+        // OR all 7 rows together: bit 4 is column 0, bit 0 is column 4
+        cols = CasioFont.top[g] & 0x1f;
+        for(bits = CasioFont.bits[g]; bits; bits >>= 5)
+            cols |= bits & 0x1f;
+
+        if( cols == 0 || g >= FONT_FIRST_ICON )
+        {
+            FontMetrics.left[g] = 0;
+            FontMetrics.width[g] = CHAR_WIDTH;
+            continue;
+        }
+
+        for(x=0; !(cols & (0x10 >> x)); x++)
+            ;
+        FontMetrics.left[g] = x;
+
+        for(x=CHAR_WIDTH-1; !(cols & (0x10 >> x)); x--)
+            ;
+        FontMetrics.width[g] = x - FontMetrics.left[g] + 1;
+    }
+}
+
+//
+// Unicode to CasioFont glyph map for the letters used by the 13
+// languages. Sorted by code point, searched with a binary search.
+// Lower case Latin-1 and Cyrillic letters are folded to upper case
+// before the search, so they don't need entries of their own.
+//
+//  step 0: every code point in first..last maps to 'glyph'
+//  step 1: code points map to consecutive glyphs starting at 'glyph'
+//
+static const struct {
+    unsigned short first;
+    unsigned short last;
+    unsigned char glyph;
+    unsigned char step;
+} UnicodeMap[] = {
+    { 0x00C0, 0x00C0,   4, 0 },     // A grave
+    { 0x00C1, 0x00C1,   3, 0 },     // A acute
+    { 0x00C2, 0x00C2,   6, 0 },     // A circumflex
+    { 0x00C3, 0x00C3,   8, 0 },     // A tilde
+    { 0x00C4, 0x00C4,   7, 0 },     // A diaeresis
+    { 0x00C5, 0x00C5,  68, 0 },     // A ring
+    { 0x00C6, 0x00C6,  66, 0 },     // AE
+    { 0x00C7, 0x00C7,  12, 0 },     // C cedilla
+    { 0x00C8, 0x00C8,  17, 0 },     // E grave
+    { 0x00C9, 0x00C9,  16, 0 },     // E acute
+    { 0x00CA, 0x00CA,  18, 0 },     // E circumflex
+    { 0x00CB, 0x00CB,  19, 0 },     // E diaeresis
+    { 0x00CC, 0x00CC,  27, 0 },     // I grave
+    { 0x00CD, 0x00CD,  26, 0 },     // I acute
+    { 0x00CE, 0x00CE,  28, 0 },     // I circumflex
+    { 0x00CF, 0x00CF,  29, 0 },     // I diaeresis
+    { 0x00D1, 0x00D1,  38, 0 },     // N tilde
+    { 0x00D2, 0x00D2,  41, 0 },     // O grave
+    { 0x00D3, 0x00D3,  40, 0 },     // O acute
+    { 0x00D4, 0x00D4,  42, 0 },     // O circumflex
+    { 0x00D5, 0x00D5,  44, 0 },     // O tilde
+    { 0x00D6, 0x00D6,  43, 0 },     // O diaeresis
+    { 0x00D7, 0x00D7,  61, 0 },     // multiplication sign
+    { 0x00D8, 0x00D8,  67, 0 },     // O stroke
+    { 0x00D9, 0x00D9,  56, 0 },     // U grave
+    { 0x00DA, 0x00DA,  55, 0 },     // U acute
+    { 0x00DB, 0x00DB,  57, 0 },     // U circumflex
+    { 0x00DC, 0x00DC,  58, 0 },     // U diaeresis
+    { 0x00F7, 0x00F7, 131, 0 },     // division sign
+    { 0x0102, 0x0103,   5, 0 },     // A breve
+    { 0x0104, 0x0105,   9, 0 },     // A ogonek
+    { 0x0106, 0x0107,  13, 0 },     // C acute
+    { 0x0118, 0x0119,  20, 0 },     // E ogonek
+    { 0x011E, 0x011F,  23, 0 },     // G breve
+    { 0x0130, 0x0130,  30, 0 },     // I dot above
+    { 0x0131, 0x0131,  25, 0 },     // dotless i
+    { 0x0141, 0x0142,  34, 0 },     // L stroke
+    { 0x0143, 0x0144,  37, 0 },     // N acute
+    { 0x0152, 0x0153,  45, 0 },     // OE
+    { 0x015A, 0x015B,  50, 0 },     // S acute
+    { 0x015E, 0x015F,  51, 0 },     // S cedilla
+    { 0x0162, 0x0163,  53, 0 },     // T cedilla
+    { 0x0179, 0x017A,  64, 0 },     // Z acute
+    { 0x017B, 0x017C,  65, 0 },     // Z dot above
+    { 0x0218, 0x0219,  51, 0 },     // S comma below
+    { 0x021A, 0x021B,  53, 0 },     // T comma below
+    { 0x0401, 0x0401,  76, 0 },     // IO
+    { 0x0410, 0x0410,   2, 0 },     // A
+    { 0x0411, 0x0415,  71, 1 },     // BE .. IE
+    { 0x0416, 0x042F,  77, 1 },     // ZHE .. YA
+    { 0x2190, 0x2190, 124, 0 },     // left arrow
+    { 0x2192, 0x2192, 125, 0 },     // right arrow
+    { 0x231B, 0x231B, 123, 0 },     // hour glass
+    { 0x23F1, 0x23F1, 132, 0 },     // stop watch
+};
+
+#define FONT_UNKNOWN    105         // '?'
+
+int text_unicode_glyph(long cp)
+{
+    int lo, hi, mid;
+
+    // fold lower case
+    if( cp >= 0x00E0 && cp <= 0x00FE && cp != 0x00F7 )
+        cp -= 0x20;
+    else if( cp >= 0x0430 && cp <= 0x044F )
+        cp -= 0x20;
+    else if( cp >= 0x0450 && cp <= 0x045F )
+        cp -= 0x50;
+
+    lo = 0;
+    hi = sizeof(UnicodeMap)/sizeof(UnicodeMap[0]) - 1;
+    while( lo <= hi )
+    {
+        mid = (lo + hi) / 2;
+        if( cp < UnicodeMap[mid].first )
+            hi = mid - 1;
+        else if( cp > UnicodeMap[mid].last )
+            lo = mid + 1;
+        else
+            return UnicodeMap[mid].glyph + UnicodeMap[mid].step * (cp - UnicodeMap[mid].first);
+    }
+
+    return FONT_UNKNOWN;
+}
+
+//
+// return the next glyph from the UTF-8 string and advance *pp, or -1
+// at the end of the string. Bytes below 0x80 (including the control
+// codes used for the icons) go straight through AsciiMap.
+//
+int text_next_glyph(const char **pp)
+{
+    const unsigned char *p;
+    long cp;
+    int ch, n;
+
+    p = (const unsigned char *)*pp;
+    ch = *p;
+    if( ch == 0 )
+        return -1;
+
+    if( ch < 0x80 )
+    {
+        (*pp)++;
+
+        ch = AsciiMap[ch];
+        if( ch == 0 )
+            ch = 128;
+
+        return ch;
+    }
+
+    //
+    // multi-byte sequence. Anything malformed, or outside the basic
+    // multilingual plane, is consumed and shown as '?'.
+    //
+    if( (ch & 0xe0) == 0xc0 ) {
+        cp = ch & 0x1f;
+        n = 1;
+    } else if( (ch & 0xf0) == 0xe0 ) {
+        cp = ch & 0x0f;
+        n = 2;
+    } else {
+        cp = -1;
+        n = 0;
+    }
+
+    p++;
+    while( n > 0 && (*p & 0xc0) == 0x80 )
+    {
+        cp = (cp << 6) | (*p++ & 0x3f);
+        n--;
+    }
+
+    // skip any stray continuation bytes
+    while( (*p & 0xc0) == 0x80 )
+        p++;
+
+    *pp = (const char *)p;
+
+    if( n != 0 || cp < 0 )
+        return FONT_UNKNOWN;
+
+    return text_unicode_glyph(cp);
+}
+
+int text_glyph_advance(int g, int mag)
+{
+    return FontMetrics.width[g] * mag + CHAR_SPACING;
+}
+
+int text_measure(const char *str, int mag)
+{
+    int g, width;
+
+    width = 0;
+    while( (g = text_next_glyph(&str)) >= 0 )
+        width += text_glyph_advance(g, mag);
+
+    // no spacing after the last glyph
+    return width ? width - CHAR_SPACING : 0;
+}
+
+//
+// draw one glyph so its first used column lands on x. Returns the x of
+// the next glyph.
+//
+int text_draw_glyph(char *frame, int x, int y, int mag, int g)
+{
+    draw_char(frame, x - FontMetrics.left[g]*mag, y, mag, g);
+    return x + text_glyph_advance(g, mag);
+}
+
+//
+// draw 'str' inside the box that starts at x0 and is 'width' pixels wide.
+// Returns the x just past the last pixel drawn.
+//
+int draw_text_box(char *frame, int x0, int y0, int width, int mag, int align, const char *str)
+{
+    int x, g, w, dots, limit;
+    const char *p;
+
+    w = text_measure(str, mag);
+
+    if( w <= width )
+    {
+        if( align == ALIGN_CENTER )
+            x = x0 + (width - w)/2;
+        else if( align == ALIGN_RIGHT )
+            x = x0 + width - w;
+        else
+            x = x0;
+
+        p = str;
+        while( (g = text_next_glyph(&p)) >= 0 )
+            x = text_draw_glyph(frame, x, y0, mag, g);
+
+        return x - CHAR_SPACING;
+    }
+
+    disp_clip_push(x0, y0, x0 + width, y0 + CHAR_HEIGHT*mag);
+
+    //
+    // truncate: as many glyphs as fit in front of the ellipsis
+    //
+    dots = 3 * text_glyph_advance(FONT_DOT, mag) - CHAR_SPACING;
+    limit = x0 + width - dots;
+
+    x = x0;
+    p = str;
+    while( (g = text_next_glyph(&p)) >= 0 )
+    {
+        if( x + FontMetrics.width[g]*mag > limit - CHAR_SPACING )
+            break;
+        x = text_draw_glyph(frame, x, y0, mag, g);
+    }
+
+    if( x + dots <= x0 + width )
+    {
+        x = text_draw_glyph(frame, x, y0, mag, FONT_DOT);
+        x = text_draw_glyph(frame, x, y0, mag, FONT_DOT);
+        x = text_draw_glyph(frame, x, y0, mag, FONT_DOT);
+    }
+
+    disp_clip_pop();
+
+    return x - CHAR_SPACING;
+}
+
+//
+// positions of the text fields on the watch face
+//
+#define BOX_TEXT_X          25      // big text, left of the x=60 line
+#define BOX_TEXT_Y          0
+#define BOX_TEXT_W          35
+
+#define BOX_INDICATOR_Y     3       // small text in the top right strip
+#define BOX_SNZ_X           63
+#define BOX_SNZ_W           17
+#define BOX_MUTE_X          85
+#define BOX_MUTE_W          23
+#define BOX_SIG_X           101
+#define BOX_SIG_W           27
+
+void draw_am1(char *frame)
+{
+//  draw_rect(frame, 1, 17, 5, 5);
+    draw_ascii_string(frame, 1, 17, 1, "A");
+}
+
+void draw_pm1(char *frame)
+{
+//  draw_rect(frame, 7, 17, 5, 5);
+    draw_ascii_string(frame, 7, 17, 1, "P");
+}
+
+void draw_am2(char *frame)
+{
+//  draw_rect(frame, 1, 50, 4, 4);
+    draw_blit(frame, 1, 50, 4, 4, 0x000069F9);  // 0110 1001 1111 1001
+}
+
+void draw_pm2(char *frame)
+{
+//  draw_rect(frame, 5, 50, 4, 4);
+    draw_blit(frame, 5, 50, 4, 4, 0x0000E9E8);  // 1110 1001 1110 1000
+}
+
+void draw_split(char *frame)
+{
+//  draw_rect(frame, 1, 1, 15, 5);
+    draw_ascii_string(frame, 1, 0, 1, "SPL");
+}
+
+void draw_dst(char *frame)
+{
+//  draw_rect(frame, 1, 8, 15, 5);
+    draw_ascii_string(frame, 1, 7, 1, "DST");
+}
+
+void draw_lt(char *frame)
+{
+//  draw_rect(frame, 62+10, 0, 12, 3);
+//  draw_blit(frame, 62+10, 0, 6, 3, 0x000278B2); // 100111 100010 110010
+
+//  draw_blit(frame, 62+10, 1, 6, 3, 0x000278B2); // 100111 100010 110010
+    draw_blit(frame, 62+10, 0, 6, 4, 0x009E28B2); // 100111 100010 100010 110010
+}
+
+void draw_3sec(char *frame)
+{
+//  draw_rect(frame, 62+30, 0, 20, 3);
+    draw_blit(frame, 62+30, 0, 10, 3, 0x36D52B6D); // 1101101101 0101001010 1101101101
+
+    draw_blit(frame, 62+30, 0, 10, 1, 0x36D52B6D); // 1101101101 0101001010 1101101101
+    draw_blit(frame, 62+30, 1, 10, 3, 0x36D52B6D); // 1101101101 0101001010 1101101101
+}
+
+void draw_snooze(char *frame)
+{
+//  draw_rect(frame, 64, 5, 12, 4);
+    draw_text_box(frame, BOX_SNZ_X, BOX_INDICATOR_Y, BOX_SNZ_W, 1, ALIGN_LEFT, "SNZ");
+}
+
+void draw_mute(char *frame)
+{
+//  draw_rect(frame, 64+12+10, 5, 20, 4);
+    draw_text_box(frame, BOX_MUTE_X, BOX_INDICATOR_Y, BOX_MUTE_W, 1, ALIGN_LEFT, "MUTE");
+}
+
+void draw_sig(char *frame)
+{
+//  draw_rect(frame, 64+12+20+6+10, 5, 12, 4);
+    draw_text_box(frame, BOX_SIG_X, BOX_INDICATOR_Y, BOX_SIG_W, 1, ALIGN_LEFT, "SIG");
+}
+
+void draw_alarm(char *frame, int n)
+{
+//  draw_rect(frame, 62+(n-1)*13, 11, 12, 3);
+    draw_blit(frame, 62+(n-1)*13, 11, 7, 3, 0x00096AD5);
+}
+
+void draw_text(char *frame, const char *str)
+{
+    draw_text_box(frame, BOX_TEXT_X, BOX_TEXT_Y, BOX_TEXT_W, 2, ALIGN_LEFT, str);
+}
+
+void draw_main(char *frame, const char *str)
+{
+    draw_segstr(frame, 10, 20, 6, 10, 2, str);
+}
+
+void draw_secondary(char *frame, const char *str)
+{
+    draw_segstr(frame, 15, 52, 4, 4, 1, str);
+}
+
+void draw_hline(char *frame, int x0, int y0, int len)
+{
+    draw_filled_block(frame, x0, y0, x0+len, y0+1);
+}
+
+void draw_vline(char *frame, int x0, int y0, int len)
+{
+    draw_filled_block(frame, x0, y0, x0+1, y0+len);
+}
+
+//////////////////////////////////////////////////////////////////////
+// end DRAW
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//
+// begin CASIO
+//
+//////////////////////////////////////////////////////////////////////
+
+typedef enum {
+    M_HOME,
+    M_HOME_SET,
+    M_DB,
+    M_DB_SET,
+    M_CAL,
+    M_EX,
+    M_ST,
+    M_AL,
+    M_AL_SET,
+    M_DT,
+    M_DT_SET,
+} MODE;
+
+typedef enum {
+    L_ENG,      // 0 - english
+    L_POR,      // 1 - portuguese
+    L_ESP,      // 2 - spanish
+    L_FRA,      // 3 - french
+    L_NED,      // 4 - dutch
+    L_DAN,      // 5 - danish
+    L_DEU,      // 6 - german
+    L_ITA,      // 7 - italian
+    L_SVE,      // 8 - swedish
+    L_POL,      // 9 - polish
+    L_ROM,      // 10 - romanian
+    L_TUR,      // 11 - turkish
+    L_RUS,      // 12 - russian
+} LANG;
+
+//
+// day of week table (UTF-8, drawn through text_next_glyph)
+//
+static const char *DowNames[13][7] = {
+    { "SUN", "MON", "TUE", "WED", "THU", "FRI", "SAT" },        // ENG
+    { "DOM", "SEG", "TER", "QUA", "QUI", "SEX", "SÁB" },        // POR
+    { "DOM", "LUN", "MAR", "MIÉ", "JUE", "VIE", "SÁB" },        // ESP
+    { "DIM", "LUN", "MAR", "MER", "JEU", "VEN", "SAM" },        // FRA
+    { "ZON", "MAA", "DIN", "WOE", "DON", "VRI", "ZAT" },        // NED
+    { "SØN", "MAN", "TIR", "ONS", "TOR", "FRE", "LØR" },        // DAN
+    { "SON", "MON", "DIE", "MIT", "DON", "FRE", "SAM" },        // DEU
+    { "DOM", "LUN", "MAR", "MER", "GIO", "VEN", "SAB" },        // ITA
+    { "SÖN", "MÅN", "TIS", "ONS", "TOR", "FRE", "LÖR" },        // SVE
+    { "NIE", "PON", "WTO", "ŚRO", "CZE", "PIĄ", "SOB" },        // POL
+    { "DUM", "LUN", "MAR", "MIE", "JOI", "VIN", "SÂM" },        // ROM
+    { "PAZ", "PZT", "SAL", "ÇAR", "PER", "CUM", "CTS" },        // TUR
+    { "ВС", "ПН", "ВТ", "СР", "ЧТ", "ПТ", "СБ" },               // PYC
+};
+
+//
+// language table
+//
+// ENG
+// POR
+// ESP
+// FRA
+// NED
+// DAN
+// DEU
+// ITA
+// SVE
+// POL
+// ROM
+// TÜR
+// РУС
+//
+
+typedef struct {
+    char hours;     // 0-23
+    char minutes;   // 0-59
+    char seconds;   // 0-59
+} TIME;
+
+typedef struct {
+    char day;
+    char month;
+    short year;
+    char dow;       // 0=sun 1=mon 2=tue 3=wed 4=thu 5=fri 6=sat
+} DATE;
+
+typedef struct {
+    DATE date;
+    TIME time;
+} DATE_TIME;
+
+typedef struct {
+    char hours;     // 0-23
+    char minutes;   // 0-59
+    char seconds;   // 0-59
+    char ks;        // 0-99
+} TIMER;
+
+typedef struct {
+    long diff;      // the 1/100ths 't' is for
+    TIMER t;
+} TIMER_CACHE;
+
+typedef struct {
+    char    mode;
+
+    // time, copied from DEVICE before every event (or set by a script)
+    long    clock;          // 1/100th of seconds counter
+    unsigned long epoch;    // seconds since jan 1, 1970
+    char    headless;       // no sound, contrast or DEVICE changes
+
+    // home screen
+    struct home {
+        struct {
+            int light : 1;
+            int hrs24 : 1;
+            int show_db : 1;
+            int show_dt : 1;
+            int light_held : 1;
+        } flags;
+        DATE_TIME   dt;
+        DATE_TIME   now;
+        char        lang;
+        char        contrast;
+    } home;
+
+    // DB
+    struct {
+        char flags;
+        char init;
+        char text[10];
+        char pos;
+        char digits[15];
+        char page;
+    } db;
+
+    // Calculator
+    struct {
+        char flags;
+        char current[15];
+        char op;
+        double acc;
+    } cal;
+
+    // Alarms
+    struct {
+        char        flags;
+        DATE_TIME   alarms[5];
+        char        pos;
+    } al;
+
+    // Dual time mode
+    struct {
+        struct {
+            int show_db : 1;
+            int show_home : 1;
+        } flags;
+        char        tz[3];
+        DATE_TIME   dt;
+    } dt;
+
+    // Stop watch
+    struct {
+        struct {
+            int running : 1;
+            int split : 1;
+            int live : 1;       // # - live hundredths, see casio_update_live()
+        } flags;
+        long    timer_start;
+        long    timer_stop;
+        long    timer_split;
+        TIMER_CACHE run;        // the time shown, see timer_cached()
+        TIMER_CACHE split;
+    } st;
+
+    // display power, see casio_power_apply()
+    struct {
+        char policy;            // POWER_DIM | POWER_INVERT
+        char inverted;          // drawing white on black
+        unsigned char contrast; // what the display is set to
+        long last_key;          // clock of the last key or button
+    } power;
+
+    DRAW draw;                  // clip stack etc. when headless, see casio_render()
+} CASIO;
+
+TIMER timer_set_from_100ths(long diff)
+{
+    TIMER result;
+
+    const int SECONDS_PER = (100);
+    const int MINUTES_PER = (100*60);
+    const int HOURS_PER = (100*60*60);
+
+    // like the real watch, the stop watch rolls over after 23:59 59"99
+    diff %= 24L * HOURS_PER;
+
+    result.hours = diff / HOURS_PER;
+    diff -= result.hours * HOURS_PER;
+
+    result.minutes = diff / MINUTES_PER;
+    diff -= result.minutes * MINUTES_PER;
+
+    result.seconds = diff / SECONDS_PER;
+    diff -= result.seconds * SECONDS_PER;
+
+    result.ks = diff;
+    return result;
+}
+
+//
+// timer_set_from_100ths(diff) for a value that usually moves forward a
+// little at a time. The running stop watch is a few 1/100ths further on
+// every frame, so the fields are carried forward from the last result
+// with no divides at all; stopped and split times are the same every
+// frame and come straight from the cache. Anything else (a jump of 10
+// seconds or more, going backwards) takes the full conversion.
+//
+TIMER timer_cached(TIMER_CACHE *tc, long diff)
+{
+    long n = diff - tc->diff;
+    int ks, s, m, h;
+
+    if( n == 0 )
+        return tc->t;
+
+    if( n < 0 || n >= 1000 || tc->diff < 0 )
+    {
+        tc->t = timer_set_from_100ths(diff);
+        tc->diff = diff;
+        return tc->t;
+    }
+
+    ks = tc->t.ks + n;
+    s = tc->t.seconds;
+    m = tc->t.minutes;
+    h = tc->t.hours;
+
+    while( ks >= 100 )
+    {
+        ks -= 100;
+        s++;
+    }
+    if( s >= 60 )
+    {
+        s -= 60;
+        if( ++m >= 60 )
+        {
+            m = 0;
+            if( ++h >= 24 )
+                h = 0;
+        }
+    }
+
+    tc->t.ks = ks;
+    tc->t.seconds = s;
+    tc->t.minutes = m;
+    tc->t.hours = h;
+    tc->diff = diff;
+
+    return tc->t;
+}
+
+//
+// seconds since 1970 (unsigned, so good until 2106) to a date and time.
+// The date uses Howard Hinnant's civil_from_days: years are counted from
+// March 1st, so the leap day is the last day of the year and the month
+// comes from a linear formula instead of a table walk.
+//
+HOT_CODE DATE_TIME epoch_to_date_time(unsigned long epoch)
+{
+    unsigned long days, era, doe, yoe, doy, mp;
+    DATE_TIME result;
+
+    result.time.seconds = epoch % 60;
+    epoch /= 60;
+    result.time.minutes = epoch % 60;
+    epoch /= 60;
+    result.time.hours = epoch % 24;
+    days = epoch / 24;
+
+    result.date.dow = (days + 4) % 7;       // jan 1, 1970 was a thursday
+
+    days += 719468;                         // days since March 1st, year 0
+    era = days / 146097;                    // 400 year cycles
+    doe = days - era * 146097;              // [0, 146096]
+    yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;     // [0, 399]
+    doy = doe - (365*yoe + yoe/4 - yoe/100);                    // [0, 365]
+    mp = (5*doy + 2) / 153;                 // [0, 11], March = 0
+
+    result.date.day = doy - (153*mp + 2)/5 + 1;
+    result.date.month = (mp < 10) ? mp + 3 : mp - 9;
+    result.date.year = era * 400 + yoe + (result.date.month <= 2);
+
+    return result;
+}
+
+unsigned long date_time_to_epoch(DATE_TIME *goal)
+{
+#define IsLeapYear(y) ( ((y%4==0) && (y%100!=0)) || (y%400==0) )
+
+    static const unsigned char month_days[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
+    const unsigned long SEC_PER_DAY = 24*60*60;
+    int i;
+    unsigned long epoch;
+
+    epoch = (goal->date.year - 1970) * 365 * SEC_PER_DAY;
+
+    for(i=1970; i < goal->date.year; i++)
+    {
+        if( IsLeapYear(i) )
+        {
+            epoch += SEC_PER_DAY;
+        }
+    }
+
+    for(i=1; i < goal->date.month; i++)
+    {
+        if( i == 2 && IsLeapYear(goal->date.year) )
+            epoch += 29 * SEC_PER_DAY;
+        else
+            epoch += month_days[i-1] * SEC_PER_DAY;
+    }
+
+    epoch += (goal->date.day-1) * SEC_PER_DAY;
+    epoch += goal->time.hours * 3600UL;
+    epoch += goal->time.minutes * 60;
+    epoch += goal->time.seconds;
+
+    return epoch;
+}
+
+int casio_disp_hours(int hrs24, int hours)
+{
+    if( ! hrs24 ) {
+        if( hours > 12 )
+            hours -= 12;
+        if( hours == 0 )
+            hours = 12;
+    }
+    return hours;
+}
+
+void casio_update_db_screen(char *frame, CASIO *c);
+void casio_update_dt_screen(char *frame, CASIO *c);
+
+void casio_update_home_screen(char *frame, CASIO *c)
+{
+    DATE_TIME *d;
+    const char *w;
+    char buf[20];
+    char *p;
+    int hours;
+
+    if( c->home.flags.show_db )
+    {
+        casio_update_db_screen(frame, c);
+        return;
+    }
+    else if( c->home.flags.show_dt && c->mode == M_HOME )
+    {
+        // (not from the DT screen's show_home, that would never return)
+        casio_update_dt_screen(frame, c);
+        return;
+    }
+
+    d = &c->home.now;
+
+    hours = casio_disp_hours(c->home.flags.hrs24, d->time.hours);
+
+    if( ! c->home.flags.hrs24 )
+    {
+        if( d->time.hours < 12 )
+            draw_am1(frame);
+        else
+            draw_pm1(frame);
+    }
+
+    p = fmt_time(buf, hours, ':', d->time.minutes);
+    *p++ = ' ';
+    fmt_02d(p, d->time.seconds);
+    draw_main(frame, buf);
+
+    p = fmt_2d(buf, d->date.year / 100);
+    *p++ = ' ';
+    p = fmt_02d(p, d->date.year % 100);
+    *p++ = ' ';
+    p = fmt_2d(p, d->date.month);
+    *p++ = '-';
+    fmt_2d(p, d->date.day);
+
+    draw_secondary(frame, buf);
+
+    w = DowNames[ (unsigned)c->home.lang % 13 ][ (unsigned)d->date.dow % 7 ];
+    draw_text(frame, w);
+}
+
+void casio_update_db_screen(char *frame, CASIO *c)
+{
+    char buf[12];
+    char *p;
+    int ch;
+    char cstart;
+    int i;
+
+    if( c->db.init > 0 )
+    {
+        draw_text(frame, "\001DB");
+        draw_main(frame, " F: 15");
+    }
+    else
+    {
+        if( c->db.page != 0 ) {
+            //
+            p = buf;
+            ch = (c->db.page-1) * 28 + 1;
+            for(i=0; i < 8; i++) {
+                *p++ = ch++;
+            }
+            *p = '\0';
+            draw_string(frame, 25, 0, 2, buf);
+
+            p = buf;
+            for(i=0; i < 10; i++) {
+                *p++ = ch++;
+            }
+            *p = '\0';
+            draw_string(frame, 5, 23, 2, buf);
+
+            p = buf;
+            for(i=0; i < 10; i++) {
+                *p++ = ch++;
+            }
+            *p = '\0';
+            draw_string(frame, 5, 45, 2, buf);
+
+        } else {
+            draw_text(frame, c->db.text);
+            draw_main(frame, "--------");
+            draw_secondary(frame, " - -- -- --");
+        }
+    }
+}
+
+void casio_update_cal_screen(char *frame, CASIO *c)
+{
+    char buf[20];
+    int delim;
+    int hours;
+
+    if( c->cal.current[0] != '\0' )
+    {
+        fmt_str(buf, c->cal.current, 8);
+    }
+    else
+    {
+        // 8.12345678
+        // 0123456789
+        fmt_calc(buf, c->cal.acc);
+    }
+    draw_main(frame, buf);
+
+    if( c->cal.op == 1 ) {
+        draw_text(frame, "  +");
+    } else if( c->cal.op == 2 ) {
+        draw_text(frame, "  -");
+    } else if( c->cal.op == 3 ) {
+        draw_text(frame, "  *");
+    } else if( c->cal.op == 4 ) {
+        draw_text(frame, "  /");
+    } else {
+        draw_text(frame, "\006\007\010");
+    }
+
+    if( c->home.now.time.seconds % 2 == 0 )
+        delim = ':';
+    else
+        delim = ' ';
+
+    hours = casio_disp_hours(c->home.flags.hrs24, c->home.now.time.hours);
+
+    if( ! c->home.flags.hrs24 )
+    {
+        if( c->home.now.time.hours < 12 )
+            draw_am2(frame);
+        else
+            draw_pm2(frame);
+    }
+
+    fmt_time(buf, hours, delim, c->home.now.time.minutes);
+
+    draw_secondary(frame, buf);
+}
+
+void casio_update_al_screen(char *frame, CASIO *c)
+{
+    char buf[20];
+    char *p;
+    int delim;
+    int hours;
+
+    draw_text(frame, "\004AL");
+    draw_main(frame, "12:00 - 1");
+
+    if( c->home.now.time.seconds % 2 == 0 )
+        delim = ':';
+    else
+        delim = ' ';
+
+    hours = casio_disp_hours(c->home.flags.hrs24, c->home.now.time.hours);
+
+    if( ! c->home.flags.hrs24 )
+    {
+        if( c->home.now.time.hours < 12 )
+            draw_am2(frame);
+        else
+            draw_pm2(frame);
+    }
+
+    p = fmt_time(buf, hours, delim, c->home.now.time.minutes);
+    strcpy(p, " --- -");
+
+    draw_secondary(frame, buf);
+
+    switch(c->al.pos)
+    {
+    case E_HEX_BUTTON_0:
+            draw_pm1(frame);
+            draw_pm2(frame);
+            break;
+
+    case E_HEX_BUTTON_1:
+            draw_am1(frame);
+            draw_am2(frame);
+            break;
+            
+    case E_HEX_BUTTON_2:
+            draw_split(frame);
+            draw_dst(frame);
+            break;
+
+    case E_HEX_BUTTON_3:    draw_snooze(frame); break;
+    case E_HEX_BUTTON_4:    draw_mute(frame); break;
+    case E_HEX_BUTTON_5:    draw_alarm(frame,1); break;
+    case E_HEX_BUTTON_6:    draw_alarm(frame,2); break;
+    case E_HEX_BUTTON_7:    draw_alarm(frame,3); break;
+    case E_HEX_BUTTON_8:    draw_alarm(frame,4); break;
+    case E_HEX_BUTTON_9:    draw_alarm(frame,5); break;
+    case E_HEX_BUTTON_A:
+            draw_sig(frame);
+            draw_lt(frame);
+            draw_3sec(frame);
+            break;
+
+    case E_HEX_BUTTON_STAR:
+            draw_pm1(frame);
+            draw_pm2(frame);
+            draw_am1(frame);
+            draw_am2(frame);
+            draw_alarm(frame,1);
+            draw_alarm(frame,2);
+            draw_alarm(frame,3);
+            draw_alarm(frame,4);
+            draw_alarm(frame,5);
+            draw_split(frame);
+            draw_dst(frame);
+            draw_sig(frame);
+            draw_lt(frame);
+            draw_3sec(frame);
+            draw_snooze(frame);
+            draw_mute(frame);
+            break;
+    }
+}
+
+void casio_update_st_screen(char *frame, CASIO *c)
+{
+    char buf[20];
+    char *p;
+    long diff;
+    TIMER t;
+    char delim;
+    int hours, ks = 0;
+
+    if( c->st.flags.running )
+    {
+        diff = c->clock - c->st.timer_start;
+        t = timer_cached(&c->st.run, diff);
+        ks = t.ks;
+    }
+    else
+    {
+        diff = c->st.timer_stop - c->st.timer_start;
+        t = timer_cached(&c->st.run, diff);
+    }
+
+    if( c->st.flags.split )
+    {
+        diff = c->st.timer_split - c->st.timer_start;
+        t = timer_cached(&c->st.split, diff);
+
+        draw_split(frame);
+    }
+
+    if( c->st.flags.running )
+        delim = (ks < 50) ? ':' : ' ';
+    else
+        delim = ':';
+
+    p = fmt_time(buf, t.hours, delim, t.minutes);
+    *p++ = ' ';
+    fmt_02d(p, t.seconds);
+    draw_main(frame, buf);
+
+    if( c->home.now.time.seconds % 2 == 0 )
+        delim = ':';
+    else
+        delim = ' ';
+
+    hours = casio_disp_hours(c->home.flags.hrs24, c->home.now.time.hours);
+
+    if( ! c->home.flags.hrs24 )
+    {
+        if( c->home.now.time.hours < 12 )
+            draw_am2(frame);
+        else
+            draw_pm2(frame);
+    }
+
+    p = fmt_time(buf, hours, delim, c->home.now.time.minutes);
+    strcpy(p, "    ");
+    fmt_02d(p + 4, t.ks);
+    draw_secondary(frame, buf);
+
+    draw_text(frame, "\012ST");
+}
+
+void casio_update_dt_screen(char *frame, CASIO *c)
+{
+    DATE_TIME d;
+    char buf[20];
+    char *p;
+    int delim;
+    int hours;
+
+    if( c->dt.flags.show_home && c->mode == M_DT )
+    {
+        casio_update_home_screen(frame, c);
+        return;
+    }
+    else if( c->dt.flags.show_db )
+    {
+        casio_update_db_screen(frame, c);
+        return;
+    }
+
+    d = epoch_to_date_time( c->epoch + 3*60*60 + 30*60 );
+
+    hours = casio_disp_hours(c->home.flags.hrs24, d.time.hours);
+
+    if( ! c->home.flags.hrs24 )
+    {
+        if( d.time.hours < 12 )
+            draw_am1(frame);
+        else
+            draw_pm1(frame);
+    }
+
+    p = fmt_time(buf, hours, ':', d.time.minutes);
+    *p++ = ' ';
+    fmt_02d(p, d.time.seconds);
+    draw_main(frame, buf);
+
+    if( c->home.now.time.seconds % 2 == 0 )
+        delim = ':';
+    else
+        delim = ' ';
+
+    hours = casio_disp_hours(c->home.flags.hrs24, c->home.now.time.hours);
+
+    if( ! c->home.flags.hrs24 )
+    {
+        if( c->home.now.time.hours < 12 )
+            draw_am2(frame);
+        else
+            draw_pm2(frame);
+    }
+
+    fmt_time(buf, hours, delim, c->home.now.time.minutes);
+    draw_secondary(frame, buf);
+
+    draw_text(frame, "\005DT");
+}
+
+//////////////////////////////////////////////////////////////////////
+// mode transitions
+//
+// When button B changes the mode, the old screen (DISP.frame) is
+// animated into the new one instead of a hard cut.
+//
+//  T_SCROLL    - new screen scrolls up from the bottom. Uses the display
+//                start line register, so only one page (128 bytes) is
+//                sent per step and the whole animation costs one frame.
+//                The display RAM holds exactly 64 rows, so this only works
+//                in page (8 pixel) steps.
+//  T_WIPE      - new screen is revealed top to bottom, one page at a time,
+//                using page range partial updates.
+//  T_SLIDE     - new screen pushes the old one out to the left. Every step
+//                is composed in software and sent as a full frame, so the
+//                frame rate is limited by the I2C bus.
+//
+// Build with -DTRANSITION_DEBUG=1 to print a summary line (frames,
+// bytes, elapsed time) to the serial port after every transition. This
+// doubles as a transfer benchmark.
+//
+typedef enum {
+    T_NONE,
+    T_SCROLL,
+    T_WIPE,
+    T_SLIDE,
+} TRANSITION;
+
+#define TRANSITION_STYLE    T_SCROLL
+#define TRANSITION_MS       150         // length of the animation
+
+#ifndef TRANSITION_DEBUG
+#   define TRANSITION_DEBUG 0
+#endif
+
+int casio_transition(const char *old_frame, const char *new_frame, int style)
+{
+    const int WIDTH = 128;
+    const int PAGES = FRAME_SIZE/128;
+    char frame[FRAME_SIZE];
+    unsigned long start, elapsed;
+    int pages, sent, off, x, page, frames, bytes, rc;
+    const char *src;
+
+    rc = 0;
+    frames = 0;
+    bytes = 0;
+    sent = 0;
+    start = micros();
+
+    for(;;)
+    {
+        elapsed = micros() - start;
+        if( elapsed >= TRANSITION_MS*1000UL || rc )
+            break;
+
+        switch(style)
+        {
+        case T_SCROLL:
+            //
+            // page 'sent' is the top page on the screen. It is
+            // overwritten with the new frame's page while still
+            // showing (for the length of one page transfer the top 8
+            // rows are new), then the start line moves past it and it
+            // re-appears at the bottom.
+            //
+            pages = (elapsed * PAGES) / (TRANSITION_MS*1000UL);
+            while( sent < pages && rc == 0 )
+            {
+                rc = disp_update_window(new_frame, 0, WIDTH-1, sent, sent);
+                sent++;
+                if( rc == 0 )
+                    rc = disp_set_start_line(sent*8);
+                bytes += WIDTH;
+                frames++;
+            }
+            break;
+
+        case T_WIPE:
+            pages = (elapsed * PAGES) / (TRANSITION_MS*1000UL);
+            if( pages > sent )
+            {
+                rc = disp_update_window(new_frame, 0, WIDTH-1, sent, pages-1);
+                bytes += (pages - sent) * WIDTH;
+                sent = pages;
+                frames++;
+            }
+            break;
+
+        case T_SLIDE:
+            off = (elapsed * WIDTH) / (TRANSITION_MS*1000UL);
+            for(page=0; page < PAGES; page++)
+            {
+                for(x=0; x < WIDTH; x++)
+                {
+                    if( x < WIDTH - off )
+                        src = old_frame + page*WIDTH + x + off;
+                    else
+                        src = new_frame + page*WIDTH + x - (WIDTH - off);
+                    frame[page*WIDTH + x] = *src;
+                }
+            }
+            rc = disp_update(frame);
+            bytes += FRAME_SIZE;
+            frames++;
+            break;
+
+        default:
+            elapsed = TRANSITION_MS*1000UL;
+            break;
+        }
+    }
+
+    //
+    // finish: whatever pages are left, then a clean start line
+    //
+    if( rc == 0 )
+    {
+        switch(style)
+        {
+        case T_SCROLL:
+            if( sent < PAGES )
+            {
+                rc = disp_update_window(new_frame, 0, WIDTH-1, sent, PAGES-1);
+                bytes += (PAGES - sent) * WIDTH;
+                frames++;
+            }
+            if( rc == 0 )
+                rc = disp_set_start_line(0);
+            break;
+
+        case T_WIPE:
+            if( sent < PAGES )
+            {
+                rc = disp_update_window(new_frame, 0, WIDTH-1, sent, PAGES-1);
+                bytes += (PAGES - sent) * WIDTH;
+                frames++;
+            }
+            break;
+
+        default:
+            rc = disp_update(new_frame);
+            bytes += FRAME_SIZE;
+            frames++;
+            break;
+        }
+    }
+
+#if TRANSITION_DEBUG
+    elapsed = micros() - start;
+    Serial.printf("transition %d: %d frames %d bytes %lu us (%lu fps)\r\n",
+            style, frames, bytes, elapsed,
+            elapsed ? (frames * 1000000UL) / elapsed : 0);
+#endif
+
+    return rc;
+}
+
+//
+// draw the current screen into 'frame'. Doesn't touch the display.
+// A headless instance draws with its own clip stack and caches (c->draw),
+// so instances on different threads of a host build don't share any.
+//
+void casio_render(char *frame, CASIO *c)
+{
+    DRAW *saved = DRAWING;
+
+    if( c->headless )
+        DRAWING = &c->draw;
+
+    memset(frame, CLR_MASK, FRAME_SIZE);
+
+    draw_hline(frame, 0, 15, 128);
+    draw_hline(frame, 60, 4, 128-60);
+    draw_hline(frame, 60, 10, 128-60);
+    draw_vline(frame, 60, 0, 15);
+
+    switch(c->mode)
+    {
+    case M_HOME:
+        casio_update_home_screen(frame, c);
+        break;
+    case M_DB:
+        casio_update_db_screen(frame, c);
+        break;
+    case M_CAL:
+        casio_update_cal_screen(frame, c);
+        break;
+    case M_AL:
+        casio_update_al_screen(frame, c);
+        break;
+    case M_ST:
+        casio_update_st_screen(frame, c);
+        break;
+    case M_DT:
+        casio_update_dt_screen(frame, c);
+        break;
+    }
+
+    if( c->power.inverted )
+    {
+        disp_invert(frame);
+    }
+
+    DRAWING = saved;
+}
+
+//
+// the mode of the last frame sent, so a mode change gets a transition.
+// Benchmarks that draw through casio_update_screen() put it back.
+//
+static struct
+{
+    int last_mode;              // -1 before the first frame
+} SCREEN = { -1 };
+
+//
+// draw the screen and send it. Only the pages that changed are sent,
+// and on the live watch the transfer gives way to a key or button
+// press (DISP_PREEMPTED is returned, the caller draws again).
+//
+int casio_update_screen(CASIO *c)
+{
+    char frame[FRAME_SIZE];
+    int rc;
+
+    if( ! c->headless )
+    {
+        device_stage(S_RENDER, 0);
+        if( ! DISP.sink )
+            disp_burn_step(0);
+    }
+    casio_render(frame, c);
+
+    if( ! c->headless )
+    {
+        disp_burn_shift(frame);
+        device_stage(S_TRANSMIT, 0);
+    }
+
+    // (transitions are paced by the clock, there's no point in them
+    // when the display is a null sink)
+    if( SCREEN.last_mode != -1 && SCREEN.last_mode != c->mode && TRANSITION_STYLE != T_NONE && ! DISP.sink )
+    {
+        rc = casio_transition(DISP.frame, frame, TRANSITION_STYLE);
+    }
+    else
+    {
+        rc = disp_update_pages(frame, c->headless ? NULL : device_input_pending);
+    }
+    SCREEN.last_mode = c->mode;
+
+    if( rc && rc != DISP_PREEMPTED )
+    {
+        Serial.printf("disp_update %d\r\n", rc);
+    }
+
+    return rc;
+}
+
+//////////////////////////////////////////////////////////////////////
+// live hundredths
+//
+// The stop watch is normally redrawn on E_SECONDS15, so its 1/100ths
+// jump in steps of 15. In live mode (# on the stop watch screen, while
+// it runs and no split is shown) device_get_event() also hands out an
+// E_LIVE for every new clock tick when there is nothing else to do, and
+// only the two hundredths digits are sent, as a window of the display:
+//
+//      columns LIVE_COL1..LIVE_COL2 of pages LIVE_PAGE1..LIVE_PAGE2
+//
+// i.e. 2 x 15 bytes plus the window commands instead of a full frame.
+// E_LIVE is never processed or logged; it only redraws. When anything
+// else on the screen has changed as well (seconds, the blinking colon)
+// just the pages that differ follow, so E_SECONDS15 is not needed.
+//
+// The rate is limited by the 1/100th clock, or by the bus if a window
+// takes longer than a tick (ticks are then skipped, not queued). When
+// live mode ends a line with the achieved rate is printed:
+//
+//      live: 6000 updates in 60000 ms, 100.0 Hz, cpu 0.4%, bus 21.3%, 48 bytes/update
+//
+// cpu is rendering, bus is the time spent in the display writes.
+//
+#define LIVE_COL1   (15 + 9*9)      // draw_secondary() digits 9 and 10,
+#define LIVE_COL2   (LIVE_COL1 + 9 + 4 + 2 - 1)
+#define LIVE_PAGE1  (52/8)          // 9 pixel pitch, 6 wide, 11 high at y 52
+#define LIVE_PAGE2  (LIVE_PAGE1 + 1)
+
+static struct
+{
+    unsigned long start;        // micros()
+    unsigned long updates;
+    unsigned long pages;        // extra pages sent for the rest of the screen
+    unsigned long render_us;
+    unsigned long bus_us;
+    unsigned long bytes;        // DISP.bytes at the start
+} LIVE;
+
+void casio_update_live(CASIO *c)
+{
+    char frame[FRAME_SIZE];
+    unsigned long t0, t1;
+    int page, first, last, rc;
+
+    t0 = micros();
+    casio_render(frame, c);
+    disp_burn_shift(frame);
+    t1 = micros();
+    LIVE.render_us += t1 - t0;
+
+    rc = disp_update_window(frame, LIVE_COL1 + BURN.dx, LIVE_COL2 + BURN.dx, LIVE_PAGE1, LIVE_PAGE2);
+
+    first = -1;
+    last = -1;
+    for(page=0; rc == 0 && page < FRAME_SIZE/128; page++)
+    {
+        if( memcmp(frame + page*128, DISP.frame + page*128, 128) )
+        {
+            if( first < 0 )
+                first = page;
+            last = page;
+        }
+    }
+    if( first >= 0 )
+    {
+        rc = disp_update_window(frame, 0, 127, first, last);
+        LIVE.pages += last - first + 1;
+    }
+
+    LIVE.bus_us += micros() - t1;
+    LIVE.updates++;
+
+    if( rc )
+    {
+        Serial.printf("disp_update_window %d\r\n", rc);
+    }
+}
+
+void casio_live_start()
+{
+    memset(&LIVE, 0, sizeof(LIVE));
+    LIVE.start = micros();
+    LIVE.bytes = DISP.bytes;
+}
+
+void casio_live_report()
+{
+    unsigned long ms, hz10, bytes;
+
+    ms = (micros() - LIVE.start) / 1000;
+    if( ms == 0 || LIVE.updates == 0 )
+        return;
+
+    hz10 = (unsigned long)((LIVE.updates * 10000ULL) / ms);
+    bytes = (DISP.bytes - LIVE.bytes) / LIVE.updates;
+    Serial.printf("live: %lu updates in %lu ms, %lu.%lu Hz, cpu %lu.%lu%%, bus %lu.%lu%%, %lu bytes/update, %lu extra pages\r\n",
+            LIVE.updates, ms, hz10 / 10, hz10 % 10,
+            LIVE.render_us / ms / 10, LIVE.render_us / ms % 10,
+            LIVE.bus_us / ms / 10, LIVE.bus_us / ms % 10,
+            bytes, LIVE.pages);
+}
+
+//
+// side effects of event processing. Skipped for headless (scripted)
+// instances, so they don't beep or change the real display.
+//
+void casio_tone(CASIO *c, int freq, int ms)
+{
+    if( ! c->headless )
+        tone(24, freq, ms);
+}
+
+//////////////////////////////////////////////////////////////////////
+// power policy
+//
+//  POWER_DIM       the contrast is kept at POWER_DIM_CONTRAST or below,
+//                  except with the light on
+//  POWER_INVERT    draw white on black (far fewer lit pixels, see
+//                  power model) at night, or after POWER_IDLE without a
+//                  key or button; again not with the light on
+//
+// Both are model state, so they log, replay and run headless like the
+// rest. Serial 'u' (casio_power_day) estimates a day under each policy.
+//
+#define POWER_DIM           0x01
+#define POWER_INVERT        0x02
+#define POWER_DIM_CONTRAST  0x20
+#define POWER_IDLE          (30*100L)   // 1/100ths
+#define POWER_NIGHT_FROM    22          // hours
+#define POWER_NIGHT_TO      7
+
+static const char *PowerNames[] = { "normal", "dim", "invert", "save" };
+
+int casio_urgent_event(int e)
+{
+    return e >= E_BUTTONA && e <= E_HEX_BUTTON_POUND_RELEASE;
+}
+
+void casio_set_contrast(CASIO *c, int x)
+{
+    if( (c->power.policy & POWER_DIM) && ! c->home.flags.light && x > POWER_DIM_CONTRAST )
+        x = POWER_DIM_CONTRAST;
+
+    c->power.contrast = x;
+    if( ! c->headless )
+        disp_set_contrast(x);
+}
+
+//
+// after every event: is it time to invert?
+//
+void casio_power_apply(int e, CASIO *c)
+{
+    int hours = c->home.now.time.hours;
+
+    if( casio_urgent_event(e) )
+        c->power.last_key = c->clock;
+
+    c->power.inverted = (c->power.policy & POWER_INVERT)
+        && ! c->home.flags.light
+        && (hours >= POWER_NIGHT_FROM || hours < POWER_NIGHT_TO
+            || c->clock - c->power.last_key >= POWER_IDLE);
+}
+
+void casio_power_policy(CASIO *c, int policy)
+{
+    c->power.policy = policy;
+    casio_set_contrast(c, c->home.flags.light ? 0xff : 0x7f);
+}
+
+//
+// does this screen need the E_SECONDS15 events?
+//
+int casio_wants_live(CASIO *c)
+{
+    return c->mode == M_ST && c->st.flags.running && c->st.flags.live
+        && ! c->st.flags.split;
+}
+
+int casio_wants_seconds15(CASIO *c)
+{
+    return (c->mode == M_ST && c->st.flags.running && ! casio_wants_live(c))
+        || (c->mode == M_DB && c->db.init > 0);
+}
+
+void casio_process_home_event(int e, CASIO *c)
+{
+    int xx;
+
+    if( e == E_BUTTONB )
+    {
+        c->mode = M_DB;
+        c->db.init = 50;
+    }
+    else if( e == E_BUTTONC )
+    {
+        casio_tone(c, 410, 80);
+        c->home.flags.hrs24 = (c->home.flags.hrs24) ? 0 : 1;
+    }
+    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
+    {
+        xx = (e - E_HEX_BUTTON_0)+1;
+
+        casio_tone(c, xx*100, 100);
+
+        if( e == E_HEX_BUTTON_A )
+        {
+            c->home.flags.show_dt = 1;
+        }
+        else if( e == E_HEX_BUTTON_D )
+        {
+            c->home.flags.show_db = 1;
+        }
+        else if( e == E_HEX_BUTTON_POUND && c->home.flags.light_held && ! c->headless )
+        {
+            DEVICE.cycles = 1;  // hidden: light + #, see casio_cycles()
+        }
+    }
+    else if( e == E_HEX_BUTTON_A_RELEASE )
+    {
+        c->home.flags.show_dt = 0;
+    }
+    else if( e == E_HEX_BUTTON_D_RELEASE )
+    {
+        c->home.flags.show_db = 0;
+    }
+}
+
+void casio_process_db_event(int e, CASIO *c)
+{
+    int xx;
+
+    if( e == E_BUTTONB )
+    {
+        c->mode = M_CAL;
+    }
+    else if( e == E_BUTTONC )
+    {
+        casio_tone(c, 410, 80);
+    }
+    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
+    {
+        xx = (e - E_HEX_BUTTON_0)+1;
+
+        casio_tone(c, xx*100, 100);
+
+        switch(e)
+        {
+        case E_HEX_BUTTON_0:        strcpy(c->db.text, "ABC"); break;
+        case E_HEX_BUTTON_1:        strcpy(c->db.text, "DEF"); break;
+        case E_HEX_BUTTON_2:        strcpy(c->db.text, "GHI"); break;
+        case E_HEX_BUTTON_3:        strcpy(c->db.text, "JKL"); break;
+        case E_HEX_BUTTON_4:        strcpy(c->db.text, "MNO"); break;
+        case E_HEX_BUTTON_5:        strcpy(c->db.text, "PQR"); break;
+        case E_HEX_BUTTON_6:        strcpy(c->db.text, "STU"); break;
+        case E_HEX_BUTTON_7:        strcpy(c->db.text, "VWX"); break;
+        case E_HEX_BUTTON_8:        strcpy(c->db.text, "YZ1"); break;
+        case E_HEX_BUTTON_9:        strcpy(c->db.text, "234"); break;
+
+        case E_HEX_BUTTON_A:
+                strcpy(c->db.text, "567");
+                if( c->db.page == 0 ) {
+                    c->db.page = 1;
+                } else {
+                    c->db.page -= 1;
+                    if( c->db.page < 1 ) c->db.page = 5;
+                }
+                break;
+
+        case E_HEX_BUTTON_B:        strcpy(c->db.text, "890"); break;
+        case E_HEX_BUTTON_C:        strcpy(c->db.text, "%<>"); break;
+
+        case E_HEX_BUTTON_D:
+                strcpy(c->db.text, "\13\14\15");
+                if( c->db.page == 0 ) {
+                    c->db.page = 5;
+                } else {
+                    c->db.page += 1;
+                    if( c->db.page > 5 ) c->db.page = 1;
+                }
+                break;
+
+        case E_HEX_BUTTON_POUND:    strcpy(c->db.text, "\6\7\10"); break;
+        case E_HEX_BUTTON_STAR:     strcpy(c->db.text, ""); break;
+        }
+
+    }
+    else if( e == E_SECONDS15 )
+    {
+        if( c->db.init > 0 )
+            c->db.init -= 1;
+    }
+}
+
+void casio_process_cal_event(int e, CASIO *c)
+{
+    int xx, len;
+    char buf[10];
+    double val;
+
+    if( e == E_BUTTONB )
+    {
+        c->mode = M_AL;
+    }
+    else if( e == E_BUTTONC )
+    {
+        c->cal.op = 0;
+        c->cal.acc = 0.0;
+        c->cal.current[0] = '\0';
+        casio_tone(c, 410, 80);
+    }
+    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
+    {
+        xx = (e - E_HEX_BUTTON_0)+1;
+
+        casio_tone(c, xx*100, 100);
+
+        if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_9 )
+        {
+            len = strlen(c->cal.current);
+            if( len < 8 )
+            {
+                buf[0] = '0' + (e - E_HEX_BUTTON_0);
+                buf[1] = '\0';
+                strcat(c->cal.current, buf);
+//              c->cal.op = 0;
+            }
+        }
+        else if( e == E_HEX_BUTTON_STAR )
+        {
+            len = strlen(c->cal.current);
+            if( len < 8 )
+            {
+                buf[0] = '.';
+                buf[1] = '\0';
+                strcat(c->cal.current, buf);
+//              c->cal.op = 0;
+            }
+        }
+        else if( e >= E_HEX_BUTTON_A && e <= E_HEX_BUTTON_D )
+        {
+            // 0=NO-OP, 1=A=+, 2=B=-, 3=C=*, 4=D=/
+
+            if( c->cal.op != 0 )
+            {
+                // enter K-mode (constant mode)
+            }
+
+            c->cal.op = (e - E_HEX_BUTTON_A) + 1;
+            val = atof(c->cal.current);
+            c->cal.acc = val;
+            c->cal.current[0] = '\0';
+        }
+        else if( e == E_HEX_BUTTON_POUND )
+        {
+            if( c->cal.op != 0 )
+            {
+                // parse number, apply op to number and store in acc
+                val = atof(c->cal.current);
+                switch(c->cal.op)
+                {
+                case 1: c->cal.acc += val; break;
+                case 2: c->cal.acc -= val; break;
+                case 3: c->cal.acc *= val; break;
+                case 4: c->cal.acc /= val; break;
+                }
+                c->cal.current[0] = '\0';
+                c->cal.op = 0;
+            }
+            else if( c->cal.current[0] != '\0' )
+            {
+                val = atof(c->cal.current);
+                c->cal.acc = val;
+                c->cal.current[0] = '\0';
+                c->cal.op = 0;
+            }
+        }
+
+    }
+}
+
+void casio_process_al_event(int e, CASIO *c)
+{
+    int xx;
+
+    if( e == E_BUTTONB )
+    {
+        c->mode = M_ST;
+    }
+    else if( e == E_BUTTONC )
+    {
+        casio_tone(c, 410, 80);
+    }
+    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
+    {
+        xx = (e - E_HEX_BUTTON_0)+1;
+
+        casio_tone(c, xx*100, 100);
+
+        c->al.pos = e;
+    }
+}
+
+void casio_process_st_event(int e, CASIO *c)
+{
+    long diff1, diff2 = 0;
+    int xx;
+
+    if( e == E_BUTTONA )
+    {
+        if( c->st.flags.split ) {
+            c->st.flags.split = 0;
+        } else {
+            casio_tone(c, 410, 80);
+            if( c->st.flags.running ) {
+                c->st.timer_split = c->clock;
+                c->st.flags.split = 1;
+            } else {
+                c->st.timer_start = c->st.timer_stop = 0;
+            }
+        }
+    }
+    else if( e == E_BUTTONB )
+    {
+        c->mode = M_DT;
+    }
+    else if( e == E_BUTTONC )
+    {
+        casio_tone(c, 410, 80);
+
+        if( c->st.flags.running ) {
+            c->st.timer_stop = c->clock;
+            c->st.flags.running = 0;
+        } else {
+            diff1 = c->st.timer_stop - c->st.timer_start;
+            if( c->st.flags.split )
+            {
+                diff2 = c->st.timer_split - c->st.timer_start;
+            }
+
+            c->st.timer_start = c->clock - diff1;
+            c->st.flags.running = 1;
+
+            if( c->st.flags.split )
+            {
+                c->st.timer_split = c->st.timer_start + diff2;
+                c->st.flags.running = 1;
+            }
+        }
+    }
+    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
+    {
+        xx = (e - E_HEX_BUTTON_0)+1;
+
+        casio_tone(c, xx*100, 100);
+
+        if( e == E_HEX_BUTTON_A )
+        {
+            c->home.contrast -= 10;
+            casio_set_contrast(c, c->home.contrast);
+        }
+        else if( e == E_HEX_BUTTON_D )
+        {
+            c->home.contrast += 10;
+            casio_set_contrast(c, c->home.contrast);
+        }
+        else if( e == E_HEX_BUTTON_POUND )
+        {
+            c->st.flags.live = ! c->st.flags.live;
+        }
+    }
+}
 
-    top = CasioFont.top[ch];
-    bits = CasioFont.bits[ch];
+void casio_process_dt_event(int e, CASIO *c)
+{
+    int xx;
 
-    // top row
-    if( top != 0 )
+    if( e == E_BUTTONB )
     {
-        x = 4;
-        y = 0;
-        for(i=0; i < 5; i++) {
-            pixel = top & 1;
-            top >>= 1;
+        c->mode = M_HOME;
+    }
+    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
+    {
+        xx = (e - E_HEX_BUTTON_0)+1;
 
-            for(mx=0; mx < mag; mx++) {
-                for(my=0; my < mag; my++) {
-                    if( pixel )
-                        disp_pset(frame, x0+x*mag+mx, y0+y*mag+my, pixel);
-                }
-            }
-            x--;
+        casio_tone(c, xx*100, 100);
+
+        if( e == E_HEX_BUTTON_A )
+        {
+            c->dt.flags.show_home = 1;
+        }
+        else if( e == E_HEX_BUTTON_D )
+        {
+            c->dt.flags.show_db = 1;
         }
     }
+    else if( e == E_HEX_BUTTON_A_RELEASE )
+    {
+        c->dt.flags.show_home = 0;
+    }
+    else if( e == E_HEX_BUTTON_D_RELEASE )
+    {
+        c->dt.flags.show_db = 0;
+    }
+}
 
-    // bottom rows
-    x = 4;
-    y = 6;
-    for(i=0; i < 30; i++) {
-        pixel = bits & 1;
-        bits >>= 1;
+void casio_process_event(int e, CASIO *c)
+{
+    int mode = c->mode;
 
-        for(mx=0; mx < mag; mx++) {
-            for(my=0; my < mag; my++) {
-                if( pixel )
-                    disp_pset(frame, x0+x*mag+mx, y0+y*mag+my, pixel);
-            }
+    if( e == E_SECONDS_TIMER )
+    {
+        c->home.now = epoch_to_date_time(c->epoch);
+    }
+
+    if( e == E_BUTTONL )
+    {
+        if( ! c->home.flags.light )
+        {
+            c->home.flags.light = 1;
+            if( ! c->headless )
+                DEVICE.light = 160;
+            casio_set_contrast(c, 0xff);
         }
+    }
 
-        x--;
-        if( x < 0 ) {
-            x = 4;
-            y--;
-            if( y < 0 ) y = 4;
+    if( e == E_BUTTONL || e == E_BUTTONL_RELEASE )
+    {
+        c->home.flags.light_held = (e == E_BUTTONL);
+    }
+
+    if( e == E_LIGHT_OFF )
+    {
+        c->home.flags.light = 0;
+        casio_set_contrast(c, 0x7f);
+    }
+
+    switch(c->mode)
+    {
+    case M_HOME:
+        casio_process_home_event(e, c);
+        break;
+    case M_DB:
+        casio_process_db_event(e, c);
+        break;
+    case M_CAL:
+        casio_process_cal_event(e, c);
+        break;
+    case M_AL:
+        casio_process_al_event(e, c);
+        break;
+    case M_ST:
+        casio_process_st_event(e, c);
+        break;
+    case M_DT:
+        casio_process_dt_event(e, c);
+        break;
+    }
+
+    // a key held across a mode change releases in the new mode
+    if( c->mode != mode )
+    {
+        c->home.flags.show_db = 0;
+        c->home.flags.show_dt = 0;
+        c->dt.flags.show_db = 0;
+        c->dt.flags.show_home = 0;
+    }
+
+    casio_power_apply(e, c);
+
+    // cancel high speed tick events if stop watch not running
+    if( ! c->headless )
+    {
+        DEVICE.counter15_enable = casio_wants_seconds15(c);
+
+        if( casio_wants_live(c) != DEVICE.live_enable )
+        {
+            if( DEVICE.live_enable )
+                casio_live_report();
+            else
+                casio_live_start();
+            DEVICE.live_enable = ! DEVICE.live_enable;
         }
     }
 }
 
-void draw_blit(char *frame, int x0, int y0, int width, int height, long bits)
+void casio_init(CASIO *c)
 {
-    int len;
-    int i, x, y, pixel;
+    memset(c, 0, sizeof(*c));
+    draw_init(&c->draw);
+    c->mode = M_HOME;
 
-    len = width * height;
-    x = width-1;
-    y = height-1;
-    for(i=0; i < len; i++) {
-        pixel = bits & 1;
-        bits >>= 1;
+    c->home.dt.date.day = 24;
+    c->home.dt.date.month = 4;
+    c->home.dt.date.year = 2022;
 
-        if( pixel )
-            disp_pset(frame, x0+x, y0+y, pixel);
+    c->home.dt.time.hours = 13;
+    c->home.dt.time.minutes = 58;
+    c->home.dt.time.seconds = 00;
 
-        x--;
-        if( x < 0 ) {
-            x = width-1;
-            y--;
-            if( y < 0 )
-                y = height-1;
-        }
-    }
+    c->home.contrast = 0x7f;
+    c->power.contrast = 0x7f;
+
+    c->epoch = date_time_to_epoch(&c->home.dt);
 }
 
+//////////////////////////////////////////////////////////////////////
+// self test
 //
-// Day of the Week List
+// Serial command 't'. Drives a scripted key and time sequence through
+// casio_process_event() and casio_render() on a headless CASIO, one
+// script per mode, covering a simulated week at one frame per minute.
+// Each frame is hashed and the hashes are folded into a running digest
+// per mode, which is checked against SelftestGolden every SELFTEST_CHUNK
+// frames and at the end:
 //
-//      Sun Mon Tue Wed Thu Fri Sat
+//      selftest HOME 10288 frames dfa51a4f ok
+//      ...
+//      selftest 68646 frames <elapsed> us <rate> fps
+//      ...
+//      selftest ok, 0 failed
 //
-// ENG  SUN MON TUE WED THU FRI SAT
-// POR  DOM SEG TER QUA QUI SEX S\000B
-// ESP  DOM LUN MAR MI\000 JUE VIE S\000B
-// FRA  DIM LUN MAR MER JEU VEN SAM
-// NED  ZON MAA DIN WOE DON VRI ZAT
-// DAN  S\000N MAN TIR ONS TOR FRE L\000R
-// DEU  SON MON DIE MIT DON FRE SAM
-// ITA  DOM LUN MAR MER GIO VEN SAB
-// SVE  S\000N M\000N TIS ONS TOR FRE L\000R
-// POL  NIE PON WTO \000RO CZE PI\000 SOB
-// ROM  DUM LUN MAR MIE JOI VIN S\000M
-// TUR  PAZ PZT SAL \000AR PER CUM CTS
-// PYC  BC \000H B\000 CP \000\000 \000\000 C\000
+// At the first checkpoint of a mode that doesn't match, a FAIL line says
+// which frames it covers and the frame drawn last (the last one of the
+// chunk that went wrong) is printed as a plain PBM image between
+// "selftest pbm" and "selftest end" lines, lit pixels black; cut it out
+// of the log to look at it. The rest of that mode is not checked again.
 //
-// Languages:
-//  ENG
-//  POR
-//  ESP
-//  FRA
-//  NED
-//  DAN
-//  DEU
-//  ITA
-//  SVE
-//  POL
-//  ROM
-//  T\000R
-//  P\000C
+// When a screen changes on purpose, run 't' and copy the new digests
+// into SelftestGolden ('T' prints the table).
 //
+// Then come the time base trim checks and the equivalence checks, each
+// a fast path against a slow reference on fixed-seed random inputs:
+//
+//      selftest fmt_calc: 20000 values, 0 differ, ok
+//      selftest timer: 20000 steps, 0 differ, ok
+//      selftest preempt: 2000 frames, <n> preempted, 0 bad, ok
+//
+#define SELFTEST_CHUNK  1024
+#define SELFTEST_CHECKS 17              // ST has 17134 frames
+
+typedef struct {
+    const char *name;
+    unsigned long frames;
+    unsigned long digest[SELFTEST_CHECKS];  // after every SELFTEST_CHUNK frames, then the end
+} GOLDEN;
+
+static const GOLDEN SelftestGolden[] = {
+    { "HOME", 10288, {
+            0x458a39ea, 0x0342dc6d, 0xf946427b, 0x67791672, 0x0641e940, 0x2fb2a1be,
+            0xf7f5dee7, 0x22f8e7c1, 0x9f5202b3, 0x3ee5f06b, 0xdfa51a4f } },
+    { "DB", 10340, {
+            0xf02cc9db, 0xc6dd841e, 0xf95a6a49, 0x4ecdaf58, 0xbfce02a6, 0x55c2098b,
+            0x45e6bd6e, 0xc65f9bf3, 0x3f46eeb6, 0xfa59bef9, 0x948c217b } },
+    { "CAL", 10292, {
+            0x79414209, 0xa9323c90, 0x302d8a9c, 0x5762ad4c, 0x3b9ab6e8, 0xd3effbb4,
+            0x17451f27, 0x9acc838a, 0xd0965518, 0xab76c9a7, 0x42053437 } },
+    { "AL", 10294, {
+            0x30ef15fa, 0xee4979d4, 0xece99be6, 0x51aea080, 0x3f32082a, 0x3f2655bb,
+            0xe1232d6b, 0xdb3c43ec, 0x90164bde, 0x3b90b376, 0x1e326700 } },
+    { "ST", 17134, {
+            0xd07aec27, 0xf0ed3149, 0xb3d8c056, 0xba110c36, 0xebdd8602, 0x579a473d,
+            0x205206c0, 0xe288b4a8, 0x7b927769, 0xd0295f0e, 0xbea108fc, 0x7b186b3c,
+            0x3af80967, 0x68ac1ecb, 0x6bf9e526, 0x2a30312b, 0x69edfb50 } },
+    { "DT", 10298, {
+            0xf15b5e43, 0x67eca3fe, 0x31682e1a, 0x4ea3580d, 0xc7231bad, 0xedd95954,
+            0xd114a680, 0x19ee2332, 0x5e127063, 0x1820afea, 0x3306681b } },
+};
 
-char AsciiMap[256];
+static struct
+{
+    const GOLDEN *golden;
+    unsigned long digest;
+    unsigned long frames;
+    int failed;                 // this mode
+    int print;                  // 'T': print the table, don't check
+    unsigned long checks[SELFTEST_CHECKS];
+} SELFTEST;
 
-void make_ascii()
+//
+// a frame as a plain (P1) PBM, lit pixels black as in tools/framedump.py
+//
+void casio_selftest_pbm(const char *frame)
 {
-    static char letters[] = {
-             2, 10, 11, 14, 15, 21,         // A B C D E F
-            22, 24, 25, 31, 32, 33,         // G H I J K L
-            35, 36, 39, 46, 47, 48,         // M N O P Q R
-            49, 52, 54, 59, 60, 61,         // S T U V W X
-            62, 63,                         // Y Z
-    };
-    int i;
+    char line[128 + 3];
+    int x, y;
 
-    // digits
-    for(i=0; i <= 9; i++)
+    Serial.printf("selftest pbm\r\nP1\r\n128 64\r\n");
+    for(y=0; y < 64; y++)
     {
-        AsciiMap[ '0' + i ] = 112 + i;
+        for(x=0; x < 128; x++)
+            line[x] = PIXEL_ON(disp_pget((char *)frame, x, y)) ? '1' : '0';
+        line[128] = '\0';
+        Serial.printf("%s\r\n", line);
     }
+    Serial.printf("selftest end\r\n");
+}
 
-    // letters
-    for(i=0; i < 26; i++)
+//
+// check the running digest at a checkpoint ('n', the end of the mode
+// is the last one)
+//
+void casio_selftest_check(int n, const char *frame)
+{
+    const GOLDEN *g = SELFTEST.golden;
+
+    if( n >= SELFTEST_CHECKS )
+        return;
+
+    SELFTEST.checks[n] = SELFTEST.digest & 0xffffffffUL;
+    if( SELFTEST.print || SELFTEST.failed )
+        return;
+
+    if( SELFTEST.checks[n] != g->digest[n] )
     {
-        AsciiMap[ 'A' + i ] = letters[i];
-        AsciiMap[ 'a' + i ] = letters[i];
+        Serial.printf("selftest %s FAIL at frames %lu..%lu: digest %08lx, expected %08lx\r\n",
+                g->name, n * (unsigned long)SELFTEST_CHUNK, SELFTEST.frames - 1,
+                SELFTEST.checks[n], g->digest[n]);
+        casio_selftest_pbm(frame);
+        SELFTEST.failed = 1;
     }
+}
 
-    AsciiMap[' '] = '\001';
+void casio_selftest_event(CASIO *c, int e, char *frame, unsigned long *digest)
+{
+    casio_process_event(e, c);
+    casio_render(frame, c);
+    *digest = (*digest ^ disp_hash(frame)) * 16777619UL;
+
+    SELFTEST.digest = *digest;
+    SELFTEST.frames++;
+    if( SELFTEST.frames % SELFTEST_CHUNK == 0 )
+        casio_selftest_check(SELFTEST.frames / SELFTEST_CHUNK - 1, frame);
+}
 
-    // symbols
-    AsciiMap['@'] = 103;
-    AsciiMap['!'] = 104;
-    AsciiMap['?'] = 105;
-    AsciiMap[','] = 106;
-    AsciiMap['.'] = 107;
-    AsciiMap[':'] = 108;
-    AsciiMap['/'] = 109;
-    AsciiMap['+'] = 110;
-    AsciiMap['-'] = 111;
+//
+// 'print' (serial command 'T'): print the digests as a SelftestGolden
+// table instead of checking them
+//
+int casio_selftest_run(int print)
+{
+    static const int keys[] = {
+        E_HEX_BUTTON_1, E_HEX_BUTTON_2, E_HEX_BUTTON_STAR, E_HEX_BUTTON_5,
+        E_HEX_BUTTON_A, E_HEX_BUTTON_7, E_HEX_BUTTON_POUND, E_HEX_BUTTON_D,
+        E_HEX_BUTTON_9, E_HEX_BUTTON_0, E_HEX_BUTTON_B, E_HEX_BUTTON_C,
+    };
+    const int NKEYS = sizeof(keys)/sizeof(keys[0]);
+    const int STEPS = 7*24*60;      // a week of minutes
+    CASIO c;
+    char frame[FRAME_SIZE];
+    unsigned long digest, start, elapsed, frames, total;
+    int m, i, k, e, n, failed;
+
+    total = 0;
+    failed = 0;
+    start = micros();
+
+    for(m=0; m < 6; m++)
+    {
+        memset(&SELFTEST, 0, sizeof(SELFTEST));
+        SELFTEST.golden = &SelftestGolden[m];
+        SELFTEST.print = print;
+
+        casio_init(&c);
+        c.headless = 1;
+        digest = 2166136261UL;
+        k = 0;
+
+        // button B steps through HOME, DB, CAL, AL, ST, DT
+        for(i=0; i < m; i++)
+        {
+            casio_selftest_event(&c, E_BUTTONB, frame, &digest);
+            casio_selftest_event(&c, E_BUTTONB_RELEASE, frame, &digest);
+        }
+
+        if( c.mode == M_ST )
+        {
+            casio_selftest_event(&c, E_BUTTONC, frame, &digest);
+        }
+
+        for(i=0; i < STEPS; i++)
+        {
+            c.epoch += 60;
+            c.clock += 60*100;
+            casio_selftest_event(&c, E_SECONDS_TIMER, frame, &digest);
+
+            if( casio_wants_seconds15(&c) )
+            {
+                casio_selftest_event(&c, E_SECONDS15, frame, &digest);
+            }
 
-    // special symbols
-    AsciiMap[1] = 123;  // hour glass
-    AsciiMap[2] = 124;  // left arrow
-    AsciiMap[3] = 125;  // right arrow
+            if( i % 97 == 0 )
+            {
+                e = keys[k++ % NKEYS];
+                casio_selftest_event(&c, e, frame, &digest);
+                casio_selftest_event(&c, e + E_HEX_BUTTON_0_RELEASE - E_HEX_BUTTON_0, frame, &digest);
+            }
 
-    AsciiMap[4] = 126;  // bell
-    AsciiMap[5] = 127;  // dual time
-    AsciiMap[6] = 128;  // calculator1
+            if( i % 1009 == 0 && c.mode == M_ST )
+            {
+                casio_selftest_event(&c, E_BUTTONA, frame, &digest);
+            }
+        }
 
-    AsciiMap[7] = 129;  // calculator2
-    AsciiMap[8] = 130;  // calculator3
-    AsciiMap[9] = 131;  // divide
+        frames = SELFTEST.frames;
+        n = frames / SELFTEST_CHUNK;
+        casio_selftest_check(n, frame);
 
-    AsciiMap[10] = 132; // stop watch
+        if( ! print && ! SELFTEST.failed && frames != SELFTEST.golden->frames )
+        {
+            Serial.printf("selftest %s FAIL: %lu frames, expected %lu\r\n",
+                    SelftestGolden[m].name, frames, SelftestGolden[m].frames);
+            SELFTEST.failed = 1;
+        }
+        failed += SELFTEST.failed;
 
-    AsciiMap[11] = 3;   // A1 \13
-    AsciiMap[12] = 4;   // A2 \14
-    AsciiMap[13] = 5;   // A3 \15
-    AsciiMap[14] = 6;   // A4
-    AsciiMap[15] = 7;   // A5
-    AsciiMap[16] = 8;   // A6
-    AsciiMap[17] = 9;   // A7
+        if( print )
+        {
+            Serial.printf("    { \"%s\", %lu, {", SelftestGolden[m].name, frames);
+            for(i=0; i <= n && i < SELFTEST_CHECKS; i++)
+                Serial.printf("%s0x%08lx", i == 0 ? "\r\n            " : i % 6 ? ", " : ",\r\n            ",
+                        SELFTEST.checks[i]);
+            Serial.printf(" } },\r\n");
+        }
+        else
+        {
+            Serial.printf("selftest %s %lu frames %08lx %s\r\n", SelftestGolden[m].name,
+                    frames, digest & 0xffffffffUL, SELFTEST.failed ? "FAIL" : "ok");
+        }
+        total += frames;
+    }
+
+    elapsed = micros() - start;
+    Serial.printf("selftest %lu frames %lu us %lu fps\r\n",
+            total, elapsed, elapsed ? (unsigned long)((total * 1000000.0) / elapsed) : 0);
+
+    return failed;
 }
 
-void draw_ascii_string(char *frame, int x0, int y0, int mag, const char *str)
+//
+// equivalence checks: a fast path against the slow way it replaced, on
+// SELFTEST_RANDOM random inputs from a fixed seed, so a failure repeats.
+// Each prints one line, with the first input that differed, and returns
+// 1 on a failure.
+//
+#define SELFTEST_RANDOM 20000
+
+unsigned long casio_selftest_rand(unsigned long *x)
 {
-    const char *p;
-    int x, ch;
+    *x ^= (*x << 13) & 0xffffffffUL;
+    *x ^= *x >> 17;
+    *x ^= (*x << 5) & 0xffffffffUL;
 
-    x = x0;
-    for(p=str; *p; p++)
+    return *x;
+}
+
+//
+// fmt_calc() against fmt_calc_ref(), on the kinds of numbers the
+// calculator makes: integers, quotients, products with decimals, and
+// fractions from 1e-9 to 1e9 (either side of the "E" limit)
+//
+int casio_selftest_fmt_calc()
+{
+    static const double Scale[] = {
+        1e-9, 1e-8, 1e-7, 1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 1e-1,
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+    };
+    char a[24], b[24];
+    unsigned long x, r, q;
+    double v;
+    int i, bad;
+
+    x = 0x9e3779b9UL;
+    bad = 0;
+    for(i=0; i < SELFTEST_RANDOM; i++)
     {
-        ch = AsciiMap[*p];
-        if( ch == 0 )
+        r = casio_selftest_rand(&x);
+        q = casio_selftest_rand(&x);
+
+        switch(i % 4)
         {
-            ch = ch + 128;
+        case 0:
+            v = (double)(r % 200000000UL) - 1e8;
+            break;
+        case 1:
+            v = ((double)(r % 100000000UL) - 5e7) / (double)(1 + q % 99999);
+            break;
+        case 2:
+            v = ((double)(r % 20000) - 1e4) * ((double)(q % 20000) - 1e4) / 1000.0;
+            break;
+        default:
+            v = ((double)r / 4294967296.0 - 0.5) * Scale[q % (sizeof(Scale) / sizeof(Scale[0]))];
+            break;
         }
 
-        draw_char(frame, x, y0, mag, ch);
-        x = x + CHAR_WIDTH * mag + CHAR_SPACING;
+        fmt_calc(a, v);
+        fmt_calc_ref(b, v);
+        if( strcmp(a, b) != 0 && bad++ == 0 )
+            Serial.printf("selftest fmt_calc: %.17g gives \"%s\", should be \"%s\"\r\n", v, a, b);
     }
+
+    Serial.printf("selftest fmt_calc: %d values, %d differ, %s\r\n",
+            SELFTEST_RANDOM, bad, bad ? "FAIL" : "ok");
+
+    return bad ? 1 : 0;
 }
 
-void draw_string(char *frame, int x0, int y0, int mag, const char *str)
+//
+// timer_cached() against timer_set_from_100ths() along random walks:
+// mostly small steps forward (the running stop watch), some repeats
+// (stopped), jumps back and jumps forward past the carry limit. Some
+// walks start just before the hour, so the carries into the hours and
+// the 24 hour wrap are crossed as well.
+//
+int casio_selftest_timer()
 {
-    const char *p;
-    int x;
+    TIMER_CACHE tc;
+    TIMER a, b;
+    unsigned long x, r;
+    long diff;
+    int i, bad;
 
-    x = x0;
-    for(p=str; *p; p++)
+    memset(&tc, 0, sizeof(tc));
+    x = 0x2545f491UL;
+    diff = 0;
+    bad = 0;
+    for(i=0; i < SELFTEST_RANDOM; i++)
     {
-        draw_char(frame, x, y0, mag, *p);
-        x = x + CHAR_WIDTH * mag + CHAR_SPACING;
+        r = casio_selftest_rand(&x);
+
+        switch(r % 10)
+        {
+        case 0:
+            break;
+        case 1:
+            diff = (r >> 8) % (3 * 8640000L);
+            break;
+        case 2:
+            diff += 1000 + (r >> 8) % 1000000L;
+            break;
+        case 3:
+            // just before one of the first 72 hours, some are days
+            diff = ((r >> 8) % 72 + 1) * 360000L - (r >> 16) % 4000;
+            break;
+        default:
+            diff += 1 + (r >> 8) % 999;
+            break;
+        }
+
+        a = timer_cached(&tc, diff);
+        b = timer_set_from_100ths(diff);
+        if( (a.hours != b.hours || a.minutes != b.minutes || a.seconds != b.seconds || a.ks != b.ks)
+            && bad++ == 0 )
+        {
+            Serial.printf("selftest timer: %ld gives %d:%02d:%02d.%02d, should be %d:%02d:%02d.%02d\r\n",
+                    diff, a.hours, a.minutes, a.seconds, a.ks, b.hours, b.minutes, b.seconds, b.ks);
+        }
     }
-}
 
-void draw_am1(char *frame)
-{
-//  draw_rect(frame, 1, 17, 5, 5);
-    draw_ascii_string(frame, 1, 17, 1, "A");
-}
+    Serial.printf("selftest timer: %d steps, %d differ, %s\r\n",
+            SELFTEST_RANDOM, bad, bad ? "FAIL" : "ok");
 
-void draw_pm1(char *frame)
-{
-//  draw_rect(frame, 7, 17, 5, 5);
-    draw_ascii_string(frame, 7, 17, 1, "P");
+    return bad ? 1 : 0;
 }
 
-void draw_am2(char *frame)
-{
-//  draw_rect(frame, 1, 50, 4, 4);
-    draw_blit(frame, 1, 50, 4, 4, 0x000069F9);  // 0110 1001 1111 1001
-}
+//
+// disp_update_pages() given way to "keys" at random pages, on the null
+// sink: a new frame is drawn after most preemptions, as casio_run()
+// does, until one goes through. No page of the display may ever hold
+// anything but the page it had or the page of the frame being sent,
+// and once an update completes the display must equal the last frame.
+// The display's own frame is put back afterwards.
+//
+#define SELFTEST_PREEMPT_FRAMES 2000
 
-void draw_pm2(char *frame)
-{
-//  draw_rect(frame, 5, 50, 4, 4);
-    draw_blit(frame, 5, 50, 4, 4, 0x0000E9E8);  // 1110 1001 1110 1000
-}
+static unsigned long selftest_preempt_rand;
 
-void draw_split(char *frame)
+int casio_selftest_preempt_key()
 {
-//  draw_rect(frame, 1, 1, 15, 5);
-    draw_ascii_string(frame, 1, 0, 1, "SPL");
+    return casio_selftest_rand(&selftest_preempt_rand) % 3 == 0;
 }
 
-void draw_dst(char *frame)
+//
+// change some pages of 'frame', a few bytes each
+//
+void casio_selftest_scribble(char *frame, unsigned long *x)
 {
-//  draw_rect(frame, 1, 8, 15, 5);
-    draw_ascii_string(frame, 1, 7, 1, "DST");
+    unsigned long r;
+    int page, i;
+
+    for(page=0; page < FRAME_SIZE/128; page++)
+    {
+        r = casio_selftest_rand(x);
+        if( r % 2 )
+            continue;
+        for(i=0; i < 1 + (int)(r >> 8) % 4; i++)
+            frame[page*128 + (casio_selftest_rand(x) >> 8) % 128] ^= 1 << (r >> (12 + i*3)) % 8;
+    }
 }
 
-void draw_lt(char *frame)
+int casio_selftest_preempt()
 {
-//  draw_rect(frame, 62+10, 0, 12, 3);
-//  draw_blit(frame, 62+10, 0, 6, 3, 0x000278B2); // 100111 100010 110010
+    char saved[FRAME_SIZE], frame[FRAME_SIZE], before[FRAME_SIZE];
+    unsigned long x, preempted;
+    int n, page, rc, sink, mirror, bad;
+
+    memcpy(saved, DISP.frame, FRAME_SIZE);
+    sink = DISP.sink;
+    mirror = MIRROR.enabled;
+    DISP.sink = 1;
+    MIRROR.enabled = 0;
+
+    x = 0x6a09e667UL;
+    selftest_preempt_rand = 0xbb67ae85UL;
+    memcpy(frame, DISP.frame, FRAME_SIZE);
+    preempted = 0;
+    bad = 0;
+
+    for(n=0; n < SELFTEST_PREEMPT_FRAMES; n++)
+    {
+        casio_selftest_scribble(frame, &x);
 
-//  draw_blit(frame, 62+10, 1, 6, 3, 0x000278B2); // 100111 100010 110010
-    draw_blit(frame, 62+10, 0, 6, 4, 0x009E28B2); // 100111 100010 100010 110010
-}
+        do {
+            memcpy(before, DISP.frame, FRAME_SIZE);
+            rc = disp_update_pages(frame, casio_selftest_preempt_key);
 
-void draw_3sec(char *frame)
-{
-//  draw_rect(frame, 62+30, 0, 20, 3);
-    draw_blit(frame, 62+30, 0, 10, 3, 0x36D52B6D); // 1101101101 0101001010 1101101101
+            for(page=0; page < FRAME_SIZE/128; page++)
+            {
+                if( memcmp(DISP.frame + page*128, frame + page*128, 128) != 0
+                    && memcmp(DISP.frame + page*128, before + page*128, 128) != 0
+                    && bad++ == 0 )
+                {
+                    Serial.printf("selftest preempt: frame %d page %d is neither old nor new\r\n", n, page);
+                }
+            }
 
-    draw_blit(frame, 62+30, 0, 10, 1, 0x36D52B6D); // 1101101101 0101001010 1101101101
-    draw_blit(frame, 62+30, 1, 10, 3, 0x36D52B6D); // 1101101101 0101001010 1101101101
-}
+            if( rc == DISP_PREEMPTED )
+            {
+                preempted++;
+                if( casio_selftest_rand(&x) % 4 )
+                    casio_selftest_scribble(frame, &x);     // the key's frame
+            }
+        } while( rc == DISP_PREEMPTED );
 
-void draw_snooze(char *frame)
-{
-//  draw_rect(frame, 64, 5, 12, 4);
-//  draw_ascii_string(frame, 64-1, 4, 1, "SNZ");
-    draw_ascii_string(frame, 64-1, 3, 1, "SNZ");
-}
+        if( (rc != 0 || memcmp(DISP.frame, frame, FRAME_SIZE) != 0) && bad++ == 0 )
+            Serial.printf("selftest preempt: frame %d didn't converge, rc %d\r\n", n, rc);
+    }
 
-void draw_mute(char *frame)
-{
-//  draw_rect(frame, 64+12+10, 5, 20, 4);
-//  draw_ascii_string(frame, 64+12+10-1, 4, 1, "MUTE");
-    draw_ascii_string(frame, 64+12+10-1, 3, 1, "MUTE");
-}
+    DISP.sink = sink;
+    MIRROR.enabled = mirror;
+    memcpy(DISP.frame, saved, FRAME_SIZE);
+    disp_power_update();
 
-void draw_sig(char *frame)
-{
-//  draw_rect(frame, 64+12+20+6+10, 5, 12, 4);
-//  draw_ascii_string(frame, 64+12+20+6+10-1, 4, 1, "SIG");
-    draw_ascii_string(frame, 64+12+20+6+10-1, 3, 1, "SIG");
+    Serial.printf("selftest preempt: %d frames, %lu preempted, %d bad, %s\r\n",
+            SELFTEST_PREEMPT_FRAMES, preempted, bad, bad ? "FAIL" : "ok");
+
+    return bad ? 1 : 0;
 }
 
-void draw_alarm(char *frame, int n)
+//
+// all of the self tests, returns how many failed
+//
+int casio_selftest()
 {
-//  draw_rect(frame, 62+(n-1)*13, 11, 12, 3);
-    draw_blit(frame, 62+(n-1)*13, 11, 7, 3, 0x00096AD5);
+    int failed;
+
+    failed = casio_selftest_run(0);
+
+    failed += device_trim_selftest(37500);
+    failed += device_trim_selftest(-123456);
+    failed += casio_selftest_fmt_calc();
+    failed += casio_selftest_timer();
+    failed += casio_selftest_preempt();
+
+    Serial.printf("selftest %s, %d failed\r\n", failed ? "FAIL" : "ok", failed);
+
+    return failed;
 }
 
-void draw_text(char *frame, const char *str)
+//////////////////////////////////////////////////////////////////////
+// soak test
+//
+// Serial command 'o'. Runs SOAK_INSTANCES independent headless watches,
+// one after the other, each fed its own random stream of keys and time
+// jumps. After every event the instance is checked:
+//
+//  - the displayed date/time never goes backwards
+//  - the stopwatch readings are consistent (start <= split/stop <= now)
+//  - nothing was drawn outside the screen (c->draw.offscreen)
+//
+// Everything an instance changes is its own: the CASIO (clock, epoch,
+// drawing state, see casio_render()), its random state and its frame.
+// A headless instance never touches DEVICE or the display, and the
+// shared tables (AsciiMap, CasioFont, FontMetrics) are read only once
+// setup is done. So tools/host/farm.cpp can run thousands of them on
+// every core of a build box through casio_soak_init()/casio_soak_run();
+// the Teensy has one core and runs SOAK_INSTANCES here. Throughput is
+// reported in events per second.
+//
+#define SOAK_INSTANCES  64
+#define SOAK_EVENTS     2000        // per instance
+
+typedef struct {
+    CASIO c;
+    unsigned long rand;             // xorshift32 state
+    DATE_TIME last;                 // last time seen on the home screen
+    unsigned long events;
+    unsigned long failures;
+} SOAK;
+
+unsigned long casio_soak_rand(SOAK *s)
 {
-    draw_ascii_string(frame, 25, 0, 2, str);
+    unsigned long x = s->rand;
+
+    x ^= (x << 13) & 0xffffffffUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xffffffffUL;
+    s->rand = x;
+
+    return x;
 }
 
-void draw_main(char *frame, const char *str)
+//
+// compare two times: <0, 0, >0
+//
+long casio_soak_cmp(DATE_TIME *a, DATE_TIME *b)
 {
-    draw_segstr(frame, 10, 20, 6, 10, 2, str);
+    if( a->date.year != b->date.year )       return a->date.year - b->date.year;
+    if( a->date.month != b->date.month )     return a->date.month - b->date.month;
+    if( a->date.day != b->date.day )         return a->date.day - b->date.day;
+    if( a->time.hours != b->time.hours )     return a->time.hours - b->time.hours;
+    if( a->time.minutes != b->time.minutes ) return a->time.minutes - b->time.minutes;
+    return a->time.seconds - b->time.seconds;
 }
 
-void draw_secondary(char *frame, const char *str)
+void casio_soak_fail(SOAK *s, int n, const char *what)
 {
-    draw_segstr(frame, 15, 52, 4, 4, 1, str);
+    if( s->failures++ == 0 )
+        Serial.printf("soak %d: %s after %lu events\r\n", n, what, s->events);
 }
 
-void draw_hline(char *frame, int x0, int y0, int len)
+//
+// pick the next random event, moving time forward as needed
+//
+int casio_soak_event(SOAK *s)
 {
-    int i, x;
+    static const int buttons[] = {
+        E_BUTTONA, E_BUTTONB, E_BUTTONC, E_BUTTONL,
+        E_BUTTONA_RELEASE, E_BUTTONB_RELEASE, E_BUTTONC_RELEASE, E_BUTTONL_RELEASE,
+    };
+    unsigned long r;
+    long secs;
 
-    x = x0;
-    for(i=0; i < len; i++)
+    r = casio_soak_rand(s);
+
+    switch(r % 8)
     {
-        disp_pset(frame, x++, y0, 1);
+    case 0:
+    case 1:
+    case 2:
+        // seconds tick, sometimes a long jump
+        secs = ((r >> 8) % 16 == 0) ? (long)((r >> 12) % (30*24*3600L)) : 1;
+        s->c.epoch += secs;
+        s->c.clock += secs*100;
+        return E_SECONDS_TIMER;
+
+    case 3:
+        s->c.clock += 15;
+        return casio_wants_seconds15(&s->c) ? E_SECONDS15 : E_NONE;
+
+    case 4:
+    case 5:
+        return E_HEX_BUTTON_0 + (r >> 8) % (E_HEX_BUTTON_POUND_RELEASE - E_HEX_BUTTON_0 + 1);
+
+    case 6:
+        return buttons[(r >> 8) % 8];
+
+    default:
+        return E_LIGHT_OFF;
     }
 }
 
-void draw_vline(char *frame, int x0, int y0, int len)
+void casio_soak_check(SOAK *s, int n, int e, unsigned long offscreen)
 {
-    int i, y;
+    CASIO *c = &s->c;
+    long now;
+
+    if( e == E_SECONDS_TIMER )
+    {
+        if( casio_soak_cmp(&c->home.now, &s->last) < 0 )
+            casio_soak_fail(s, n, "time went backwards");
+        s->last = c->home.now;
+    }
 
-    y = y0;
-    for(i=0; i < len; i++)
+    // (differences, so the checks survive the clock wrapping)
+    now = c->clock;
+    if( c->st.flags.running )
+    {
+        if( now - c->st.timer_start < 0 )
+            casio_soak_fail(s, n, "stopwatch started in the future");
+        if( c->st.flags.split
+            && (c->st.timer_split - c->st.timer_start < 0 || now - c->st.timer_split < 0) )
+        {
+            casio_soak_fail(s, n, "split outside of the run");
+        }
+    }
+    else if( c->st.timer_stop - c->st.timer_start < 0 )
     {
-        disp_pset(frame, x0, y++, 1);
+        casio_soak_fail(s, n, "stopwatch stopped before it started");
     }
+
+    if( c->draw.offscreen != offscreen )
+        casio_soak_fail(s, n, "drew outside the screen");
 }
 
-//////////////////////////////////////////////////////////////////////
-// end DRAW
-//////////////////////////////////////////////////////////////////////
+void casio_soak_init(SOAK *s, int n)
+{
+    casio_init(&s->c);
+    s->c.headless = 1;
+    s->rand = 0x9e3779b9UL * (n + 1);
+    s->last = epoch_to_date_time(s->c.epoch);
+    s->events = 0;
+    s->failures = 0;
+}
 
-//////////////////////////////////////////////////////////////////////
 //
-// begin CASIO
+// run instance 'n' for 'count' random events (some are E_NONE and
+// skipped), drawing into 'frame'
 //
-//////////////////////////////////////////////////////////////////////
+void casio_soak_run(SOAK *s, int n, int count, char *frame)
+{
+    unsigned long offscreen;
+    int i, e;
 
-typedef enum {
-    M_HOME,
-    M_HOME_SET,
-    M_DB,
-    M_DB_SET,
-    M_CAL,
-    M_EX,
-    M_ST,
-    M_AL,
-    M_AL_SET,
-    M_DT,
-    M_DT_SET,
-} MODE;
+    for(i=0; i < count; i++)
+    {
+        e = casio_soak_event(s);
+        if( e == E_NONE )
+            continue;
 
-typedef enum {
-    L_ENG,      // 0 - english
-    L_POR,      // 1 - portuguese
-    L_ESP,      // 2 - spanish
-    L_FRA,      // 3 - french
-    L_NED,      // 4 - dutch
-    L_DAN,      // 5 - danish
-    L_DEU,      // 6 - german
-    L_ITA,      // 7 - italian
-    L_SVE,      // 8 - swedish
-    L_POL,      // 9 - polish
-    L_ROM,      // 10 - romanian
-    L_TUR,      // 11 - turkish
-    L_RUS,      // 12 - russian
-} LANG;
+        offscreen = s->c.draw.offscreen;
+        casio_process_event(e, &s->c);
+        casio_render(frame, &s->c);
+        s->events++;
+        casio_soak_check(s, n, e, offscreen);
+    }
+}
 
-//
-// day of week table
-//
-// ENG  SUN MON TUE WED THU FRI SAT
-// POR  DOM SEG TER QUA QUI SEX S\000B
-// ESP  DOM LUN MAR MI\000 JUE VIE S\000B
-// FRA  DIM LUN MAR MER JEU VEN SAM
-// NED  ZON MAA DIN WOE DON VRI ZAT
-// DAN  S\000N MAN TIR ONS TOR FRE L\000R
-// DEU  SON MON DIE MIT DON FRE SAM
-// ITA  DOM LUN MAR MER GIO VEN SAB
-// SVE  S\000N M\000N TIS ONS TOR FRE L\000R
-// POL  NIE PON WTO \000RO CZE PI\000 SOB
-// ROM  DUM LUN MAR MIE JOI VIN S\000M
-// TUR  PAZ PZT SAL \000AR PER CUM CTS
-// PYC  BC \000H B\000 CP \000\000 \000\000 C\000
-//
+void casio_soak()
+{
+    static SOAK farm[SOAK_INSTANCES];
+    char frame[FRAME_SIZE];
+    unsigned long start, elapsed, events, failed;
+    int n;
+
+    for(n=0; n < SOAK_INSTANCES; n++)
+        casio_soak_init(&farm[n], n);
+
+    start = micros();
+
+    for(n=0; n < SOAK_INSTANCES; n++)
+        casio_soak_run(&farm[n], n, SOAK_EVENTS, frame);
+
+    elapsed = micros() - start;
+
+    events = 0;
+    failed = 0;
+    for(n=0; n < SOAK_INSTANCES; n++)
+    {
+        events += farm[n].events;
+        if( farm[n].failures )
+            failed++;
+    }
+
+    Serial.printf("soak %d instances %lu events %lu us %lu events/s, %lu failed\r\n",
+            SOAK_INSTANCES, events, elapsed,
+            elapsed ? (unsigned long)((events * 1000000.0) / elapsed) : 0,
+            failed);
+}
 
+//////////////////////////////////////////////////////////////////////
+// time warp
 //
-// language table
+// Serial command 'w'. Runs a headless watch through WarpPhases, each a
+// start time, a jump and a number of jumps, from single seconds up to
+// whole years. Between them they cross leap days, year ends and the
+// signed (2038) and unsigned (2106) 32 bit rollovers of the epoch.
 //
-// ENG
-// POR
-// ESP
-// FRA
-// NED
-// DAN
-// DEU
-// ITA
-// SVE
-// POL
-// ROM
-// T\000R
-// \000\000\000
+// Every jump is sent as an E_SECONDS_TIMER and the date/time the watch
+// shows is checked against warp_reference(), which works the date out
+// the slow way (year by year, then month by month, Zeller for the day
+// of the week) and shares no code with epoch_to_date_time(). The round
+// trip through date_time_to_epoch() is checked as well.
+//
+// The mode changes every WARP_MODE_EVERY jumps so all the screens see
+// the odd dates, and only every WARP_RENDER_EVERY'th jump is drawn to
+// keep the pace up. The 1/100 s clock moves one second per jump, so it
+// can't overflow. start + n*step is worked out in 64 bits and a phase
+// stops at the end of the epoch (2106-02-07 06:28:15) rather than wrap
+// back to 1970. Throughput is reported in simulated days per second.
 //
 
-typedef struct {
-    char hours;     // 0-23
-    char minutes;   // 0-59
-    char seconds;   // 0-59
-} TIME;
+#define WARP_RENDER_EVERY   64
+#define WARP_MODE_EVERY     4096
 
 typedef struct {
-    char day;
-    char month;
-    short year;
-    char dow;       // 0=sun 1=mon 2=tue 3=wed 4=thu 5=fri 6=sat
-} DATE;
+    unsigned long start;
+    unsigned long step;         // seconds
+    unsigned long count;
+} WARP;
+
+static const WARP WarpPhases[] = {
+    { 1708992000UL,             1,              200000 },   // 2024-02-27, leap day
+    { 1703462400UL,             59,             600000 },   // 2023-12-25, over a year
+    { 0,                        3607,           400000 },   // 1970, ~45 years of hours
+    { 0,                        86399,          49710 },    // 1970 to 2106-02-05 in days
+    { 0x7fffffffUL - 99999,     1,              200000 },   // 2038
+    { 0xffffffffUL - 199999,    1,              200000 },   // 2106, ends on the last second
+    { 0,                        365*86400UL+1,  136 },      // years
+};
 
-typedef struct {
-    DATE date;
-    TIME time;
-} DATE_TIME;
+#define WARP_PHASES (int)(sizeof(WarpPhases) / sizeof(WarpPhases[0]))
 
-typedef struct {
-    char hours;     // 0-23
-    char minutes;   // 0-59
-    char seconds;   // 0-59
-    char ks;        // 0-99
-} TIMER;
+DATE_TIME warp_reference(unsigned long t)
+{
+    DATE_TIME r;
+    unsigned long days, len;
+    int y, m, q, k, j;
 
-typedef struct {
-    char    mode;
+    r.time.seconds = t % 60;
+    r.time.minutes = t / 60 % 60;
+    r.time.hours = t / 3600 % 24;
 
-    // home screen
-    struct home {
-        struct {
-            int light : 1;
-            int hrs24 : 1;
-            int show_db : 1;
-            int show_dt : 1;
-        } flags;
-        DATE_TIME   dt;
-        DATE_TIME   now;
-        char        lang;
-        char        contrast;
-    } home;
+    days = t / 86400;
+    for(y=1970; ; y++)
+    {
+        len = IsLeapYear(y) ? 366 : 365;
+        if( days < len )
+            break;
+        days -= len;
+    }
+    for(m=1; ; m++)
+    {
+        if( m == 2 )
+            len = IsLeapYear(y) ? 29 : 28;
+        else if( m == 4 || m == 6 || m == 9 || m == 11 )
+            len = 30;
+        else
+            len = 31;
+        if( days < len )
+            break;
+        days -= len;
+    }
 
-    // DB
-    struct {
-        char flags;
-        char init;
-        char text[10];
-        char pos;
-        char digits[15];
-        char page;
-    } db;
+    r.date.year = y;
+    r.date.month = m;
+    r.date.day = days + 1;
 
-    // Calculator
-    struct {
-        char flags;
-        char current[15];
-        char op;
-        double acc;
-    } cal;
+    // Zeller's congruence, january and february count as months 13 and
+    // 14 of the year before. h = 0 is a saturday.
+    q = (m < 3) ? m + 12 : m;
+    k = (m < 3) ? y - 1 : y;
+    j = k / 100;
+    k = k % 100;
+    r.date.dow = ((r.date.day + 13*(q+1)/5 + k + k/4 + j/4 + 5*j) % 7 + 6) % 7;
 
-    // Alarms
-    struct {
-        char        flags;
-        DATE_TIME   alarms[5];
-        char        pos;
-    } al;
+    return r;
+}
 
-    // Dual time mode
-    struct {
-        struct {
-            int show_db : 1;
-            int show_home : 1;
-        } flags;
-        char        tz[3];
-        DATE_TIME   dt;
-    } dt;
+void casio_warp()
+{
+    CASIO c;
+    char frame[FRAME_SIZE];
+    DATE_TIME ref;
+    unsigned long long t64;
+    unsigned long n, t, start, elapsed, errors, offscreen;
+    double days;
+    int phase;
 
-    // Stop watch
-    struct {
-        struct {
-            int running : 1;
-            int split : 1;
-        } flags;
-        long    timer_start;
-        long    timer_stop;
-        long    timer_split;
-    } st;
-} CASIO;
+    for(phase=0; phase < WARP_PHASES; phase++)
+    {
+        casio_init(&c);
+        c.headless = 1;
+        errors = 0;
+        offscreen = c.draw.offscreen;
+        start = micros();
 
-TIMER timer_set_from_100ths(long diff)
-{
-    TIMER result;
+        for(n=0; n < WarpPhases[phase].count; n++)
+        {
+            t64 = WarpPhases[phase].start + (unsigned long long)n * WarpPhases[phase].step;
+            if( t64 > 0xffffffffULL )
+                break;
+            t = (unsigned long)t64;
 
-    const int SECONDS_PER = (100);
-    const int MINUTES_PER = (100*60);
-    const int HOURS_PER = (100*60*60);
+            c.epoch = t;
+            c.clock += 100;
 
-    result.hours = diff / HOURS_PER;
-    diff -= result.hours * HOURS_PER;
+            if( n % WARP_MODE_EVERY == WARP_MODE_EVERY-1 )
+                casio_process_event(E_BUTTONB, &c);
+            casio_process_event(E_SECONDS_TIMER, &c);
 
-    result.minutes = diff / MINUTES_PER;
-    diff -= result.minutes * MINUTES_PER;
+            if( n % WARP_RENDER_EVERY == 0 )
+                casio_render(frame, &c);
 
-    result.seconds = diff / SECONDS_PER;
-    diff -= result.seconds * SECONDS_PER;
+            ref = warp_reference(t);
+            if( casio_soak_cmp(&c.home.now, &ref) != 0
+                || c.home.now.date.dow != ref.date.dow
+                || date_time_to_epoch(&c.home.now) != t )
+            {
+                if( errors++ == 0 )
+                    Serial.printf("warp: %lu shows %d-%02d-%02d %02d:%02d:%02d, should be %d-%02d-%02d %02d:%02d:%02d\r\n",
+                            t, c.home.now.date.year, c.home.now.date.month, c.home.now.date.day,
+                            c.home.now.time.hours, c.home.now.time.minutes, c.home.now.time.seconds,
+                            ref.date.year, ref.date.month, ref.date.day,
+                            ref.time.hours, ref.time.minutes, ref.time.seconds);
+            }
+        }
 
-    result.ks = diff;
-    return result;
+        elapsed = micros() - start;
+        days = (double)n * WarpPhases[phase].step / 86400.0;
+
+        Serial.printf("warp %d: step %lu s, %lu steps, %lu days in %lu us (%lu days/s), %lu errors%s\r\n",
+                phase, WarpPhases[phase].step, n,
+                (unsigned long)days, elapsed,
+                elapsed ? (unsigned long)(days * 1000000.0 / elapsed) : 0,
+                errors, c.draw.offscreen != offscreen ? ", drew outside the screen" : "");
+    }
 }
 
-DATE_TIME epoch_to_date_time(long epoch)
+//////////////////////////////////////////////////////////////////////
+// event log
+//
+// Records every event the live watch processes, with its time stamp,
+// so a session can be replayed deterministically. Recording starts
+// with a copy of the whole CASIO state, so it can start at any time.
+//
+// Each event is stored as:
+//
+//      event               1 byte
+//      clock delta         varint, 1/100ths since the previous event
+//      epoch delta         varint, seconds since the previous event
+//
+// (varint: 7 bits per byte, low bits first, high bit set = more follows)
+// A typical event takes 3 bytes, so the 16 KB buffer holds well over an
+// hour of normal use.
+//
+// The hash of the frame after every event is folded into a digest.
+// Replaying at full speed ('p') renders the same frames headless and
+// compares the digest, so any non-determinism shows up. 'P' replays on
+// the display at the recorded pace.
+//
+// 'd' sends the log in the same framing as the frame mirror:
+//
+//      0xA5 'L' 0 0 len-lo len-hi
+//      state size (2 bytes), start state, digest (4), event count (4),
+//      events...
+//
+// The start state is written field by field (casio_state_save()), all
+// little endian with fixed sizes, so a host build with its own struct
+// layout can load it: tools/host/replay.cpp replays a dump and checks
+// the digest. Derived state (the timer caches, DRAW) isn't written, it
+// is rebuilt by the first frame.
+//
+
+#define LOG_SIZE    16384
+
+static struct
 {
-    static unsigned char month_days[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
-    static unsigned char week_days[7] = {4,5,6,0,1,2,3};
-    // Thu=4, Fri=5, Sat=6, Sun=0, Mon=1, Tue=2, Wed=3
+    int recording;
+    CASIO *live;                // the watch being recorded
+    CASIO start;                // state when recording started
+    long clock;                 // time of the last recorded event
+    unsigned long epoch;
+    unsigned long digest;       // hash of the frames after every event
+    unsigned long events;
+    int len;
+    unsigned char buf[LOG_SIZE];
+} LOG;
 
-    unsigned char ntp_hour, ntp_minute, ntp_second;
-    unsigned char ntp_week_day, ntp_date, ntp_month, leap_days;
-    unsigned short temp_days;
-    unsigned int ntp_year, days_since_epoch, day_of_year;
+int casio_log_put_varint(unsigned long v)
+{
+    do {
+        if( LOG.len >= LOG_SIZE )
+            return -1;
+        LOG.buf[LOG.len++] = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+        v >>= 7;
+    } while( v );
 
-    DATE_TIME result;
+    return 0;
+}
 
-    leap_days = 0;
-    
-    // Add or substract time zone here. 
-    epoch += 0; //GMT +5:30 = +19800 seconds 
-    
-    ntp_second = epoch%60;
-    epoch /= 60;
-    ntp_minute = epoch%60;
-    epoch /= 60;
-    ntp_hour    = epoch%24;
-    epoch /= 24;
-        
-    days_since_epoch = epoch;                       // number of days since epoch
-    ntp_week_day = week_days[days_since_epoch%7];   // Calculating WeekDay
-      
-    ntp_year = 1970+(days_since_epoch/365);         // ball parking year, may not be accurate!
- 
-    int i;
-    for(i=1972; i<ntp_year; i+=4)                   // Calculating number of leap days since epoch/1970
-        if( ((i%4==0) && (i%100!=0)) || (i%400==0) ) leap_days++;
-            
-    // Calculating accurate current year by (days_since_epoch - extra leap days)
-    ntp_year = 1970 + ((days_since_epoch - leap_days)/365);
-    day_of_year = ((days_since_epoch - leap_days)%365)+1;
+unsigned long casio_log_get_varint(const unsigned char *buf, int len, int *pos)
+{
+    unsigned long v;
+    int shift;
 
-    if( ((ntp_year%4==0) && (ntp_year%100!=0)) || (ntp_year%400==0) )
+    v = 0;
+    shift = 0;
+    while( *pos < len )
     {
-        month_days[1] = 29;    // February = 29 days for leap years
-    }
-    else
-    {
-        month_days[1] = 28;     // February = 28 days for non-leap years 
+        v |= (unsigned long)(buf[*pos] & 0x7f) << shift;
+        shift += 7;
+        if( (buf[(*pos)++] & 0x80) == 0 )
+            break;
     }
 
-    temp_days = 0;
-   
-    for(ntp_month=0 ; ntp_month <= 11 ; ntp_month++)    // calculating current Month
+    return v;
+}
+
+//
+// the start state, field by field: 'n' byte little endian numbers,
+// longs are 4 bytes whatever the build's long is
+//
+#define CASIO_STATE_SIZE    156
+
+unsigned char *casio_state_put(unsigned char *p, unsigned long v, int n)
+{
+    while( n-- > 0 )
     {
-        if (day_of_year <= temp_days) break; 
-        temp_days = temp_days + month_days[ntp_month];
+        *p++ = v & 0xff;
+        v >>= 8;
     }
-    
-    temp_days = temp_days - month_days[ntp_month-1]; //calculating current Date
-    ntp_date = day_of_year - temp_days;
 
-    result.date.year = ntp_year;
-    result.date.month = ntp_month;
-    result.date.day = ntp_date;
-    result.date.dow = ntp_week_day;
+    return p;
+}
+
+unsigned long casio_state_get(const unsigned char **p, int n)
+{
+    unsigned long v;
+    int i;
 
-    result.time.hours = ntp_hour;
-    result.time.minutes = ntp_minute;
-    result.time.seconds = ntp_second;
+    v = 0;
+    for(i=0; i < n; i++)
+        v |= (unsigned long)(*p)[i] << (i*8);
+    *p += n;
 
-    return result;
+    return v;
 }
 
-long date_time_to_epoch(DATE_TIME *goal)
+long casio_state_get_long(const unsigned char **p)
 {
-#define IsLeapYear(y) ( ((y%4==0) && (y%100!=0)) || (y%400==0) )
+    unsigned long v = casio_state_get(p, 4);
 
-    static unsigned char month_days[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
-    const int SEC_PER_DAY = 24*60*60;
-    int i;
-    long epoch;
+    if( v & 0x80000000UL )
+        return -(long)(0xffffffffUL - v) - 1;
+    return (long)v;
+}
 
-    epoch = (goal->date.year - 1970) * 365 * SEC_PER_DAY;
+unsigned char *casio_state_put_chars(unsigned char *p, const char *s, int n)
+{
+    while( n-- > 0 )
+        *p++ = *s++;
 
-    for(i=1970; i < goal->date.year; i++)
-    {
-        if( IsLeapYear(i) )
-        {
-            epoch += SEC_PER_DAY;
-        }
-    }
+    return p;
+}
 
-    for(i=1; i < goal->date.month; i++)
-    {
-        if( i == 2 && IsLeapYear(goal->date.year) )
-            epoch += 29 * SEC_PER_DAY;
-        else
-            epoch += month_days[i-1] * SEC_PER_DAY;
-    }
+void casio_state_get_chars(const unsigned char **p, char *s, int n)
+{
+    while( n-- > 0 )
+        *s++ = *(*p)++;
+}
 
-    epoch += (goal->date.day-1) * SEC_PER_DAY;
-    epoch += goal->time.hours * 3600;
-    epoch += goal->time.minutes * 60;
-    epoch += goal->time.seconds;
+unsigned char *casio_state_put_dt(unsigned char *p, const DATE_TIME *dt)
+{
+    p = casio_state_put(p, dt->date.day, 1);
+    p = casio_state_put(p, dt->date.month, 1);
+    p = casio_state_put(p, dt->date.year, 2);
+    p = casio_state_put(p, dt->date.dow, 1);
+    p = casio_state_put(p, dt->time.hours, 1);
+    p = casio_state_put(p, dt->time.minutes, 1);
+    return casio_state_put(p, dt->time.seconds, 1);
+}
 
-    return epoch;
+void casio_state_get_dt(const unsigned char **p, DATE_TIME *dt)
+{
+    dt->date.day = casio_state_get(p, 1);
+    dt->date.month = casio_state_get(p, 1);
+    dt->date.year = (short)casio_state_get(p, 2);
+    dt->date.dow = casio_state_get(p, 1);
+    dt->time.hours = casio_state_get(p, 1);
+    dt->time.minutes = casio_state_get(p, 1);
+    dt->time.seconds = casio_state_get(p, 1);
 }
 
-int casio_disp_hours(int hrs24, int hours)
+//
+// write 'c' to 'buf' (CASIO_STATE_SIZE bytes), returns the size
+//
+int casio_state_save(const CASIO *c, unsigned char *buf)
 {
-    if( ! hrs24 ) {
-        if( hours > 12 )
-            hours -= 12;
-        if( hours == 0 )
-            hours = 12;
-    }
-    return hours;
+    unsigned char *p = buf;
+    unsigned long long acc;
+    int i;
+
+    p = casio_state_put(p, c->mode, 1);
+    p = casio_state_put(p, c->clock, 4);
+    p = casio_state_put(p, c->epoch, 4);
+
+    p = casio_state_put(p, (c->home.flags.light != 0) | (c->home.flags.hrs24 != 0) << 1
+            | (c->home.flags.show_db != 0) << 2 | (c->home.flags.show_dt != 0) << 3
+            | (c->home.flags.light_held != 0) << 4, 1);
+    p = casio_state_put_dt(p, &c->home.dt);
+    p = casio_state_put_dt(p, &c->home.now);
+    p = casio_state_put(p, c->home.lang, 1);
+    p = casio_state_put(p, c->home.contrast, 1);
+
+    p = casio_state_put(p, c->db.flags, 1);
+    p = casio_state_put(p, c->db.init, 1);
+    p = casio_state_put_chars(p, c->db.text, sizeof(c->db.text));
+    p = casio_state_put(p, c->db.pos, 1);
+    p = casio_state_put_chars(p, c->db.digits, sizeof(c->db.digits));
+    p = casio_state_put(p, c->db.page, 1);
+
+    memcpy(&acc, &c->cal.acc, sizeof(acc));
+    p = casio_state_put(p, c->cal.flags, 1);
+    p = casio_state_put_chars(p, c->cal.current, sizeof(c->cal.current));
+    p = casio_state_put(p, c->cal.op, 1);
+    p = casio_state_put(p, (unsigned long)(acc & 0xffffffffUL), 4);
+    p = casio_state_put(p, (unsigned long)(acc >> 32), 4);
+
+    p = casio_state_put(p, c->al.flags, 1);
+    for(i=0; i < 5; i++)
+        p = casio_state_put_dt(p, &c->al.alarms[i]);
+    p = casio_state_put(p, c->al.pos, 1);
+
+    p = casio_state_put(p, (c->dt.flags.show_db != 0) | (c->dt.flags.show_home != 0) << 1, 1);
+    p = casio_state_put_chars(p, c->dt.tz, sizeof(c->dt.tz));
+    p = casio_state_put_dt(p, &c->dt.dt);
+
+    p = casio_state_put(p, (c->st.flags.running != 0) | (c->st.flags.split != 0) << 1
+            | (c->st.flags.live != 0) << 2, 1);
+    p = casio_state_put(p, c->st.timer_start, 4);
+    p = casio_state_put(p, c->st.timer_stop, 4);
+    p = casio_state_put(p, c->st.timer_split, 4);
+
+    p = casio_state_put(p, c->power.policy, 1);
+    p = casio_state_put(p, c->power.inverted, 1);
+    p = casio_state_put(p, c->power.contrast, 1);
+    p = casio_state_put(p, c->power.last_key, 4);
+
+    return p - buf;
 }
 
-void casio_update_db_screen(char *frame, CASIO *c);
-void casio_update_dt_screen(char *frame, CASIO *c);
+//
+// read a state written by casio_state_save() into a fresh, headless
+// 'c'. Returns -1 if 'len' isn't the size of one.
+//
+int casio_state_load(CASIO *c, const unsigned char *buf, int len)
+{
+    const unsigned char *p = buf;
+    unsigned long long acc;
+    unsigned long b;
+    int i;
 
-void casio_update_home_screen(char *frame, CASIO *c)
+    if( len != CASIO_STATE_SIZE )
+        return -1;
+
+    casio_init(c);
+    c->headless = 1;
+    c->st.run.diff = -1;        // no cached times, see timer_cached()
+    c->st.split.diff = -1;
+
+    c->mode = casio_state_get(&p, 1);
+    c->clock = casio_state_get_long(&p);
+    c->epoch = casio_state_get(&p, 4);
+
+    b = casio_state_get(&p, 1);
+    c->home.flags.light = b & 1;
+    c->home.flags.hrs24 = b >> 1 & 1;
+    c->home.flags.show_db = b >> 2 & 1;
+    c->home.flags.show_dt = b >> 3 & 1;
+    c->home.flags.light_held = b >> 4 & 1;
+    casio_state_get_dt(&p, &c->home.dt);
+    casio_state_get_dt(&p, &c->home.now);
+    c->home.lang = casio_state_get(&p, 1);
+    c->home.contrast = casio_state_get(&p, 1);
+
+    c->db.flags = casio_state_get(&p, 1);
+    c->db.init = casio_state_get(&p, 1);
+    casio_state_get_chars(&p, c->db.text, sizeof(c->db.text));
+    c->db.pos = casio_state_get(&p, 1);
+    casio_state_get_chars(&p, c->db.digits, sizeof(c->db.digits));
+    c->db.page = casio_state_get(&p, 1);
+
+    c->cal.flags = casio_state_get(&p, 1);
+    casio_state_get_chars(&p, c->cal.current, sizeof(c->cal.current));
+    c->cal.op = casio_state_get(&p, 1);
+    acc = casio_state_get(&p, 4);
+    acc |= (unsigned long long)casio_state_get(&p, 4) << 32;
+    memcpy(&c->cal.acc, &acc, sizeof(acc));
+
+    c->al.flags = casio_state_get(&p, 1);
+    for(i=0; i < 5; i++)
+        casio_state_get_dt(&p, &c->al.alarms[i]);
+    c->al.pos = casio_state_get(&p, 1);
+
+    b = casio_state_get(&p, 1);
+    c->dt.flags.show_db = b & 1;
+    c->dt.flags.show_home = b >> 1 & 1;
+    casio_state_get_chars(&p, c->dt.tz, sizeof(c->dt.tz));
+    casio_state_get_dt(&p, &c->dt.dt);
+
+    b = casio_state_get(&p, 1);
+    c->st.flags.running = b & 1;
+    c->st.flags.split = b >> 1 & 1;
+    c->st.flags.live = b >> 2 & 1;
+    c->st.timer_start = casio_state_get_long(&p);
+    c->st.timer_stop = casio_state_get_long(&p);
+    c->st.timer_split = casio_state_get_long(&p);
+
+    c->power.policy = casio_state_get(&p, 1);
+    c->power.inverted = casio_state_get(&p, 1);
+    c->power.contrast = casio_state_get(&p, 1);
+    c->power.last_key = casio_state_get_long(&p);
+
+    return 0;
+}
+
+//
+// called by casio_run() after each event has been processed. The frame
+// is drawn here, as casio_run() may fold several events into one.
+//
+void casio_log_event(CASIO *c, int e)
 {
-    DATE_TIME *d;
-    const char *w;
-    char buf[20];
-    int hours;
+    char frame[FRAME_SIZE];
+    int len;
 
-    if( c->home.flags.show_db )
+    if( ! LOG.recording )
+        return;
+
+    len = LOG.len;
+    LOG.buf[LOG.len++] = e;
+    if( casio_log_put_varint(c->clock - LOG.clock)
+        || casio_log_put_varint(c->epoch - LOG.epoch)
+        || LOG.len >= LOG_SIZE )
     {
-        casio_update_db_screen(frame, c);
+        LOG.len = len;
+        LOG.recording = 0;
+        Serial.printf("log full, %lu events\r\n", LOG.events);
         return;
     }
-    else if( c->home.flags.show_dt )
+
+    LOG.clock = c->clock;
+    LOG.epoch = c->epoch;
+    casio_render(frame, c);
+    LOG.digest = (LOG.digest ^ disp_hash(frame)) * 16777619UL;
+    LOG.events++;
+}
+
+void casio_log_start(CASIO *c)
+{
+    LOG.start = *c;
+    LOG.clock = c->clock;
+    LOG.epoch = c->epoch;
+    LOG.digest = 2166136261UL;
+    LOG.events = 0;
+    LOG.len = 0;
+    LOG.recording = 1;
+}
+
+//
+// play 'len' bytes of logged events on the headless 'c', returns the
+// digest of the frames and the number of events in *events. With
+// 'realtime' set each frame is also sent to the display, at the pace
+// it was recorded.
+//
+unsigned long casio_log_play(CASIO *c, const unsigned char *buf, int len,
+        unsigned long *events, int realtime)
+{
+    char frame[FRAME_SIZE];
+    unsigned long digest, start, due;
+    long clock0;
+    int pos, e;
+
+    clock0 = c->clock;
+    digest = 2166136261UL;
+    *events = 0;
+    pos = 0;
+    start = micros();
+
+    while( pos < len )
     {
-        casio_update_dt_screen(frame, c);
-        return;
+        e = buf[pos++];
+        c->clock += casio_log_get_varint(buf, len, &pos);
+        c->epoch += casio_log_get_varint(buf, len, &pos);
+
+        casio_process_event(e, c);
+        casio_render(frame, c);
+        digest = (digest ^ disp_hash(frame)) * 16777619UL;
+        (*events)++;
+
+        if( realtime )
+        {
+            due = (c->clock - clock0) * 10000UL;
+            while( micros() - start < due )
+                ;
+            disp_update(frame);
+        }
     }
 
-    d = &c->home.now;
+    return digest & 0xffffffffUL;
+}
+
+//
+// replay the log into a headless copy of the starting state
+//
+void casio_log_replay(int realtime)
+{
+    CASIO c;
+    unsigned long digest, n, start, elapsed;
+
+    c = LOG.start;
+    c.headless = 1;
+    start = micros();
 
-    hours = casio_disp_hours(c->home.flags.hrs24, d->time.hours);
+    digest = casio_log_play(&c, LOG.buf, LOG.len, &n, realtime);
 
-    if( ! c->home.flags.hrs24 )
+    elapsed = micros() - start;
+    Serial.printf("replay %lu events %lu us %s\r\n", n, elapsed,
+            digest != (LOG.digest & 0xffffffffUL) ? "MISMATCH" : "ok");
+}
+
+void casio_log_dump()
+{
+    unsigned char hdr[6 + 2 + CASIO_STATE_SIZE + 8];
+    unsigned char *p;
+
+    p = hdr;
+    *p++ = MIRROR_SYNC;
+    *p++ = 'L';
+    *p++ = 0;
+    *p++ = 0;
+    p = casio_state_put(p, 2 + CASIO_STATE_SIZE + 8 + LOG.len, 2);
+    p = casio_state_put(p, CASIO_STATE_SIZE, 2);
+    p += casio_state_save(&LOG.start, p);
+    p = casio_state_put(p, LOG.digest, 4);
+    p = casio_state_put(p, LOG.events, 4);
+    Serial.write(hdr, p - hdr);
+
+    Serial.write(LOG.buf, LOG.len);
+}
+
+void casio_log_command(int ch)
+{
+    switch(ch)
     {
-        if( d->time.hours < 12 )
-            draw_am1(frame);
+    case 'r':
+        if( LOG.recording )
+        {
+            LOG.recording = 0;
+            Serial.printf("log stopped, %lu events %d bytes\r\n", LOG.events, LOG.len);
+        }
+        else if( LOG.live )
+        {
+            casio_log_start(LOG.live);
+            Serial.printf("log started\r\n");
+        }
+        break;
+    case 'd':
+        casio_log_dump();
+        break;
+    case 'p':
+    case 'P':
+        if( LOG.recording )
+            Serial.printf("stop recording first\r\n");
         else
-            draw_pm1(frame);
+            casio_log_replay(ch == 'P');
+        break;
     }
+}
 
-    snprintf(buf, sizeof(buf), "%2d:%02d %02d",
-                    hours,
-                    d->time.minutes,
-                    d->time.seconds);
-    draw_main(frame, buf);
+//////////////////////////////////////////////////////////////////////
+// fuzzing
+//
+// casio_fuzz_input() turns any byte string into a session on a fresh
+// headless watch, in the event log encoding (event byte, clock delta,
+// epoch delta). Events are taken modulo the number of events and the
+// time steps are capped at an hour, so every input is a valid session
+// and a run can't overflow the clocks. The events of a dumped log
+// ('d', everything after the event count) make good seeds.
+//
+// Every event is processed and rendered, then checked like the soak
+// test: a known mode and nothing drawn outside the screen. Returns 0 if
+// the input ran clean.
+//
+// Built on the host with -DCASIO_FUZZ (tools/host, "make fuzz" for
+// libFuzzer or "make fuzz-asan" for a plain driver, both with ASan and
+// UBSan), the entry point below aborts on a failed check so the input
+// is saved. On the watch, serial command 'z' runs FUZZ_RUNS random
+// inputs.
+//
+// Don't expect the usual libFuzzer rates. Every event is rendered, a
+// few microseconds each, and an input is hundreds of events: random
+// inputs of up to 1 KB run at about 4k execs/s on one desktop core
+// without sanitizers and 1.5-2k execs/s under ASan (and UBSan), nowhere
+// near 100k. Coverage comes from letting it run and from the seeds;
+// -max_len=256 gets it to about 5k under ASan.
+//
 
-    snprintf(buf, sizeof(buf), "%2d %02d %2d-%2d",
-                    d->date.year / 100,
-                    d->date.year % 100,
-                    d->date.month,
-                    d->date.day);
+#define FUZZ_MAX_EVENTS 4096
+#define FUZZ_MAX_STEP   3600L       // seconds
+#define FUZZ_RUNS       2000
+#define FUZZ_LEN        256
 
-    draw_secondary(frame, buf);
+unsigned long casio_fuzz_varint(const unsigned char *data, int len, int *pos)
+{
+    unsigned long v;
+    int shift;
 
-    switch(d->date.dow) {
-    case 0: w = "SUN"; break;
-    case 1: w = "MON"; break;
-    case 2: w = "TUE"; break;
-    case 3: w = "WED"; break;
-    case 4: w = "THU"; break;
-    case 5: w = "FRI"; break;
-    case 6: w = "SAT"; break;
+    v = 0;
+    for(shift=0; *pos < len && shift < 28; shift += 7)
+    {
+        v |= (unsigned long)(data[*pos] & 0x7f) << shift;
+        if( (data[(*pos)++] & 0x80) == 0 )
+            break;
     }
-    draw_text(frame, w);
+
+    return v;
 }
 
-void casio_update_db_screen(char *frame, CASIO *c)
+int casio_fuzz_input(const unsigned char *data, int len)
 {
-    char buf[10];
-    char *p;
-    char ch, cstart;
-    int i;
+    CASIO c;
+    char frame[FRAME_SIZE];
+    unsigned long offscreen;
+    int pos, e, n;
 
-    if( c->db.init > 0 )
-    {
-        draw_text(frame, "\001DB");
-        draw_main(frame, " F: 15");
-    }
-    else
-    {
-        if( c->db.page != 0 ) {
-            //
-            p = buf;
-            ch = (c->db.page-1) * 28 + 1;
-            for(i=0; i < 8; i++) {
-                *p++ = ch++;
-            }
-            *p = '\0';
-            draw_string(frame, 25, 0, 2, buf);
+    casio_init(&c);
+    c.headless = 1;
 
-            p = buf;
-            for(i=0; i < 10; i++) {
-                *p++ = ch++;
-            }
-            *p = '\0';
-            draw_string(frame, 5, 23, 2, buf);
+    pos = 0;
+    for(n=0; pos < len && n < FUZZ_MAX_EVENTS; n++)
+    {
+        e = data[pos++] % (E_LIGHT_OFF + 1);
+        c.clock += casio_fuzz_varint(data, len, &pos) % (FUZZ_MAX_STEP * 100);
+        c.epoch += casio_fuzz_varint(data, len, &pos) % FUZZ_MAX_STEP;
 
-            p = buf;
-            for(i=0; i < 10; i++) {
-                *p++ = ch++;
-            }
-            *p = '\0';
-            draw_string(frame, 5, 45, 2, buf);
+        offscreen = c.draw.offscreen;
+        casio_process_event(e, &c);
+        casio_render(frame, &c);
 
-        } else {
-            draw_text(frame, c->db.text);
-            draw_main(frame, "--------");
-            draw_secondary(frame, " - -- -- --");
-        }
+        if( c.mode < M_HOME || c.mode > M_DT_SET || c.draw.offscreen != offscreen )
+            return -1;
     }
+
+    return 0;
 }
 
-void casio_update_cal_screen(char *frame, CASIO *c)
+void casio_fuzz()
 {
-    char buf[20];
-    char xbuf[20];
-    int delim;
-    int hours;
-    char *p;
+    unsigned char data[FUZZ_LEN];
+    unsigned long x, start, elapsed, failed;
+    int run, i;
 
-    if( c->cal.current[0] != '\0' )
-    {
-//      snprintf(buf, sizeof(buf), "%8s", c->cal.current);
-        snprintf(buf, sizeof(buf), "%8s", c->cal.current);
-    }
-    else
+    x = 2463534242UL;
+    failed = 0;
+    start = micros();
+
+    for(run=0; run < FUZZ_RUNS; run++)
     {
-//      snprintf(buf, sizeof(buf), "%.2f", c->cal.acc);
-        snprintf(xbuf, sizeof(xbuf), "%.9f", c->cal.acc);
-        // 8.12345678
-        // 0123456789
-        for(p=xbuf+strlen(xbuf)-1; p > xbuf; p--)
+        for(i=0; i < FUZZ_LEN; i++)
         {
-            if( *p == '.' )
-                break;
-            if( *p == '0' )
-                *p = '\0';
+            x ^= (x << 13) & 0xffffffffUL;
+            x ^= x >> 17;
+            x ^= (x << 5) & 0xffffffffUL;
+            data[i] = x;
         }
-        snprintf(buf, sizeof(buf), "%9s", xbuf);
-    }
-    draw_main(frame, buf);
 
-    if( c->cal.op == 1 ) {
-        draw_text(frame, "  +");
-    } else if( c->cal.op == 2 ) {
-        draw_text(frame, "  -");
-    } else if( c->cal.op == 3 ) {
-        draw_text(frame, "  *");
-    } else if( c->cal.op == 4 ) {
-        draw_text(frame, "  /");
-    } else {
-        draw_text(frame, "\006\007\010");
+        if( casio_fuzz_input(data, FUZZ_LEN) && failed++ == 0 )
+            Serial.printf("fuzz: run %d failed\r\n", run);
     }
 
-    if( c->home.now.time.seconds % 2 == 0 )
-        delim = ':';
-    else
-        delim = ' ';
+    elapsed = micros() - start;
+    Serial.printf("fuzz %d runs %lu us %lu execs/s, %lu failed\r\n",
+            FUZZ_RUNS, elapsed,
+            elapsed ? (unsigned long)((FUZZ_RUNS * 1000000.0) / elapsed) : 0,
+            failed);
+}
 
-    hours = casio_disp_hours(c->home.flags.hrs24, c->home.now.time.hours);
+#ifdef CASIO_FUZZ
+extern "C" int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size)
+{
+    static int setup;
 
-    if( ! c->home.flags.hrs24 )
+    if( ! setup )
     {
-        if( c->home.now.time.hours < 12 )
-            draw_am2(frame);
-        else
-            draw_pm2(frame);
+        make_ascii();
+        make_font_metrics();
+        setup = 1;
     }
 
-    snprintf(buf, sizeof(buf), "%2d%c%02d",
-            hours,
-            delim,
-            c->home.now.time.minutes );
+    if( casio_fuzz_input(data, size > 65536 ? 65536 : (int)size) )
+        abort();
 
-    draw_secondary(frame, buf);
+    return 0;
 }
+#endif
 
-void casio_update_al_screen(char *frame, CASIO *c)
-{
-    char buf[20];
-    int delim;
-    int hours;
-
-    draw_text(frame, "\004AL");
-    draw_main(frame, "12:00 - 1");
-
-    if( c->home.now.time.seconds % 2 == 0 )
-        delim = ':';
-    else
-        delim = ' ';
+//////////////////////////////////////////////////////////////////////
+// micro benchmarks
+//
+// Serial command 'b'. Times the drawing primitives, each screen and
+// the calendar/timer arithmetic, and prints the results as Google
+// Benchmark style JSON, so tools/benchcmp.py (or any tool that reads
+// that format) can save a baseline and compare later builds against
+// it. The /clipped variants draw across the screen edge, so they time
+// the clipping paths against the unchecked loops of the plain ones.
+//
+// Each benchmark doubles its iteration count until a run takes at
+// least BENCH_MIN_US, and reports the time per iteration of that run.
+// The argument 'i' varies the input a little, so nothing is constant
+// folded; results that would otherwise be unused go to bench_sink.
+//
 
-    hours = casio_disp_hours(c->home.flags.hrs24, c->home.now.time.hours);
+#define BENCH_MIN_US    20000
+#define BENCH_MAX_ITER  (1UL << 24)
 
-    if( ! c->home.flags.hrs24 )
-    {
-        if( c->home.now.time.hours < 12 )
-            draw_am2(frame);
-        else
-            draw_pm2(frame);
-    }
+typedef struct {
+    const char *name;
+    void (*fn)(char *frame, CASIO *c, unsigned long i);
+    int draws;                  // uses the frame
+} BENCH;
 
-    snprintf(buf, sizeof(buf), "%2d%c%02d --- -",
-            hours,
-            delim,
-            c->home.now.time.minutes );
+static volatile unsigned long bench_sink;
 
-    draw_secondary(frame, buf);
+void bench_pset(char *frame, CASIO *c, unsigned long i)
+{
+    disp_pset(frame, i & 127, (i >> 7) & 63, i & 1);
+}
 
-    switch(c->al.pos)
-    {
-    case E_HEX_BUTTON_0:
-            draw_pm1(frame);
-            draw_pm2(frame);
-            break;
+void bench_pget(char *frame, CASIO *c, unsigned long i)
+{
+    bench_sink += disp_pget(frame, i & 127, (i >> 7) & 63);
+}
 
-    case E_HEX_BUTTON_1:
-            draw_am1(frame);
-            draw_am2(frame);
-            break;
-            
-    case E_HEX_BUTTON_2:
-            draw_split(frame);
-            draw_dst(frame);
-            break;
+void bench_invert(char *frame, CASIO *c, unsigned long i)
+{
+    disp_invert(frame);
+}
 
-    case E_HEX_BUTTON_3:    draw_snooze(frame); break;
-    case E_HEX_BUTTON_4:    draw_mute(frame); break;
-    case E_HEX_BUTTON_5:    draw_alarm(frame,1); break;
-    case E_HEX_BUTTON_6:    draw_alarm(frame,2); break;
-    case E_HEX_BUTTON_7:    draw_alarm(frame,3); break;
-    case E_HEX_BUTTON_8:    draw_alarm(frame,4); break;
-    case E_HEX_BUTTON_9:    draw_alarm(frame,5); break;
-    case E_HEX_BUTTON_A:
-            draw_sig(frame);
-            draw_lt(frame);
-            draw_3sec(frame);
-            break;
+void bench_lit(char *frame, CASIO *c, unsigned long i)
+{
+    bench_sink += disp_lit(frame);
+}
 
-    case E_HEX_BUTTON_STAR:
-            draw_pm1(frame);
-            draw_pm2(frame);
-            draw_am1(frame);
-            draw_am2(frame);
-            draw_alarm(frame,1);
-            draw_alarm(frame,2);
-            draw_alarm(frame,3);
-            draw_alarm(frame,4);
-            draw_alarm(frame,5);
-            draw_split(frame);
-            draw_dst(frame);
-            draw_sig(frame);
-            draw_lt(frame);
-            draw_3sec(frame);
-            draw_snooze(frame);
-            draw_mute(frame);
-            break;
-    }
+void bench_filled_block(char *frame, CASIO *c, unsigned long i)
+{
+    draw_filled_block(frame, i & 63, (i >> 6) & 31, (i & 63) + 40, ((i >> 6) & 31) + 20);
 }
 
-void casio_update_st_screen(char *frame, CASIO *c)
+void bench_digit(char *frame, CASIO *c, unsigned long i)
 {
-    char buf[20];
-    long diff;
-    TIMER t;
-    char delim;
-    int hours, ks;
+    draw_digit(frame, 10, 20, 6, 10, 2, '0' + i % 10, i & 1);
+}
 
-    if( c->st.flags.running )
-    {
-        diff = DEVICE.clock - c->st.timer_start;
-        t = timer_set_from_100ths(diff);
-        ks = t.ks;
-    }
-    else
-    {
-        diff = c->st.timer_stop - c->st.timer_start;
-        t = timer_set_from_100ths(diff);
-    }
+void bench_segstr(char *frame, CASIO *c, unsigned long i)
+{
+    draw_segstr(frame, 10, 20, 6, 10, 2, (i & 1) ? "12:34 56" : "10.58 07");
+}
 
-    if( c->st.flags.split )
-    {
-        diff = c->st.timer_split - c->st.timer_start;
-        t = timer_set_from_100ths(diff);
+void bench_char1(char *frame, CASIO *c, unsigned long i)
+{
+    draw_char(frame, i & 63, 0, 1, 'A' + i % 26);
+}
 
-        draw_split(frame);
-    }
+void bench_char2(char *frame, CASIO *c, unsigned long i)
+{
+    draw_char(frame, i & 63, 0, 2, 'A' + i % 26);
+}
 
-    if( c->st.flags.running )
-        delim = (ks < 50) ? ':' : ' ';
-    else
-        delim = ':';
+void bench_blit(char *frame, CASIO *c, unsigned long i)
+{
+    draw_blit(frame, i & 63, 50, 4, 4, 0x000069F9);
+}
 
-    snprintf(buf, sizeof(buf), "%2d%c%02d %02d", t.hours, delim, t.minutes, t.seconds);
-    draw_main(frame, buf);      
+//
+// the same primitives straddling the screen edge, i.e. through the
+// clipping paths instead of the unchecked loops
+//
+void bench_filled_block_clipped(char *frame, CASIO *c, unsigned long i)
+{
+    draw_filled_block(frame, 100 + (i & 15), (i >> 4) & 31, 140 + (i & 15), ((i >> 4) & 31) + 20);
+}
 
-    if( c->home.now.time.seconds % 2 == 0 )
-        delim = ':';
-    else
-        delim = ' ';
+void bench_char1_clipped(char *frame, CASIO *c, unsigned long i)
+{
+    draw_char(frame, 124 + (i & 1), 0, 1, 'A' + i % 26);
+}
 
-    hours = casio_disp_hours(c->home.flags.hrs24, c->home.now.time.hours);
+void bench_char2_clipped(char *frame, CASIO *c, unsigned long i)
+{
+    draw_char(frame, 120 + (i & 3), 0, 2, 'A' + i % 26);
+}
 
-    if( ! c->home.flags.hrs24 )
-    {
-        if( c->home.now.time.hours < 12 )
-            draw_am2(frame);
-        else
-            draw_pm2(frame);
-    }
+void bench_blit_clipped(char *frame, CASIO *c, unsigned long i)
+{
+    draw_blit(frame, 126, 50 + (i & 7), 4, 4, 0x000069F9);
+}
 
-    snprintf(buf, sizeof(buf), "%2d%c%02d    %02d",
-            hours,
-            delim,
-            c->home.now.time.minutes,
-            t.ks);
-    draw_secondary(frame, buf);
+void bench_fmt_time(char *frame, CASIO *c, unsigned long i)
+{
+    char buf[20], *p;
 
-    draw_text(frame, "\012ST");
+    p = fmt_time(buf, i % 24, ':', i % 60);
+    *p++ = ' ';
+    fmt_02d(p, i % 60);
+    bench_sink += buf[1];
 }
 
-void casio_update_dt_screen(char *frame, CASIO *c)
+void bench_fmt_calc(char *frame, CASIO *c, unsigned long i)
 {
-    DATE_TIME d;
     char buf[20];
-    int delim;
-    int hours;
-
-    if( c->dt.flags.show_home )
-    {
-        casio_update_home_screen(frame, c);
-        return;
-    }
-    else if( c->dt.flags.show_db )
-    {
-        casio_update_db_screen(frame, c);
-        return;
-    }
-
-    d = epoch_to_date_time( DEVICE.epoch + 3*60*60 + 30*60 );
 
-    hours = casio_disp_hours(c->home.flags.hrs24, d.time.hours);
+    fmt_calc(buf, i / 7.0);
+    bench_sink += buf[8];
+}
 
-    if( ! c->home.flags.hrs24 )
-    {
-        if( d.time.hours < 12 )
-            draw_am1(frame);
-        else
-            draw_pm1(frame);
-    }
+void bench_home(char *frame, CASIO *c, unsigned long i)   { casio_update_home_screen(frame, c); }
+void bench_db(char *frame, CASIO *c, unsigned long i)     { casio_update_db_screen(frame, c); }
+void bench_cal(char *frame, CASIO *c, unsigned long i)    { casio_update_cal_screen(frame, c); }
+void bench_al(char *frame, CASIO *c, unsigned long i)     { casio_update_al_screen(frame, c); }
+void bench_st(char *frame, CASIO *c, unsigned long i)     { casio_update_st_screen(frame, c); }
+void bench_dt(char *frame, CASIO *c, unsigned long i)     { casio_update_dt_screen(frame, c); }
 
-    snprintf(buf, sizeof(buf), "%2d:%02d %02d",
-                    hours,
-                    d.time.minutes,
-                    d.time.seconds);
-    draw_main(frame, buf);
+void bench_epoch_to_date_time(char *frame, CASIO *c, unsigned long i)
+{
+    DATE_TIME dt = epoch_to_date_time(c->epoch + i * 86413UL);
+    bench_sink += dt.time.seconds;
+}
 
-    if( c->home.now.time.seconds % 2 == 0 )
-        delim = ':';
-    else
-        delim = ' ';
+void bench_date_time_to_epoch(char *frame, CASIO *c, unsigned long i)
+{
+    DATE_TIME dt = c->home.dt;
+    dt.date.day = 1 + i % 28;
+    bench_sink += date_time_to_epoch(&dt);
+}
 
-    hours = casio_disp_hours(c->home.flags.hrs24, c->home.now.time.hours);
+void bench_timer(char *frame, CASIO *c, unsigned long i)
+{
+    TIMER t = timer_set_from_100ths(i * 997);
+    bench_sink += t.ks;
+}
 
-    if( ! c->home.flags.hrs24 )
-    {
-        if( c->home.now.time.hours < 12 )
-            draw_am2(frame);
-        else
-            draw_pm2(frame);
-    }
+void bench_timer_cached(char *frame, CASIO *c, unsigned long i)
+{
+    TIMER t = timer_cached(&c->st.run, i * 7);
+    bench_sink += t.ks;
+}
 
-    snprintf(buf, sizeof(buf), "%2d%c%02d",
-            hours,
-            delim,
-            c->home.now.time.minutes );
-    draw_secondary(frame, buf);
+static const BENCH Benchmarks[] = {
+    { "disp_pset",                   bench_pset,                 1 },
+    { "disp_pget",                   bench_pget,                 1 },
+    { "disp_invert",                 bench_invert,               1 },
+    { "disp_lit",                    bench_lit,                  0 },
+    { "draw_filled_block",           bench_filled_block,         1 },
+    { "draw_digit",                  bench_digit,                1 },
+    { "draw_segstr",                 bench_segstr,               1 },
+    { "draw_char/1",                 bench_char1,                1 },
+    { "draw_char/2",                 bench_char2,                1 },
+    { "draw_blit",                   bench_blit,                 1 },
+    { "draw_filled_block/clipped",   bench_filled_block_clipped, 1 },
+    { "draw_char/1/clipped",         bench_char1_clipped,        1 },
+    { "draw_char/2/clipped",         bench_char2_clipped,        1 },
+    { "draw_blit/clipped",           bench_blit_clipped,         1 },
+    { "fmt_time",                    bench_fmt_time,             0 },
+    { "fmt_calc",                    bench_fmt_calc,             0 },
+    { "casio_update_home_screen",    bench_home,                 1 },
+    { "casio_update_db_screen",      bench_db,                   1 },
+    { "casio_update_cal_screen",     bench_cal,                  1 },
+    { "casio_update_al_screen",      bench_al,                   1 },
+    { "casio_update_st_screen",      bench_st,                   1 },
+    { "casio_update_dt_screen",      bench_dt,                   1 },
+    { "epoch_to_date_time",          bench_epoch_to_date_time,   0 },
+    { "date_time_to_epoch",          bench_date_time_to_epoch,   0 },
+    { "timer_set_from_100ths",       bench_timer,                0 },
+    { "timer_cached",                bench_timer_cached,         0 },
+};
 
-    draw_text(frame, "\005DT");
-}
+#define BENCH_COUNT (int)(sizeof(Benchmarks) / sizeof(Benchmarks[0]))
 
-void casio_update_screen(CASIO *c)
+void casio_bench()
 {
+    CASIO c;
     char frame[FRAME_SIZE];
-    int rc;
+    unsigned long iter, i, start, elapsed;
+    int n;
 
-    memset(frame, CLR_MASK, FRAME_SIZE);
+    casio_init(&c);
+    c.headless = 1;
+    c.clock = 123456;
+    casio_process_event(E_SECONDS_TIMER, &c);
+    memset(frame, 0, sizeof(frame));
 
-    draw_hline(frame, 0, 15, 128);
-    draw_hline(frame, 60, 4, 128-60);
-    draw_hline(frame, 60, 10, 128-60);
-    draw_vline(frame, 60, 0, 15);
+    Serial.printf("{\r\n  \"context\": { \"mhz_per_cpu\": %lu, \"library_build_type\": \"release\" },\r\n",
+            (unsigned long)(F_CPU_ACTUAL / 1000000));
+    Serial.printf("  \"benchmarks\": [\r\n");
 
-    switch(c->mode)
+    for(n=0; n < BENCH_COUNT; n++)
     {
-    case M_HOME:
-        casio_update_home_screen(frame, c);
-        break;
-    case M_DB:
-        casio_update_db_screen(frame, c);
-        break;
-    case M_CAL:
-        casio_update_cal_screen(frame, c);
-        break;
-    case M_AL:
-        casio_update_al_screen(frame, c);
-        break;
-    case M_ST:
-        casio_update_st_screen(frame, c);
-        break;
-    case M_DT:
-        casio_update_dt_screen(frame, c);
-        break;
-    }
+        for(iter=1; ; iter *= 2)
+        {
+            start = micros();
+            for(i=0; i < iter; i++)
+                Benchmarks[n].fn(frame, &c, i);
+            elapsed = micros() - start;
 
-    if( ! c->home.flags.light )
-    {
-        // disp_invert(frame);
-    }
+            if( elapsed >= BENCH_MIN_US || iter >= BENCH_MAX_ITER )
+                break;
+        }
 
-    rc = disp_update(frame);
-    if( rc )
-    {
-        Serial.printf("disp_update %d\r\n", rc);
+        Serial.printf("    { \"name\": \"%s\", \"iterations\": %lu, "
+                "\"real_time\": %.1f, \"cpu_time\": %.1f, \"time_unit\": \"ns\" }%s\r\n",
+                Benchmarks[n].name, iter,
+                elapsed * 1000.0 / iter, elapsed * 1000.0 / iter,
+                n < BENCH_COUNT-1 ? "," : "");
     }
+
+    Serial.printf("  ]\r\n}\r\n");
 }
 
-void casio_process_home_event(int e, CASIO *c)
+//////////////////////////////////////////////////////////////////////
+// cycle counts
+//
+// Hidden benchmark mode: hold the light button and press '#' on the
+// home screen (or serial command 'c'). The key only sets DEVICE.cycles;
+// casio_run() runs the tables between events, as a command stage, so
+// they aren't timed as event processing and the watchdog is fed while
+// they take their seconds. Every benchmark above, plus the
+// display transfers, is run CYCLES_RUNS times and timed with the DWT
+// cycle counter, and a table of min/avg/max cycles is printed. Unlike
+// the 'b' timings these include the M7 caches, TCM and flash wait
+// states.
+//
+// Kernels that draw run twice, on a frame on the stack (DTCM) and on
+// one in DMAMEM (OCRAM, through the data cache). Code placement is set
+// at build time with HOT_CODE; the header shows where draw_char ended
+// up, so an ITCM build and a -DHOT_CODE=FLASHMEM build can be compared
+// from their tables.
+//
+// The display transfers resend the frame already on the screen.
+//
+
+#define CYCLES_RUNS 100
+
+static DMAMEM char cycles_frame[FRAME_SIZE];
+
+const char *cycles_region(const void *p)
 {
-    int xx;
+    unsigned long a = (unsigned long)p;
 
-    if( e == E_BUTTONB )
-    {
-        c->mode = M_DB;
-        c->db.init = 50;
-    }
-    else if( e == E_BUTTONC )
-    {
-        tone(24, 410, 80);
-        c->home.flags.hrs24 = (c->home.flags.hrs24) ? 0 : 1;
-    }
-    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
-    {
-        xx = (e - E_HEX_BUTTON_0)+1;
+    if( a < 0x00080000UL )                          return "itcm";
+    if( a >= 0x20000000UL && a < 0x20080000UL )     return "dtcm";
+    if( a >= 0x20200000UL && a < 0x20280000UL )     return "ocram";
+    if( a >= 0x60000000UL && a < 0x70000000UL )     return "flash";
+    return "?";
+}
 
-        tone(24, xx*100, 100);
+void bench_disp_update(char *frame, CASIO *c, unsigned long i)
+{
+    disp_update(frame);
+}
 
-        if( e == E_HEX_BUTTON_A )
-        {
-            c->home.flags.show_dt = 1;
-        }
-        else if( e == E_HEX_BUTTON_D )
-        {
-            c->home.flags.show_db = 1;
-        }
-    }
-    else if( e == E_HEX_BUTTON_A_RELEASE )
-    {
-        c->home.flags.show_dt = 0;
-    }
-    else if( e == E_HEX_BUTTON_D_RELEASE )
-    {
-        c->home.flags.show_db = 0;
-    }
+void bench_disp_update_page(char *frame, CASIO *c, unsigned long i)
+{
+    disp_update_window(frame, 0, 127, i & 7, i & 7);
 }
 
-void casio_process_db_event(int e, CASIO *c)
+static const BENCH CycleTransfers[] = {
+    { "disp_update",                bench_disp_update,          1 },
+    { "disp_update_window/page",    bench_disp_update_page,     1 },
+};
+
+void casio_cycles_row(const BENCH *b, char *frame, CASIO *c)
 {
-    int xx;
+    unsigned long i, t, min, max, total;
 
-    if( e == E_BUTTONB )
-    {
-        c->mode = M_CAL;
-    }
-    else if( e == E_BUTTONC )
+    min = 0xffffffffUL;
+    max = total = 0;
+
+    for(i=0; i < CYCLES_RUNS; i++)
     {
-        tone(24, 410, 80);
+        t = ARM_DWT_CYCCNT;
+        b->fn(frame, c, i);
+        t = ARM_DWT_CYCCNT - t;
+
+        total += t;
+        if( t < min ) min = t;
+        if( t > max ) max = t;
     }
-    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
-    {
-        xx = (e - E_HEX_BUTTON_0)+1;
 
-        tone(24, xx*100, 100);
+    Serial.printf("%-28s %-6s %9lu %9lu %9lu\r\n",
+            b->name, b->draws ? cycles_region(frame) : "-",
+            min, total / CYCLES_RUNS, max);
+}
 
-        switch(e)
-        {
-        case E_HEX_BUTTON_0:        strcpy(c->db.text, "ABC"); break;
-        case E_HEX_BUTTON_1:        strcpy(c->db.text, "DEF"); break;
-        case E_HEX_BUTTON_2:        strcpy(c->db.text, "GHI"); break;
-        case E_HEX_BUTTON_3:        strcpy(c->db.text, "JKL"); break;
-        case E_HEX_BUTTON_4:        strcpy(c->db.text, "MNO"); break;
-        case E_HEX_BUTTON_5:        strcpy(c->db.text, "PQR"); break;
-        case E_HEX_BUTTON_6:        strcpy(c->db.text, "STU"); break;
-        case E_HEX_BUTTON_7:        strcpy(c->db.text, "VWX"); break;
-        case E_HEX_BUTTON_8:        strcpy(c->db.text, "YZ1"); break;
-        case E_HEX_BUTTON_9:        strcpy(c->db.text, "234"); break;
+void casio_cycles()
+{
+    CASIO c;
+    char frame[FRAME_SIZE];
+    int n;
 
-        case E_HEX_BUTTON_A:
-                strcpy(c->db.text, "567");
-                if( c->db.page == 0 ) {
-                    c->db.page = 1;
-                } else {
-                    c->db.page -= 1;
-                    if( c->db.page < 1 ) c->db.page = 5;
-                }
-                break;
+    // normally already running on Teensy 4
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
 
-        case E_HEX_BUTTON_B:        strcpy(c->db.text, "890"); break;
-        case E_HEX_BUTTON_C:        strcpy(c->db.text, "%<>"); break;
+    casio_init(&c);
+    c.headless = 1;
+    c.clock = 123456;
+    casio_process_event(E_SECONDS_TIMER, &c);
 
-        case E_HEX_BUTTON_D:
-                strcpy(c->db.text, "\13\14\15");
-                if( c->db.page == 0 ) {
-                    c->db.page = 5;
-                } else {
-                    c->db.page += 1;
-                    if( c->db.page > 5 ) c->db.page = 1;
-                }
-                break;
+    Serial.printf("cycles: %d runs, %lu MHz, hot code in %s\r\n",
+            CYCLES_RUNS, (unsigned long)(F_CPU_ACTUAL / 1000000),
+            cycles_region((const void *)draw_char));
+    Serial.printf("%-28s %-6s %9s %9s %9s\r\n", "kernel", "frame", "min", "avg", "max");
 
-        case E_HEX_BUTTON_POUND:    strcpy(c->db.text, "\6\7\10"); break;
-        case E_HEX_BUTTON_STAR:     strcpy(c->db.text, ""); break;
-        }
+    for(n=0; n < BENCH_COUNT; n++)
+    {
+        memset(frame, 0, sizeof(frame));
+        casio_cycles_row(&Benchmarks[n], frame, &c);
 
+        if( Benchmarks[n].draws )
+        {
+            memset(cycles_frame, 0, sizeof(cycles_frame));
+            casio_cycles_row(&Benchmarks[n], cycles_frame, &c);
+        }
     }
-    else if( e == E_SECONDS15 )
+
+    for(n=0; n < (int)(sizeof(CycleTransfers) / sizeof(CycleTransfers[0])); n++)
     {
-        if( c->db.init > 0 )
-            c->db.init -= 1;
+        memcpy(frame, DISP.frame, FRAME_SIZE);
+        casio_cycles_row(&CycleTransfers[n], frame, &c);
+
+        memcpy(cycles_frame, DISP.frame, FRAME_SIZE);
+        casio_cycles_row(&CycleTransfers[n], cycles_frame, &c);
     }
 }
 
-void casio_process_cal_event(int e, CASIO *c)
-{
-    int xx, len;
-    char buf[10];
-    double val;
+//////////////////////////////////////////////////////////////////////
+// pipeline benchmark
+//
+// Serial command 'e'. The headline number: a fixed event mix goes
+// through casio_process_event() and casio_update_screen() exactly as in
+// casio_run(), with the display as a null sink. Everything up to the
+// I2C transfer still happens: rendering, page chunking, the window and
+// start line commands and the mirror delta encoding.
+//
+// The mix (PipeMix) walks through every mode once per pass: seconds
+// ticks, hex keys, mode switches, and E_SECONDS15 ticks with the
+// stopwatch running. Every event is drawn, but only a frame that
+// changed some page is sent, so events/s and frames/s (sent) differ;
+// the I2C bytes and transactions and the mirror bytes are per frame
+// sent. The watch's own last mode (SCREEN) is put back afterwards.
+//
 
-    if( e == E_BUTTONB )
-    {
-        c->mode = M_AL;
-    }
-    else if( e == E_BUTTONC )
-    {
-        c->cal.op = 0;
-        c->cal.acc = 0.0;
-        c->cal.current[0] = '\0';
-        tone(24, 410, 80);
-    }
-    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
-    {
-        xx = (e - E_HEX_BUTTON_0)+1;
+#define PIPE_PASSES     200
+
+static const unsigned char PipeMix[] = {
+    // home
+    E_SECONDS_TIMER, E_HEX_BUTTON_1, E_HEX_BUTTON_1_RELEASE, E_SECONDS_TIMER,
+    E_HEX_BUTTON_A, E_HEX_BUTTON_A_RELEASE, E_SECONDS_TIMER, E_BUTTONB, E_BUTTONB_RELEASE,
+    // data bank
+    E_SECONDS_TIMER, E_HEX_BUTTON_2, E_HEX_BUTTON_2_RELEASE, E_BUTTONB, E_BUTTONB_RELEASE,
+    // calculator
+    E_HEX_BUTTON_3, E_HEX_BUTTON_3_RELEASE, E_HEX_BUTTON_STAR, E_HEX_BUTTON_STAR_RELEASE,
+    E_HEX_BUTTON_7, E_HEX_BUTTON_7_RELEASE, E_HEX_BUTTON_POUND, E_HEX_BUTTON_POUND_RELEASE,
+    E_SECONDS_TIMER, E_BUTTONB, E_BUTTONB_RELEASE,
+    // alarm
+    E_SECONDS_TIMER, E_BUTTONB, E_BUTTONB_RELEASE,
+    // stop watch: start, tick, split, stop, reset
+    E_BUTTONC, E_BUTTONC_RELEASE,
+    E_SECONDS15, E_SECONDS15, E_SECONDS15, E_SECONDS15, E_SECONDS15, E_SECONDS15,
+    E_SECONDS15, E_SECONDS15, E_SECONDS15, E_SECONDS15, E_SECONDS15, E_SECONDS15,
+    E_SECONDS15, E_SECONDS15, E_SECONDS15, E_SECONDS_TIMER,
+    E_BUTTONA, E_BUTTONA_RELEASE, E_SECONDS15, E_SECONDS15, E_SECONDS15,
+    E_BUTTONC, E_BUTTONC_RELEASE, E_BUTTONA, E_BUTTONA_RELEASE,
+    E_BUTTONB, E_BUTTONB_RELEASE,
+    // dual time
+    E_SECONDS_TIMER, E_HEX_BUTTON_4, E_HEX_BUTTON_4_RELEASE, E_BUTTONB, E_BUTTONB_RELEASE,
+};
 
-        tone(24, xx*100, 100);
+void casio_pipeline()
+{
+    CASIO c;
+    char saved[FRAME_SIZE];
+    unsigned long start, elapsed, events, frames, bytes, transfers, mirror, before;
+    int pass, i, e, mirror_enabled, last_mode;
 
-        if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_9 )
-        {
-            len = strlen(c->cal.current);
-            if( len < 8 )
-            {
-                buf[0] = '0' + (e - E_HEX_BUTTON_0);
-                buf[1] = '\0';
-                strcat(c->cal.current, buf);
-//              c->cal.op = 0;
-            }
-        }
-        else if( e == E_HEX_BUTTON_STAR )
-        {
-            len = strlen(c->cal.current);
-            if( len < 8 )
-            {
-                buf[0] = '.';
-                buf[1] = '\0';
-                strcat(c->cal.current, buf);
-//              c->cal.op = 0;
-            }
-        }
-        else if( e >= E_HEX_BUTTON_A && e <= E_HEX_BUTTON_D )
-        {
-            // 0=NO-OP, 1=A=+, 2=B=-, 3=C=*, 4=D=/
+    memcpy(saved, DISP.frame, FRAME_SIZE);
+    mirror_enabled = MIRROR.enabled;
+    last_mode = SCREEN.last_mode;
 
-            if( c->cal.op != 0 )
-            {
-                // enter K-mode (constant mode)
-            }
+    casio_init(&c);
+    c.headless = 1;
 
-            c->cal.op = (e - E_HEX_BUTTON_A) + 1;
-            val = atof(c->cal.current);
-            c->cal.acc = val;
-            c->cal.current[0] = '\0';
-        }
-        else if( e == E_HEX_BUTTON_POUND )
+    DISP.sink = 1;
+    MIRROR.enabled = 1;
+    memcpy(MIRROR.prev, DISP.frame, FRAME_SIZE);
+
+    events = 0;
+    frames = 0;
+    bytes = DISP.bytes;
+    transfers = DISP.transfers;
+    mirror = MIRROR.bytes;
+    start = micros();
+
+    for(pass=0; pass < PIPE_PASSES; pass++)
+    {
+        for(i=0; i < (int)sizeof(PipeMix); i++)
         {
-            if( c->cal.op != 0 )
+            e = PipeMix[i];
+            if( e == E_SECONDS_TIMER )
             {
-                // parse number, apply op to number and store in acc
-                val = atof(c->cal.current);
-                switch(c->cal.op)
-                {
-                case 1: c->cal.acc += val; break;
-                case 2: c->cal.acc -= val; break;
-                case 3: c->cal.acc *= val; break;
-                case 4: c->cal.acc /= val; break;
-                }
-                c->cal.current[0] = '\0';
-                c->cal.op = 0;
+                c.epoch++;
+                c.clock += 100;
             }
-            else if( c->cal.current[0] != '\0' )
+            else if( e == E_SECONDS15 )
             {
-                val = atof(c->cal.current);
-                c->cal.acc = val;
-                c->cal.current[0] = '\0';
-                c->cal.op = 0;
+                c.clock += 7;
             }
-        }
 
+            casio_process_event(e, &c);
+            before = DISP.transfers;
+            casio_update_screen(&c);        // drawn for every event
+            events++;
+            if( DISP.transfers != before )
+                frames++;
+        }
     }
+
+    elapsed = micros() - start;
+    bytes = DISP.bytes - bytes;
+    transfers = DISP.transfers - transfers;
+    mirror = MIRROR.bytes - mirror;
+
+    DISP.sink = 0;
+    MIRROR.enabled = mirror_enabled;
+    memcpy(MIRROR.prev, saved, FRAME_SIZE);
+    disp_update(saved);
+    SCREEN.last_mode = last_mode;
+
+    Serial.printf("pipeline %lu events %lu frames %lu us: %lu events/s %lu fps, "
+            "%lu bytes %lu transfers per frame, mirror %lu bytes per frame\r\n",
+            events, frames, elapsed,
+            elapsed ? (unsigned long)(events * 1000000.0 / elapsed) : 0,
+            elapsed ? (unsigned long)(frames * 1000000.0 / elapsed) : 0,
+            frames ? bytes / frames : 0, frames ? transfers / frames : 0,
+            frames ? mirror / frames : 0);
 }
 
-void casio_process_al_event(int e, CASIO *c)
-{
-    int xx;
+//////////////////////////////////////////////////////////////////////
+// key latency benchmark
+//
+// Serial command 'l'. A key comes in while a whole new screen is being
+// sent: the calculator is drawn over a blank display and the key (5)
+// "arrives" after page 'at' of it. Measured is the time from the key
+// until the screen showing it is on the display, on the real bus, and
+// the bytes sent in that time:
+//
+//  wait    - the stale frame is finished, then the new one is sent
+//            (only the pages that changed in between)
+//  preempt - the transfer stops at the key, the remaining pages are
+//            sent from the new frame (disp_update_pages)
+//
+//      latency: key after page, then us and bytes until it is shown
+//      at   wait-us  bytes  preempt-us  bytes
+//       1       ...   1433         ...    924
+//       ...
+//       7       ...    659         ...    673
+//
+// (bytes from the host model of the display.) Giving way saves the
+// most for keys early in a frame; for the last page or two it costs a
+// window command more than it saves.
+//
 
-    if( e == E_BUTTONB )
+#define LATENCY_RUNS    4
+
+static struct
+{
+    int at;             // key arrives before this page is asked for
+    int calls;
+    int preempt;        // give way to it?
+    unsigned long key;  // micros() when it arrived
+    unsigned long bytes;    // DISP.bytes then
+} LAT;
+
+int casio_latency_key()
+{
+    if( ++LAT.calls == LAT.at )
     {
-        c->mode = M_ST;
+        LAT.key = micros();
+        LAT.bytes = DISP.bytes;
     }
-    else if( e == E_BUTTONC )
+    return LAT.calls >= LAT.at && LAT.preempt;
+}
+
+//
+// one run, returns us from the key to the new frame on the display
+// and adds the bytes sent in that time to 'bytes'
+//
+unsigned long casio_latency_run(char *blank, int at, int preempt, unsigned long *bytes)
+{
+    CASIO c;
+    char frame[FRAME_SIZE];
+
+    disp_update(blank);
+
+    casio_init(&c);
+    c.headless = 1;
+    c.mode = M_CAL;
+    strcpy(c.cal.current, "1234");
+    casio_render(frame, &c);
+
+    LAT.at = at;
+    LAT.calls = 0;
+    LAT.preempt = preempt;
+    LAT.key = 0;
+
+    disp_update_pages(frame, casio_latency_key);
+    if( LAT.key == 0 )
     {
-        tone(24, 410, 80);
+        LAT.key = micros();     // the old frame was done before the key
+        LAT.bytes = DISP.bytes;
     }
-    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
-    {
-        xx = (e - E_HEX_BUTTON_0)+1;
 
-        tone(24, xx*100, 100);
+    casio_process_event(E_HEX_BUTTON_5, &c);
+    casio_render(frame, &c);
+    disp_update_pages(frame, NULL);
 
-        c->al.pos = e;
-    }
+    *bytes += DISP.bytes - LAT.bytes;
+    return micros() - LAT.key;
 }
 
-void casio_process_st_event(int e, CASIO *c)
+void casio_latency()
 {
-    int diff1, diff2;
-    int xx;
+    char saved[FRAME_SIZE], blank[FRAME_SIZE];
+    unsigned long wait, preempt, wait_bytes, preempt_bytes;
+    int at, i;
 
-    if( e == E_BUTTONA )
+    memcpy(saved, DISP.frame, FRAME_SIZE);
+    memset(blank, CLR_MASK, FRAME_SIZE);
+
+    Serial.printf("latency: key after page, then us and bytes until it is shown\r\n");
+    Serial.printf("at   wait-us  bytes  preempt-us  bytes\r\n");
+
+    for(at=1; at < FRAME_SIZE/128; at++)
     {
-        if( c->st.flags.split ) {
-            c->st.flags.split = 0;
-        } else {
-            tone(24, 410, 80);
-            if( c->st.flags.running ) {
-                c->st.timer_split = DEVICE.clock;
-                c->st.flags.split = 1;
-            } else {
-                c->st.timer_start = c->st.timer_stop = 0;
-            }
+        wait = preempt = 0;
+        wait_bytes = preempt_bytes = 0;
+        for(i=0; i < LATENCY_RUNS; i++)
+        {
+            wait += casio_latency_run(blank, at, 0, &wait_bytes);
+            preempt += casio_latency_run(blank, at, 1, &preempt_bytes);
         }
+        Serial.printf("%2d %9lu %6lu %11lu %6lu\r\n", at,
+                wait / LATENCY_RUNS, wait_bytes / LATENCY_RUNS,
+                preempt / LATENCY_RUNS, preempt_bytes / LATENCY_RUNS);
     }
-    else if( e == E_BUTTONB )
-    {
-        c->mode = M_DT;
-    }
-    else if( e == E_BUTTONC )
+
+    disp_update(saved);
+}
+
+//////////////////////////////////////////////////////////////////////
+// power day
+//
+// Serial 'u'. A headless watch lives through a day under each power
+// policy, a minute at a time, and the power model adds up the display
+// charge. Awake (07:00-22:00) a key is pressed every 20 minutes and the
+// light is used for 2 seconds every 3 hours; asleep nothing happens.
+//
+//      power day: policy     mAh/day  avg mA  avg lit
+//      power day: normal       ...
+//
+// Only the display, and only as good as the POWER_* numbers. On a host:
+// tools/host, "make power".
+//
+
+void casio_power_step(CASIO *c, int e, int seconds, unsigned long long *ua_s, unsigned long long *lit_s)
+{
+    char frame[FRAME_SIZE];
+    int lit;
+
+    casio_process_event(e, c);
+    casio_render(frame, c);
+    lit = disp_lit(frame);
+
+    *ua_s += (unsigned long long)disp_power_ua(lit, c->power.contrast) * seconds;
+    *lit_s += (unsigned long long)lit * seconds;
+}
+
+void casio_power_day()
+{
+    CASIO c;
+    DATE_TIME dt;
+    unsigned long long ua_s, lit_s;
+    unsigned long mah1000, ma100;
+    int policy, m, hour, awake;
+
+    Serial.printf("power day: policy     mAh/day  avg mA  avg lit\r\n");
+
+    for(policy=0; policy < 4; policy++)
     {
-        tone(24, 410, 80);
+        casio_init(&c);
+        c.headless = 1;
+
+        memset(&dt, 0, sizeof(dt));
+        dt.date.year = 2024;
+        dt.date.month = 6;
+        dt.date.day = 3;
+        c.epoch = date_time_to_epoch(&dt);
+        c.clock = 0;
+        casio_power_policy(&c, policy);
+        casio_process_event(E_SECONDS_TIMER, &c);
+
+        ua_s = 0;
+        lit_s = 0;
+        for(m=0; m < 24*60; m++)
+        {
+            c.epoch += 60;
+            c.clock += 60*100;
 
-        if( c->st.flags.running ) {
-            c->st.timer_stop = DEVICE.clock;
-            c->st.flags.running = 0;
-        } else {
-            diff1 = c->st.timer_stop - c->st.timer_start;
-            if( c->st.flags.split )
+            hour = m / 60;
+            awake = hour >= POWER_NIGHT_TO && hour < POWER_NIGHT_FROM;
+
+            if( awake && m % 180 == 90 )
             {
-                diff2 = c->st.timer_split - c->st.timer_start;
+                casio_power_step(&c, E_BUTTONL, 0, &ua_s, &lit_s);
+                casio_power_step(&c, E_BUTTONL_RELEASE, 0, &ua_s, &lit_s);
+                casio_power_step(&c, E_SECONDS_TIMER, 2, &ua_s, &lit_s);
+                c.clock += 2*100;
+                casio_power_step(&c, E_LIGHT_OFF, 58, &ua_s, &lit_s);
+                c.clock -= 2*100;
             }
-
-            c->st.timer_start = DEVICE.clock - diff1;
-            c->st.flags.running = 1;
-
-            if( c->st.flags.split )
+            else if( awake && m % 20 == 0 )
             {
-                c->st.timer_split = c->st.timer_start + diff2;
-                c->st.flags.running = 1;
+                casio_power_step(&c, E_HEX_BUTTON_1, 0, &ua_s, &lit_s);
+                casio_power_step(&c, E_HEX_BUTTON_1_RELEASE, 0, &ua_s, &lit_s);
+                casio_power_step(&c, E_SECONDS_TIMER, 30, &ua_s, &lit_s);
+                c.clock += 30*100;
+                casio_power_step(&c, E_SECONDS_TIMER, 30, &ua_s, &lit_s);
+                c.clock -= 30*100;
+            }
+            else
+            {
+                casio_power_step(&c, E_SECONDS_TIMER, 60, &ua_s, &lit_s);
             }
         }
+
+        // uA s -> mAh (x1000), average mA (x100)
+        mah1000 = (unsigned long)(ua_s / 3600);
+        ma100 = (unsigned long)(ua_s / (24*60*60UL) / 10);
+        Serial.printf("power day: %-8s %5lu.%03lu %4lu.%02lu %8lu\r\n",
+                PowerNames[policy], mah1000 / 1000, mah1000 % 1000,
+                ma100 / 100, ma100 % 100,
+                (unsigned long)(lit_s / (24*60*60UL)));
     }
-    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
-    {
-        xx = (e - E_HEX_BUTTON_0)+1;
+}
 
-        tone(24, xx*100, 100);
+//
+// console "power": the live display's power model, and the policy. The
+// policy is CASIO state that no event carries, so it can't change
+// while events are being recorded: the replay would draw differently.
+//
+void casio_console_power(const char *arg)
+{
+    CASIO *c = LOG.live;
+    int i;
 
-        if( e == E_HEX_BUTTON_A )
-        {
-            c->home.contrast -= 10;
-            disp_set_contrast(c->home.contrast);
-        }
-        else if( e == E_HEX_BUTTON_D )
+    for(i=0; c && i < 4; i++)
+    {
+        if( strcmp(arg, PowerNames[i]) != 0 )
+            continue;
+
+        if( LOG.recording )
         {
-            c->home.contrast += 10;
-            disp_set_contrast(c->home.contrast);
+            Serial.printf("power: recording events, stop it ('r') to change the policy\r\n");
+            return;
         }
+        casio_power_policy(c, i);
+        casio_power_apply(E_NONE, c);
     }
+
+    disp_power_update();
+    Serial.printf("power: policy %s%s, %d pixels lit, contrast %d, %lu uA now, %lu uA avg, %lu uAh in %lu s\r\n",
+            c ? PowerNames[c->power.policy & 3] : "?",
+            c && c->power.inverted ? " (inverted)" : "",
+            POWER.lit, POWER.contrast, POWER.ua,
+            POWER.us ? (unsigned long)(POWER.ua_us / POWER.us) : 0,
+            (unsigned long)(POWER.ua_us / 3600000000ULL),
+            (unsigned long)(POWER.us / 1000000));
 }
 
-void casio_process_dt_event(int e, CASIO *c)
+//
+// console "time": print or set the time. Every field is checked, and a
+// bare number needs at least 5 digits, so "time 2024" is taken for the
+// year it looks like and refused, not set as 00:33:44 on 1970-01-01.
+//
+#define TIME_YEAR_MIN   1970
+#define TIME_YEAR_MAX   2105        // the epoch runs out in 2106
+
+//
+// parse 'arg' as EPOCH or Y-M-D H:M:S into *epoch. Returns 0, or prints
+// why not and returns -1.
+//
+int casio_console_time_parse(const char *arg, unsigned long *epoch)
 {
-    int xx;
+    static const unsigned char month_days[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
+    DATE_TIME dt;
+    unsigned long long v;
+    int y, mo, d, h, mi, sec, n, days;
 
-    if( e == E_BUTTONB )
-    {
-        c->mode = M_HOME;
-    }
-    else if( e >= E_HEX_BUTTON_0 && e <= E_HEX_BUTTON_POUND )
+    n = 0;
+    if( sscanf(arg, "%d-%d-%d %d:%d:%d%n", &y, &mo, &d, &h, &mi, &sec, &n) == 6 && arg[n] == '\0' )
     {
-        xx = (e - E_HEX_BUTTON_0)+1;
-
-        tone(24, xx*100, 100);
-
-        if( e == E_HEX_BUTTON_A )
+        if( y < TIME_YEAR_MIN || y > TIME_YEAR_MAX )
         {
-            c->dt.flags.show_home = 1;
+            Serial.printf("time: year %d, not %d to %d\r\n", y, TIME_YEAR_MIN, TIME_YEAR_MAX);
+            return -1;
         }
-        else if( e == E_HEX_BUTTON_D )
+        if( mo < 1 || mo > 12 )
         {
-            c->dt.flags.show_db = 1;
+            Serial.printf("time: month %d, not 1 to 12\r\n", mo);
+            return -1;
         }
+        days = (mo == 2 && IsLeapYear(y)) ? 29 : month_days[mo-1];
+        if( d < 1 || d > days )
+        {
+            Serial.printf("time: day %d, not 1 to %d\r\n", d, days);
+            return -1;
+        }
+        if( h < 0 || h > 23 || mi < 0 || mi > 59 || sec < 0 || sec > 59 )
+        {
+            Serial.printf("time: %d:%d:%d, not 00:00:00 to 23:59:59\r\n", h, mi, sec);
+            return -1;
+        }
+
+        dt.date.year = y;
+        dt.date.month = mo;
+        dt.date.day = d;
+        dt.time.hours = h;
+        dt.time.minutes = mi;
+        dt.time.seconds = sec;
+        *epoch = date_time_to_epoch(&dt);
+        return 0;
     }
-    else if( e == E_HEX_BUTTON_A_RELEASE )
-    {
-        c->dt.flags.show_home = 0;
-    }
-    else if( e == E_HEX_BUTTON_D_RELEASE )
+
+    // EPOCH: digits only, 5 or more, and it has to fit 32 bits
+    v = 0;
+    for(n=0; arg[n] >= '0' && arg[n] <= '9'; n++)
     {
-        c->dt.flags.show_db = 0;
+        if( v <= 0xffffffffULL )
+            v = v*10 + (arg[n] - '0');
     }
-}
 
-void casio_process_event(int e, CASIO *c)
-{
-    if( e == E_SECONDS_TIMER )
+    if( n == 0 || arg[n] != '\0' )
     {
-        c->home.now = epoch_to_date_time(DEVICE.epoch);
+        Serial.printf("time: expected EPOCH or YYYY-MM-DD HH:MM:SS, not \"%s\"\r\n", arg);
+        return -1;
     }
-
-    if( e == E_BUTTONL )
+    if( n < 5 )
     {
-        if( ! c->home.flags.light )
-        {
-            c->home.flags.light = 1;
-            DEVICE.light = 160;
-            disp_set_contrast(0xff);
-        }
+        Serial.printf("time: %s looks like a year, use YYYY-MM-DD HH:MM:SS\r\n", arg);
+        return -1;
     }
-
-    if( e == E_LIGHT_OFF )
+    if( v > 0xffffffffULL )
     {
-        c->home.flags.light = 0;
-        disp_set_contrast(0x7f);
+        Serial.printf("time: %s is past 2106\r\n", arg);
+        return -1;
     }
 
-    switch(c->mode)
+    *epoch = (unsigned long)v;
+    return 0;
+}
+
+void casio_console_time(const char *arg)
+{
+    DATE_TIME dt;
+    unsigned long epoch;
+
+    if( *arg == '\0' )
     {
-    case M_HOME:
-        casio_process_home_event(e, c);
-        break;
-    case M_DB:
-        casio_process_db_event(e, c);
-        break;
-    case M_CAL:
-        casio_process_cal_event(e, c);
-        break;
-    case M_AL:
-        casio_process_al_event(e, c);
-        break;
-    case M_ST:
-        casio_process_st_event(e, c);
-        break;
-    case M_DT:
-        casio_process_dt_event(e, c);
-        break;
+        epoch = DEVICE.epoch;
     }
-
-    // cancel high speed tick events if stop watch not running
-    if( (c->mode == M_ST && c->st.flags.running)
-        || (c->mode == M_DB && c->db.init > 0) )
+    else if( casio_console_time_parse(arg, &epoch) )
     {
-        DEVICE.counter15_enable = 1;
+        return;
     }
     else
     {
-        DEVICE.counter15_enable = 0;
+        noInterrupts();
+        DEVICE.epoch = epoch;
+        DEVICE.counter100 = 0;
+        DEVICE.slew = 0;
+        interrupts();
     }
+
+    dt = epoch_to_date_time(epoch);
+    Serial.printf("time %lu %d-%02d-%02d %02d:%02d:%02d\r\n", epoch,
+            dt.date.year, dt.date.month, dt.date.day,
+            dt.time.hours, dt.time.minutes, dt.time.seconds);
 }
 
-void casio_init(CASIO *c)
+//
+// console "state": the live watch
+//
+void casio_console_state()
 {
-    memset(c, 0, sizeof(*c));
-    c->mode = M_HOME;
+    CASIO *c = LOG.live;
 
-    c->home.dt.date.day = 24;
-    c->home.dt.date.month = 4;
-    c->home.dt.date.year = 2022;
+    if( c == NULL )
+        return;
 
-    c->home.dt.time.hours = 13;
-    c->home.dt.time.minutes = 58;
-    c->home.dt.time.seconds = 00;
+    Serial.printf("mode %d clock %ld epoch %lu now %d-%02d-%02d %02d:%02d:%02d dow %d\r\n",
+            c->mode, c->clock, c->epoch,
+            c->home.now.date.year, c->home.now.date.month, c->home.now.date.day,
+            c->home.now.time.hours, c->home.now.time.minutes, c->home.now.time.seconds,
+            c->home.now.date.dow);
+    Serial.printf("home light %d hrs24 %d lang %d contrast %d\r\n",
+            c->home.flags.light != 0, c->home.flags.hrs24 != 0, c->home.lang, c->home.contrast);
+    Serial.printf("db init %d page %d pos %d\r\n", c->db.init, c->db.page, c->db.pos);
+    Serial.printf("cal current \"%s\" op %d acc %g\r\n", c->cal.current, c->cal.op, c->cal.acc);
+    Serial.printf("st running %d split %d start %ld stop %ld split %ld\r\n",
+            c->st.flags.running != 0, c->st.flags.split != 0,
+            c->st.timer_start, c->st.timer_stop, c->st.timer_split);
+    Serial.printf("log recording %d events %lu bytes %d\r\n", LOG.recording, LOG.events, LOG.len);
+}
 
-    c->home.contrast = 0x7f;
+//////////////////////////////////////////////////////////////////////
+// frame governor
+//
+// casio_run() processes every event that is waiting before it draws,
+// so a burst (key press and release, a tick, E_LIGHT_OFF) costs one
+// frame instead of four. Frames are also kept at least GOV.min_us
+// apart: a screen that changes faster than that is drawn once at the
+// end of the interval, and until then the loop sleeps in
+// device_wait_event() instead of polling. Keys and buttons are urgent
+// and are drawn at once, so the governor never adds latency to typing.
+//
+// Console "frame" prints the counters, "frame US" sets the interval:
+//
+//      frame: 5230 events 4340 frames (1.20 events/frame), 890 dropped 12 deferred 3 preempted, min 20000 us
+//      key latency: 212 keys avg 4210 us max 9950 us
+//
+// dropped are the frames not drawn because events shared one, deferred
+// the times min_us held a frame back, preempted the transfers cut short
+// by a key (see disp_update_pages). Key latency is from the key or
+// button interrupt until the frame showing it is on the display.
+//
+#define GOV_MIN_US      20000       // 50 fps
+#define GOV_MAX_EVENTS  16          // per frame, so a flood can't starve the display
 
-    DEVICE.epoch = date_time_to_epoch(&c->home.dt);
+static struct
+{
+    unsigned long min_us;
+    unsigned long last;             // micros() of the last frame
+    unsigned long events;
+    unsigned long frames;
+    unsigned long deferred;
+    unsigned long preempted;
+    unsigned long key_us;           // DEVICE.input_us of the oldest key not yet shown, 0 = none
+    unsigned long keys;
+    unsigned long key_total;        // latency, us
+    unsigned long key_max;
+} GOV = { GOV_MIN_US };
+
+void casio_console_frame(const char *arg)
+{
+    unsigned long us, per100;
+
+    if( sscanf(arg, "%lu", &us) == 1 )
+        GOV.min_us = us;
+
+    per100 = GOV.frames ? GOV.events * 100 / GOV.frames : 0;
+    Serial.printf("frame: %lu events %lu frames (%lu.%02lu events/frame), %lu dropped %lu deferred %lu preempted, min %lu us\r\n",
+            GOV.events, GOV.frames, per100 / 100, per100 % 100,
+            GOV.events > GOV.frames ? GOV.events - GOV.frames : 0,
+            GOV.deferred, GOV.preempted, GOV.min_us);
+    Serial.printf("key latency: %lu keys avg %lu us max %lu us\r\n",
+            GOV.keys, GOV.keys ? GOV.key_total / GOV.keys : 0, GOV.key_max);
 }
 
 void casio_run()
 {
     CASIO c;
-    int e;
+    unsigned long us;
+    int e, n, dirty, urgent, live, rc;
 
     make_ascii();
+    make_font_metrics();
 
     device_setup();
 
     casio_init(&c);
+    DEVICE.epoch = c.epoch;
+    LOG.live = &c;
 
     disp_clear();
 
+    dirty = 0;
+    urgent = 0;
     for(;;)
     {
-        e = device_get_event();
+        // wait for an event, or with a frame held back by min_us until
+        // it is due (an urgent one is due now). Blocked is idle, however
+        // long it takes; only taking the event counts against the event
+        // budget.
+        device_stage(S_IDLE, 0);
+        if( dirty )
+            e = device_wait_event(urgent ? micros() : GOV.last + GOV.min_us);
+        else
+            e = device_get_event();
+        device_stage(S_EVENT, 0);
 
-        casio_process_event(e, &c);
-        casio_update_screen(&c);
+        live = 0;
+        for(n=0; e != E_NONE; )
+        {
+            c.clock = DEVICE.clock;
+            c.epoch = DEVICE.epoch;
+            if( e == E_LIVE )
+            {
+                live = 1;
+            }
+            else
+            {
+                device_stage(S_PROCESS, e);
+                casio_process_event(e, &c);
+                casio_log_event(&c, e);
+                GOV.events++;
+                dirty = 1;
+                if( casio_urgent_event(e) )
+                {
+                    urgent = 1;
+                    if( GOV.key_us == 0 )
+                        GOV.key_us = DEVICE.input_us | 1;
+                }
+            }
+
+            if( ++n >= GOV_MAX_EVENTS )
+                break;
+            device_stage(S_EVENT, 0);
+            e = device_poll_event();
+        }
+
+        if( DEVICE.cycles )
+        {
+            DEVICE.cycles = 0;
+            device_stage(S_COMMAND, 0);
+            casio_cycles();
+        }
+
+        if( dirty && (urgent || micros() - GOV.last >= GOV.min_us) )
+        {
+            rc = casio_update_screen(&c);
+            if( rc == DISP_PREEMPTED )
+            {
+                GOV.preempted++;
+                continue;       // still dirty, the key is drawn next
+            }
+
+            GOV.last = micros();
+            GOV.frames++;
+            dirty = 0;
+            urgent = 0;
+
+            if( GOV.key_us )
+            {
+                us = GOV.last - GOV.key_us;
+                GOV.keys++;
+                GOV.key_total += us;
+                if( us > GOV.key_max )
+                    GOV.key_max = us;
+                GOV.key_us = 0;
+            }
+        }
+        else if( dirty )
+        {
+            if( n > 0 )
+                GOV.deferred++;
+        }
+        else if( live )
+        {
+            casio_update_live(&c);
+        }
     }
 }
 
@@ -2808,7 +8343,9 @@ void casio_run()
 // end CASIO
 //////////////////////////////////////////////////////////////////////
 
+#if !defined(CASIO_HOST) && !defined(CASIO_FUZZ)
 extern "C" int main(void)
 {
     casio_run();
 }
+#endif
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+#
+# benchcmp.py - capture the watch micro benchmarks and compare runs
+#
+# usage:
+#   benchcmp.py /dev/ttyACM0 run.json           run the benchmarks ('b'), save JSON
+#   benchcmp.py base.json run.json              compare a run against a baseline
+#   benchcmp.py base.json /dev/ttyACM0          run and compare in one go
+#
+# The comparison lists every benchmark with its change in time per
+# iteration. Anything slower than the baseline by more than THRESHOLD
+# is marked, and the exit status is 1 if there was any such regression.
+#
+# See "micro benchmarks" in main.cpp.
+#
+
+import json
+import sys
+
+THRESHOLD = 0.05        # 5%
+
+
+def capture(dev):
+    """run the benchmarks on the watch, returns the JSON text"""
+    f = open(dev, 'r+b', buffering=0)
+    f.write(b'b\n')
+
+    lines = []
+    depth = 0
+    while True:
+        line = f.readline().decode('ascii', 'replace').rstrip()
+        if not lines and not line.startswith('{'):
+            continue        # other output from Serial.printf
+        lines.append(line)
+        depth += line.count('{') - line.count('}')
+        if depth == 0:
+            break
+    f.close()
+
+    return '\n'.join(lines) + '\n'
+
+
+def load(src):
+    if src.startswith('/dev/'):
+        return json.loads(capture(src))
+    with open(src) as f:
+        return json.load(f)
+
+
+def times(run):
+    return dict((b['name'], b['real_time']) for b in run['benchmarks'])
+
+
+def compare(base, new):
+    old = times(base)
+    cur = times(new)
+    regressions = 0
+
+    print('%-28s %12s %12s %8s' % ('benchmark', 'base ns', 'new ns', 'change'))
+    for name in cur:
+        if name not in old:
+            print('%-28s %12s %12.1f' % (name, '-', cur[name]))
+            continue
+        change = (cur[name] - old[name]) / old[name] if old[name] else 0.0
+        mark = ''
+        if change > THRESHOLD:
+            mark = '  SLOWER'
+            regressions += 1
+        print('%-28s %12.1f %12.1f %+7.1f%%%s' %
+              (name, old[name], cur[name], change * 100, mark))
+
+    return regressions
+
+
+def main():
+    args = sys.argv[1:]
+    if len(args) != 2:
+        sys.stderr.write('usage: benchcmp.py DEVICE OUT.json | BASE.json NEW.json|DEVICE\n')
+        sys.exit(2)
+
+    if args[0].startswith('/dev/'):
+        with open(args[1], 'w') as f:
+            f.write(capture(args[0]))
+        return
+
+    if compare(load(args[0]), load(args[1])):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
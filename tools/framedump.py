@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+#
+# framedump.py - capture the watch display over USB serial as PBM images
+#
+# usage:
+#   framedump.py /dev/ttyACM0 shot.pbm           one screenshot
+#   framedump.py /dev/ttyACM0 -m frames/         mirror mode, one PBM per frame
+#   framedump.py capture.bin -m frames/          decode a saved stream
+#
+# See "frame mirror" in main.cpp for the packet format.
+#
+
+import os
+import sys
+
+FRAME_SIZE = 1024
+WIDTH = 128
+HEIGHT = 64
+SYNC = 0xA5
+
+
+def read_exact(f, n):
+    data = b''
+    while len(data) < n:
+        chunk = f.read(n - len(data))
+        if not chunk:
+            raise EOFError
+        data += chunk
+    return data
+
+
+def read_packet(f):
+    """return (type, seq, payload) for the next packet in the stream"""
+    while True:
+        b = read_exact(f, 1)
+        if b[0] != SYNC:
+            continue        # serial noise, or text from Serial.printf
+        hdr = read_exact(f, 5)
+        kind = chr(hdr[0])
+        if kind not in 'KD':
+            continue
+        seq = hdr[1] | (hdr[2] << 8)
+        length = hdr[3] | (hdr[4] << 8)
+        return kind, seq, read_exact(f, length)
+
+
+def apply(kind, payload, prev):
+    """undo the XOR/RLE encoding, returns the new frame"""
+    if kind == 'K':
+        base = bytes([payload[0]]) * FRAME_SIZE
+        payload = payload[1:]
+    else:
+        base = prev
+
+    delta = bytearray()
+    i = 0
+    while i < len(payload):
+        if payload[i] == 0:
+            delta += bytes(payload[i + 1] + 1)
+            i += 2
+        else:
+            delta.append(payload[i])
+            i += 1
+
+    if len(delta) != FRAME_SIZE:
+        raise ValueError('bad frame: %d bytes' % len(delta))
+
+    return bytes(a ^ b for a, b in zip(base, delta))
+
+
+def write_pbm(path, frame):
+    """lit pixels are drawn black"""
+    rows = bytearray()
+    for y in range(HEIGHT):
+        for xb in range(0, WIDTH, 8):
+            v = 0
+            for x in range(xb, xb + 8):
+                bit = (frame[x + (y >> 3) * WIDTH] >> (y & 7)) & 1
+                v = (v << 1) | bit
+            rows.append(v)
+    with open(path, 'wb') as f:
+        f.write(b'P4\n%d %d\n' % (WIDTH, HEIGHT))
+        f.write(rows)
+
+
+def main():
+    args = sys.argv[1:]
+    mirror = '-m' in args
+    args = [a for a in args if a != '-m']
+    if len(args) != 2:
+        sys.stderr.write('usage: framedump.py DEVICE [-m] OUT\n')
+        sys.exit(2)
+
+    src, out = args
+    is_tty = src.startswith('/dev/')
+    f = open(src, 'r+b' if is_tty else 'rb', buffering=0)
+
+    if is_tty:
+        f.write(b'mirror on\n' if mirror else b's\n')
+
+    if mirror:
+        os.makedirs(out, exist_ok=True)
+
+    frame = None
+    last_seq = None
+    try:
+        while True:
+            kind, seq, payload = read_packet(f)
+            if kind == 'D' and frame is None:
+                continue        # need a key frame first
+            if last_seq is not None and seq != (last_seq + 1) & 0xffff:
+                sys.stderr.write('lost packets before %d\n' % seq)
+            last_seq = seq
+
+            frame = apply(kind, payload, frame)
+
+            if not mirror:
+                write_pbm(out, frame)
+                break
+            write_pbm(os.path.join(out, 'frame%05d.pbm' % seq), frame)
+    except (EOFError, KeyboardInterrupt):
+        pass
+    finally:
+        if is_tty and mirror:
+            f.write(b'mirror off\n')
+        f.close()
+
+
+if __name__ == '__main__':
+    main()
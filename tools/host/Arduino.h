@@ -0,0 +1,90 @@
+//
+// Arduino.h - just enough of the Teensy core to build main.cpp on a
+// host (tools/host). There are no pins, timers or interrupts; the
+// serial port is stdout, and micros()/millis() are the monotonic clock.
+// Only the headless paths (soak, warp, self test, fuzz) are meaningful.
+//
+#ifndef CASIO_HOST_ARDUINO_H
+#define CASIO_HOST_ARDUINO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define INPUT_PULLDOWN  3
+#define RISING          4
+#define CHANGE          5
+#define FALLING         6
+
+#define FASTRUN
+#define FLASHMEM
+#define DMAMEM
+#define PROGMEM
+
+#define F_CPU_ACTUAL    600000000
+
+extern volatile uint32_t host_cyccnt, host_demcr, host_dwtctrl;
+
+#define ARM_DWT_CYCCNT          host_cyccnt
+#define ARM_DEMCR               host_demcr
+#define ARM_DEMCR_TRCENA        0
+#define ARM_DWT_CTRL            host_dwtctrl
+#define ARM_DWT_CTRL_CYCCNTENA  0
+
+typedef void (*host_isr)();
+
+class IntervalTimer
+{
+public:
+    bool begin(host_isr f, unsigned long us) volatile { return true; }
+    void priority(int prio) volatile {}
+    void update(unsigned long us) volatile {}
+    void end() volatile {}
+};
+
+uint32_t micros();
+uint32_t millis();
+
+inline void delay(uint32_t ms) {}
+inline void delayMicroseconds(uint32_t us) {}
+inline void pinMode(int pin, int mode) {}
+inline int digitalRead(int pin) { return LOW; }
+inline void digitalWrite(int pin, int v) {}
+inline void digitalWriteFast(int pin, int v) {}
+inline void attachInterrupt(int pin, host_isr f, int mode) {}
+inline void tone(int pin, int freq, int ms) {}
+inline void noTone(int pin) {}
+inline void interrupts() {}
+inline void noInterrupts() {}
+
+class HostSerial
+{
+public:
+    void begin(long baud) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(const unsigned char *buf, size_t len) { return fwrite(buf, 1, len, stdout); }
+    size_t write(const char *buf, size_t len) { return fwrite(buf, 1, len, stdout); }
+    void println(const char *s) { printf("%s\r\n", s); }
+    int printf(const char *fmt, ...)
+    {
+        va_list ap;
+        int n;
+
+        va_start(ap, fmt);
+        n = vprintf(fmt, ap);
+        va_end(ap);
+        return n;
+    }
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,34 @@
+//
+// EEPROM.h - a host EEPROM in memory, erased (0xff) at start
+// (see Arduino.h)
+//
+#ifndef CASIO_HOST_EEPROM_H
+#define CASIO_HOST_EEPROM_H
+
+#include <string.h>
+
+#define HOST_EEPROM_SIZE 4284   // Teensy 4.1
+
+class HostEEPROM
+{
+public:
+    unsigned char mem[HOST_EEPROM_SIZE];
+
+    HostEEPROM() { memset(mem, 0xff, sizeof(mem)); }
+
+    template <class T> T &get(int addr, T &v)
+    {
+        memcpy(&v, mem + addr, sizeof(T));
+        return v;
+    }
+
+    template <class T> const T &put(int addr, const T &v)
+    {
+        memcpy(mem + addr, &v, sizeof(T));
+        return v;
+    }
+};
+
+extern HostEEPROM EEPROM;
+
+#endif
@@ -0,0 +1,25 @@
+//
+// Wire.h - a host I2C bus with nothing on it, every transfer succeeds
+// (see Arduino.h)
+//
+#ifndef CASIO_HOST_WIRE_H
+#define CASIO_HOST_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire
+{
+public:
+    void setSDA(int pin) {}
+    void setSCL(int pin) {}
+    void begin() {}
+    void setClock(long hz) {}
+    void beginTransmission(int addr) {}
+    size_t write(const unsigned char *buf, size_t len) { return len; }
+    size_t write(const char *buf, size_t len) { return len; }
+    int endTransmission(bool stop = true) { return 0; }
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,188 @@
+//
+// farm.cpp - the soak test (casio_soak(), serial command 'o') on every
+// core of a host
+//
+// usage: farm [INSTANCES [EVENTS [THREADS]]]
+//
+// Builds main.cpp against the stubs in this directory (see Makefile)
+// and runs INSTANCES headless watches, EVENTS random events each, on
+// THREADS workers (default: one per core). Each worker has its own
+// queue of instances. It runs the one at the back of its queue for
+// FARM_SLICE events and puts it back, and when its queue is empty it
+// steals from the front of the other workers' queues, so the cores
+// stay busy however uneven the instances turn out to be.
+//
+// Prints the events/s of every worker and of the whole farm. The exit
+// status is 1 if any instance failed a check.
+//
+#define CASIO_HOST
+#define CASIO_TLS thread_local  // a DRAWING per thread, see main.cpp
+
+// (before main.cpp, which poisons sprintf and friends)
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../../main.cpp"
+
+#define FARM_INSTANCES  4096
+#define FARM_EVENTS     SOAK_EVENTS
+#define FARM_SLICE      250         // events per turn of an instance
+
+typedef struct {
+    std::mutex lock;
+    std::deque<int> queue;          // instances waiting for their next slice
+    unsigned long events;
+    unsigned long instances;        // run to the end by this worker
+    unsigned long steals;
+    double seconds;                 // from start until it ran out of work
+} WORKER;
+
+static struct {
+    SOAK *soak;
+    int *left;                      // events still to run, per instance
+    WORKER *workers;
+    int threads;
+    std::chrono::steady_clock::time_point start;
+} FARM;
+
+//
+// take an instance from the back of worker w's queue, or steal one from
+// the front of another's. Returns -1 once every queue is empty.
+//
+static int farm_take(int w)
+{
+    WORKER *me = &FARM.workers[w];
+    int i, n;
+
+    {
+        std::lock_guard<std::mutex> g(me->lock);
+        if( ! me->queue.empty() )
+        {
+            n = me->queue.back();
+            me->queue.pop_back();
+            return n;
+        }
+    }
+
+    for(i=1; i < FARM.threads; i++)
+    {
+        WORKER *victim = &FARM.workers[(w + i) % FARM.threads];
+        std::lock_guard<std::mutex> g(victim->lock);
+
+        if( ! victim->queue.empty() )
+        {
+            n = victim->queue.front();
+            victim->queue.pop_front();
+            me->steals++;
+            return n;
+        }
+    }
+
+    return -1;
+}
+
+static void farm_worker(int w)
+{
+    WORKER *me = &FARM.workers[w];
+    char frame[FRAME_SIZE];
+    unsigned long before;
+    int n, count;
+
+    while( (n = farm_take(w)) >= 0 )
+    {
+        count = FARM.left[n] < FARM_SLICE ? FARM.left[n] : FARM_SLICE;
+        FARM.left[n] -= count;
+
+        before = FARM.soak[n].events;
+        casio_soak_run(&FARM.soak[n], n, count, frame);
+        me->events += FARM.soak[n].events - before;
+
+        if( FARM.left[n] > 0 )
+        {
+            std::lock_guard<std::mutex> g(me->lock);
+            me->queue.push_back(n);
+        }
+        else
+        {
+            me->instances++;
+        }
+    }
+
+    me->seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - FARM.start).count();
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::thread> pool;
+    unsigned long events, failed;
+    double elapsed;
+    int instances, count, n, w;
+
+    instances = argc > 1 ? atoi(argv[1]) : FARM_INSTANCES;
+    count = argc > 2 ? atoi(argv[2]) : FARM_EVENTS;
+    FARM.threads = argc > 3 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    if( instances < 1 || count < 1 )
+    {
+        fprintf(stderr, "usage: %s [INSTANCES [EVENTS [THREADS]]]\n", argv[0]);
+        return 2;
+    }
+    if( FARM.threads < 1 )
+        FARM.threads = 1;
+
+    // the shared tables, read only from here on
+    make_ascii();
+    make_font_metrics();
+
+    FARM.soak = new SOAK[instances];
+    FARM.left = new int[instances];
+    FARM.workers = new WORKER[FARM.threads];
+
+    // deal the instances out round robin
+    for(n=0; n < instances; n++)
+    {
+        casio_soak_init(&FARM.soak[n], n);
+        FARM.left[n] = count;
+        FARM.workers[n % FARM.threads].queue.push_back(n);
+    }
+
+    FARM.start = std::chrono::steady_clock::now();
+
+    for(w=0; w < FARM.threads; w++)
+        pool.push_back(std::thread(farm_worker, w));
+    for(w=0; w < FARM.threads; w++)
+        pool[w].join();
+
+    elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - FARM.start).count();
+
+    events = 0;
+    for(w=0; w < FARM.threads; w++)
+    {
+        WORKER *me = &FARM.workers[w];
+
+        printf("core %d: %lu events %.0f events/s, %lu instances, %lu steals\n",
+                w, me->events,
+                me->seconds > 0 ? me->events / me->seconds : 0.0,
+                me->instances, me->steals);
+        events += me->events;
+    }
+
+    failed = 0;
+    for(n=0; n < instances; n++)
+    {
+        if( FARM.soak[n].failures )
+            failed++;
+    }
+
+    printf("farm %d instances %d threads %lu events %.3f s %.0f events/s (%.0f per core), %lu failed\n",
+            instances, FARM.threads, events, elapsed,
+            elapsed > 0 ? events / elapsed : 0.0,
+            elapsed > 0 ? events / elapsed / FARM.threads : 0.0,
+            failed);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+//
+// fuzz.cpp - the fuzz entry point of main.cpp (casio_fuzz_input()) on
+// a host, see "fuzzing" in main.cpp and the Makefile
+//
+// With clang (make fuzz) this is the libFuzzer target, the usual
+// options apply:
+//
+//   ./fuzz -max_len=4096 corpus/
+//
+// Without libFuzzer (make fuzz-asan, any compiler with ASan/UBSan) the
+// main() below is the driver: it runs each file named on the command
+// line, or with no arguments FUZZ_HOST_RUNS random inputs, and prints
+// the rate. A failed check aborts, like under libFuzzer; a random input
+// that did it is written to crash.bin first.
+//
+#define CASIO_FUZZ
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "../../main.cpp"
+
+#ifndef CASIO_LIBFUZZER
+
+#define FUZZ_HOST_RUNS  20000
+#define FUZZ_HOST_LEN   1024        // random inputs are 1..FUZZ_HOST_LEN bytes
+
+static unsigned char fuzz_data[FUZZ_HOST_LEN];
+static int fuzz_len;
+
+static void fuzz_abort(int sig)
+{
+    FILE *f;
+
+    f = fopen("crash.bin", "wb");
+    if( f != NULL )
+    {
+        fwrite(fuzz_data, 1, fuzz_len, f);
+        fclose(f);
+    }
+    write(2, "fuzz: failed, input in crash.bin\n", 33);
+    _exit(1);
+}
+
+static int fuzz_file(const char *name)
+{
+    static unsigned char data[65536];
+    FILE *f;
+    size_t n;
+
+    f = fopen(name, "rb");
+    if( f == NULL )
+    {
+        perror(name);
+        return -1;
+    }
+    n = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    LLVMFuzzerTestOneInput(data, n);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long x, start, elapsed;
+    int run, i;
+
+    if( argc > 1 )
+    {
+        for(i=1; i < argc; i++)
+        {
+            if( fuzz_file(argv[i]) )
+                return 2;
+        }
+        printf("fuzz %d inputs ok\n", argc - 1);
+        return 0;
+    }
+
+    signal(SIGABRT, fuzz_abort);
+
+    x = 2463534242UL;
+    start = micros();
+
+    for(run=0; run < FUZZ_HOST_RUNS; run++)
+    {
+        x ^= (x << 13) & 0xffffffffUL;
+        x ^= x >> 17;
+        x ^= (x << 5) & 0xffffffffUL;
+        fuzz_len = 1 + x % FUZZ_HOST_LEN;
+
+        for(i=0; i < fuzz_len; i++)
+        {
+            x ^= (x << 13) & 0xffffffffUL;
+            x ^= x >> 17;
+            x ^= (x << 5) & 0xffffffffUL;
+            fuzz_data[i] = x;
+        }
+
+        LLVMFuzzerTestOneInput(fuzz_data, fuzz_len);
+    }
+
+    elapsed = micros() - start;
+    printf("fuzz %d runs %lu us %lu execs/s\n", FUZZ_HOST_RUNS, elapsed,
+            elapsed ? (unsigned long)((FUZZ_HOST_RUNS * 1000000.0) / elapsed) : 0);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,30 @@
+//
+// host.cpp - the objects behind the host Arduino.h, Wire.h and EEPROM.h
+//
+#include <time.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "EEPROM.h"
+
+volatile uint32_t host_cyccnt, host_demcr, host_dwtctrl;
+
+HostSerial Serial;
+TwoWire Wire;
+HostEEPROM EEPROM;
+
+uint32_t micros()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+uint32_t millis()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
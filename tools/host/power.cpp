@@ -0,0 +1,24 @@
+//
+// power.cpp - the power day (serial command 'u', casio_power_day() in
+// main.cpp) on a host
+//
+// usage: power
+//
+// Prints the display's mAh/day, average mA and average lit pixels
+// under each power policy, as 'u' does. The watch draws the same
+// frames on a host, so only the POWER_* numbers need the hardware.
+// "make power" builds and runs it.
+//
+#define CASIO_HOST
+
+#include "../../main.cpp"
+
+int main(int argc, char **argv)
+{
+    make_ascii();
+    make_font_metrics();
+
+    casio_power_day();
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+//
+// replay.cpp - replay an event log dumped by the watch (serial command
+// 'd', see "event log" in main.cpp) on a host
+//
+// usage: replay FILE
+//
+// FILE is a capture of the serial port while 'd' ran, e.g.
+//
+//   stty -F /dev/ttyACM0 raw; cat /dev/ttyACM0 > log.bin
+//
+// and anything else the watch sent around the dump is skipped. Loads
+// the start state, plays the events headless and compares the digest
+// of the frames with the one the watch recorded. The exit status is 1
+// on a mismatch, 2 if there's no dump in FILE.
+//
+#define CASIO_HOST
+
+#include "../../main.cpp"
+
+static unsigned char replay_data[2 * (6 + 2 + CASIO_STATE_SIZE + 8 + LOG_SIZE)];
+
+int main(int argc, char **argv)
+{
+    CASIO c;
+    const unsigned char *p;
+    unsigned long digest, events, got, n;
+    FILE *f;
+    int len, size, i;
+
+    if( argc != 2 )
+    {
+        fprintf(stderr, "usage: %s FILE\n", argv[0]);
+        return 2;
+    }
+
+    f = fopen(argv[1], "rb");
+    if( f == NULL )
+    {
+        perror(argv[1]);
+        return 2;
+    }
+    n = fread(replay_data, 1, sizeof(replay_data), f);
+    fclose(f);
+
+    make_ascii();
+    make_font_metrics();
+
+    // find the packet: 0xA5 'L' 0 0 len-lo len-hi
+    for(i=0; i + 6 <= (int)n; i++)
+    {
+        if( replay_data[i] == MIRROR_SYNC && replay_data[i+1] == 'L'
+            && replay_data[i+2] == 0 && replay_data[i+3] == 0 )
+            break;
+    }
+    if( i + 6 > (int)n )
+    {
+        fprintf(stderr, "%s: no log dump\n", argv[1]);
+        return 2;
+    }
+
+    p = replay_data + i + 4;
+    len = casio_state_get(&p, 2);
+    if( len < 2 || i + 6 + len > (int)n )
+    {
+        fprintf(stderr, "%s: log dump cut short\n", argv[1]);
+        return 2;
+    }
+    size = casio_state_get(&p, 2);
+    if( len < 2 + size + 8 || casio_state_load(&c, p, size) )
+    {
+        fprintf(stderr, "%s: start state of %d bytes, expected %d\n",
+                argv[1], size, CASIO_STATE_SIZE);
+        return 2;
+    }
+    p += size;
+    digest = casio_state_get(&p, 4);
+    events = casio_state_get(&p, 4);
+
+    got = casio_log_play(&c, p, len - 2 - size - 8, &n, 0);
+
+    printf("replay %lu events %s\n", n,
+            got != digest || n != events ? "MISMATCH" : "ok");
+
+    return got != digest || n != events ? 1 : 0;
+}
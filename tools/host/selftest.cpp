@@ -0,0 +1,27 @@
+//
+// selftest.cpp - the self test (serial command 't', casio_selftest()
+// in main.cpp) on a host, for CI
+//
+// usage: selftest
+//
+// Runs what 't' runs and prints what it prints: the scripted sessions
+// of every mode checked against SelftestGolden (with a PBM of the first
+// frame that went wrong), the time base trim, fmt_calc(), the stopwatch
+// cache and the preempted page updates. The exit status is 1 if any of
+// them failed. "make selftest" builds and runs it.
+//
+#define CASIO_HOST
+
+#include "../../main.cpp"
+
+int main(int argc, char **argv)
+{
+    int failed;
+
+    make_ascii();
+    make_font_metrics();
+
+    failed = casio_selftest();
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+#
+# timesync.py - keep the watch's clock in sync with this computer
+#
+# usage:
+#   timesync.py /dev/ttyACM0            sync every 64 seconds
+#   timesync.py /dev/ttyACM0 -1         sync once and exit
+#   timesync.py /dev/ttyACM0 600        sync every 10 minutes
+#
+# Answers the watch's time requests (see "time sync" in main.cpp) with
+# this computer's local time, and prints the watch's summary line after
+# every burst: the offset it found, the round trip delay, whether it
+# stepped or slewed, and the accuracy achieved.
+#
+
+import os
+import select
+import sys
+import time
+
+SYNC = 0xA5
+
+
+def now_us():
+    """local time (the watch has no time zone), microseconds since 1970"""
+    t = time.time()
+    return int((t + time.localtime(t).tm_gmtoff) * 1000000)
+
+
+def read_exact(fd, n, timeout):
+    data = b''
+    while len(data) < n:
+        r, _, _ = select.select([fd], [], [], timeout)
+        if not r:
+            raise TimeoutError
+        data += os.read(fd, n - len(data))
+    return data
+
+
+def burst(fd):
+    """run one burst, returns the watch's summary line"""
+    text = b''
+    os.write(fd, b'y\n')
+
+    while True:
+        b = read_exact(fd, 1, 2.0)
+        if b[0] != SYNC:
+            text += b
+            if b == b'\n':
+                line = text.decode('ascii', 'replace').strip()
+                text = b''
+                if line.startswith('sync:'):
+                    return line
+            continue
+
+        hdr = read_exact(fd, 5, 0.5)
+        length = hdr[3] | (hdr[4] << 8)
+        payload = read_exact(fd, length, 0.5)
+        if chr(hdr[0]) != 'Q':
+            continue            # mirror frames etc.
+
+        t2 = now_us()
+        reply = bytes([SYNC, ord('R'), hdr[1], hdr[2], 24, 0]) + payload[:8]
+        reply += t2.to_bytes(8, 'little')
+        t3 = now_us()
+        reply += t3.to_bytes(8, 'little')
+        os.write(fd, reply)
+
+
+def main():
+    args = sys.argv[1:]
+    if len(args) not in (1, 2):
+        sys.stderr.write('usage: timesync.py DEVICE [SECONDS]\n')
+        sys.exit(2)
+
+    interval = int(args[1]) if len(args) > 1 else 64
+    fd = os.open(args[0], os.O_RDWR | os.O_NOCTTY)
+
+    try:
+        while True:
+            try:
+                print(time.strftime('%H:%M:%S'), burst(fd))
+            except TimeoutError:
+                print(time.strftime('%H:%M:%S'), 'no answer from the watch')
+            sys.stdout.flush()
+            if interval < 0:
+                break
+            time.sleep(interval)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+
+
+if __name__ == '__main__':
+    main()